@@ -4,6 +4,7 @@
 #define __alarm_h
 
 #include <utility/queue.h>
+#include <utility/wheel.h>
 #include <utility/handler.h>
 #include <tsc.h>
 #include <rtc.h>
@@ -26,7 +27,13 @@ private:
     typedef TSC::Hertz Hertz;
     typedef Timer::Tick Tick;
 
-    typedef Relative_Queue<Alarm, Tick> Queue;
+    static const bool wheel = Traits<Alarm>::timing_wheel;
+    static const bool tickless = Alarm_Timer::tickless;
+
+    typedef IF<wheel, Timing_Wheel<Alarm, Tick>, Relative_Queue<Alarm, Tick> >::Result Queue;
+
+    template<bool> struct Wheel {};
+    template<bool> struct Tickless {};
 
 public:
     typedef RTC::Microsecond Microsecond;
@@ -59,6 +66,35 @@ private:
     static void lock() { Thread::lock(); }
     static void unlock() { Thread::unlock(); }
 
+    // The queue is a parameter so only the selected backend gets instantiated
+    void dequeue() { dequeue(&_request, Wheel<wheel>()); }
+    template<typename Q> void dequeue(Q * q, const Wheel<false> &);
+    template<typename Q> void dequeue(Q * q, const Wheel<true> &);
+
+    static void advance(const Tick & now);
+    template<typename Q> static void advance(Q * q, const Tick & ticks, const Wheel<false> &);
+    template<typename Q> static void advance(Q * q, const Tick & ticks, const Wheel<true> &);
+
+    static Alarm * expired() { return expired(&_request, Wheel<wheel>()); }
+    template<typename Q> static Alarm * expired(Q * q, const Wheel<false> &);
+    template<typename Q> static Alarm * expired(Q * q, const Wheel<true> &);
+    static void rearm(Queue::Element * e);
+
+    // Ticks until the next alarm expires (0 if none)
+    static Tick next() { return next(&_request, Wheel<wheel>()); }
+    template<typename Q> static Tick next(Q * q, const Wheel<false> &);
+    template<typename Q> static Tick next(Q * q, const Wheel<true> &);
+
+    // A periodic timer interrupts at every tick, while a tickless one only when the next alarm expires,
+    // so the current tick is read from the TSC and the timer must be rearmed whenever the queue changes
+    static Tick now() { return now(Tickless<tickless>()); }
+    static Tick now(const Tickless<false> &) { return _elapsed + 1; }
+    static Tick now(const Tickless<true> &) { return (TSC::time_stamp() - _epoch) / (TSC::frequency() / frequency()); }
+
+    static void program() { program(_timer, Tickless<tickless>()); }
+    template<typename T> static void program(T * timer, const Tickless<false> &) {}
+    template<typename T> static void program(T * timer, const Tickless<true> &) { timer->arm(next()); }
+
     static void handler(const IC::Interrupt_Id & i);
 
 private:
@@ -70,6 +106,7 @@ private:
 
     static Alarm_Timer * _timer;
     static volatile Tick _elapsed;
+    static TSC::Time_Stamp _epoch;
     static Queue _request;
 };
 
@@ -90,7 +90,11 @@ public:
 
     // CR4 Flags
     enum {
-        CR4_PSE     = 1 << 8    // CR4 Performance Counter Enable
+        CR4_PSE         = 1 << 4,   // Page Size Extensions (4 MiB pages)
+        CR4_PGE         = 1 << 7,   // Page Global Enable
+        CR4_PCE         = 1 << 8,   // Performance-Monitoring Counter Enable (RDPMC at CPL 3)
+        CR4_OSFXSR      = 1 << 9,   // OS supports FXSAVE/FXRSTOR (enables SSE)
+        CR4_OSXMMEXCPT  = 1 << 10   // OS supports unmasked SIMD floating-point exceptions
     };
 
     // Segment Flags
@@ -297,6 +301,31 @@ public:
         Reg32 _eflags;
     };
 
+    // FPU Context (x87/MMX/SSE state, as stored by FXSAVE)
+    // It is switched lazily: dispatching a thread sets CR0.TS, so the first FPU/SSE instruction it executes
+    // traps (#NM) into fpu_trap(), which only then saves the state of the FPU's owner and restores the thread's
+    class FPU_Context
+    {
+        friend class IA32;
+
+    private:
+        static const unsigned int SIZE = Traits<IA32_FPU>::enabled ? 512 : 0;
+        static const unsigned int ALIGNMENT = 16;
+
+    public:
+        FPU_Context(): _used(false) {}
+
+    private:
+        void * area() { return reinterpret_cast<void *>((reinterpret_cast<unsigned int>(_area) + ALIGNMENT - 1) & ~(ALIGNMENT - 1)); }
+
+        void save() { ASM("fxsave (%0)" : : "r"(area()) : "memory"); }
+        void load() { ASM("fxrstor (%0)" : : "r"(area()) : "memory"); }
+
+    private:
+        bool _used; // the thread has already used the FPU, so its state must be restored
+        char _area[SIZE + ALIGNMENT];
+    };
+
     // I/O ports
     typedef Reg16 IO_Port;
     typedef Reg16 IO_Irq;
@@ -319,9 +348,17 @@ public:
     static bool int_disabled() { return !int_enabled(); }
 
     static void halt() { ASM("hlt"); }
+    static void pause() { ASM("pause"); } // spin-wait hint
 
     static void switch_context(Context * volatile * o, Context * volatile n);
 
+    static void fpu_switch(FPU_Context * prev, FPU_Context * next) {
+        if(Traits<IA32_FPU>::enabled)
+            lazy_fpu_switch(prev, next);
+    }
+    static void fpu_release(FPU_Context * c);
+    static void fpu_trap();
+
     static void syscall(void * message);
     static void syscalled();
 
@@ -371,6 +408,81 @@ public:
     static Reg32 ntohl(Reg32 v) { return htonl(v); }
     static Reg16 ntohs(Reg16 v) { return htons(v); }
 
+    static const unsigned int SSE2_THRESHOLD = 64; // smaller blocks are not worth saving XMM registers
+
+    // With SSE2, 16 bytes are summed per iteration: the 32-bit words are unpacked into the 64-bit lanes
+    // of an accumulator. XMM0-3 are preserved, since these may run in interrupt handlers.
+    static unsigned long long sum32(const void * data, unsigned int size) {
+        if(!Traits<IA32>::sse2 || (size < SSE2_THRESHOLD))
+            return CPU_Common::sum32(data, size);
+
+        const char * src = reinterpret_cast<const char *>(data);
+        unsigned int blocks = size / 16;
+        unsigned long long lanes[2];
+        char xmm[4 * 16];
+
+        ASM("       movdqu      %%xmm0,   0(%[xmm])         \n"
+            "       movdqu      %%xmm1,  16(%[xmm])         \n"
+            "       movdqu      %%xmm2,  32(%[xmm])         \n"
+            "       movdqu      %%xmm3,  48(%[xmm])         \n"
+            "       pxor        %%xmm0, %%xmm0              \n"
+            "       pxor        %%xmm3, %%xmm3              \n"
+            "1:     movdqu      (%[src]), %%xmm1            \n"
+            "       movdqa      %%xmm1, %%xmm2              \n"
+            "       punpckldq   %%xmm0, %%xmm1              \n"
+            "       punpckhdq   %%xmm0, %%xmm2              \n"
+            "       paddq       %%xmm1, %%xmm3              \n"
+            "       paddq       %%xmm2, %%xmm3              \n"
+            "       add         $16, %[src]                 \n"
+            "       dec         %[blocks]                   \n"
+            "       jnz         1b                          \n"
+            "       movdqu      %%xmm3, (%[lanes])          \n"
+            "       movdqu        0(%[xmm]), %%xmm0         \n"
+            "       movdqu       16(%[xmm]), %%xmm1         \n"
+            "       movdqu       32(%[xmm]), %%xmm2         \n"
+            "       movdqu       48(%[xmm]), %%xmm3         \n"
+            : [src] "+r"(src), [blocks] "+r"(blocks) : [xmm] "r"(xmm), [lanes] "r"(lanes) : "memory", "cc");
+
+        return lanes[0] + lanes[1] + CPU_Common::sum32(src, size % 16);
+    }
+
+    static unsigned long long copy_and_sum32(void * to, const void * from, unsigned int size) {
+        if(!Traits<IA32>::sse2 || (size < SSE2_THRESHOLD))
+            return CPU_Common::copy_and_sum32(to, from, size);
+
+        char * dst = reinterpret_cast<char *>(to);
+        const char * src = reinterpret_cast<const char *>(from);
+        unsigned int blocks = size / 16;
+        unsigned long long lanes[2];
+        char xmm[4 * 16];
+
+        ASM("       movdqu      %%xmm0,   0(%[xmm])         \n"
+            "       movdqu      %%xmm1,  16(%[xmm])         \n"
+            "       movdqu      %%xmm2,  32(%[xmm])         \n"
+            "       movdqu      %%xmm3,  48(%[xmm])         \n"
+            "       pxor        %%xmm0, %%xmm0              \n"
+            "       pxor        %%xmm3, %%xmm3              \n"
+            "1:     movdqu      (%[src]), %%xmm1            \n"
+            "       movdqu      %%xmm1, (%[dst])            \n"
+            "       movdqa      %%xmm1, %%xmm2              \n"
+            "       punpckldq   %%xmm0, %%xmm1              \n"
+            "       punpckhdq   %%xmm0, %%xmm2              \n"
+            "       paddq       %%xmm1, %%xmm3              \n"
+            "       paddq       %%xmm2, %%xmm3              \n"
+            "       add         $16, %[src]                 \n"
+            "       add         $16, %[dst]                 \n"
+            "       dec         %[blocks]                   \n"
+            "       jnz         1b                          \n"
+            "       movdqu      %%xmm3, (%[lanes])          \n"
+            "       movdqu        0(%[xmm]), %%xmm0         \n"
+            "       movdqu       16(%[xmm]), %%xmm1         \n"
+            "       movdqu       32(%[xmm]), %%xmm2         \n"
+            "       movdqu       48(%[xmm]), %%xmm3         \n"
+            : [src] "+r"(src), [dst] "+r"(dst), [blocks] "+r"(blocks) : [xmm] "r"(xmm), [lanes] "r"(lanes) : "memory", "cc");
+
+        return lanes[0] + lanes[1] + CPU_Common::copy_and_sum32(dst, src, size % 16);
+    }
+
     template<typename ... Tn>
     static Context * init_stack(const Log_Addr & usp, Log_Addr sp, void (* exit)(), int (* entry)(Tn ...), Tn ... an) {
         // IA32 first decrements the stack pointer and then writes into the stack
@@ -444,6 +556,7 @@ public:
     static void cr0(const Reg32 value) {
         ASM("movl %0, %%cr0" : : "r"(value));
     }
+    static void clts() { ASM("clts"); }
 
     static Reg32 cr2() {
         Reg32 value; ASM("movl %%cr2, %0" : "=r"(value) :); return value;
@@ -601,11 +714,16 @@ private:
     }
     static void init_stack_helper(Log_Addr sp) {}
 
+    static void lazy_fpu_switch(FPU_Context * prev, FPU_Context * next);
+    static void fpu_handover();
+
     static void init();
 
 private:
     static unsigned int _cpu_clock;
     static unsigned int _bus_clock;
+    static FPU_Context * _fpu_owner[Traits<Build>::CPUS];   // whose state is in each CPU's FPU
+    static FPU_Context * _fpu_running[Traits<Build>::CPUS]; // the context of the thread running on each CPU
 };
 
 inline CPU::Reg32 htonl(CPU::Reg32 v) { return CPU::htonl(v); }
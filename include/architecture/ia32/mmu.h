@@ -7,6 +7,7 @@
 #include <utility/string.h>
 #include <utility/list.h>
 #include <utility/debug.h>
+#include <utility/spin.h>
 #include <cpu.h>
 #include <mmu.h>
 
@@ -17,12 +18,73 @@ class IA32_MMU: public MMU_Common<10, 10, 12>
     friend class IA32;
 
 private:
-    typedef Grouping_List<Frame> List;
-
     static const bool colorful = Traits<MMU>::colorful;
     static const unsigned int COLORS = Traits<MMU>::COLORS;
+    static const bool large_pages = Traits<MMU>::large_pages;
+    static const bool smp = Traits<System>::multicore;
     static const unsigned int PHY_MEM = Memory_Map<Machine>::PHY_MEM;
 
+public:
+    // A large page (PSE) spans what a whole page table would map
+    static const unsigned int LARGE_PAGE = PT_ENTRIES * PAGE_SIZE;
+
+    // Free frames are kept in blocks of 2^order frames, from a single frame up to the whole address space
+    static const unsigned int ORDERS = sizeof(unsigned int) * 8 - PAGE_SHIFT + 1;
+
+    // Frame allocator statistics (for a color)
+    struct Statistics {
+        unsigned int free;              // free frames
+        unsigned int largest;           // frames in the largest free block (i.e. the longest run alloc() can return)
+        unsigned int blocks[ORDERS];    // free blocks of each order
+        unsigned int fragmentation;     // percentage of the free frames that are not in the largest block
+    };
+
+private:
+    // Binary Buddy Allocator (one per color)
+    // Free blocks of 2^order frames are aligned to their size and kept in a free list per order. The list elements
+    // live in a table with an entry per frame (_blocks), whose rank tags the free block starting at that frame with
+    // its color and order, so the buddy of a block being freed is checked and merged in O(1) and both alloc() and
+    // free() take O(ORDERS). Free frames themselves are never touched (INIT runs from free memory during MMU::init()).
+    // Runs of any length can be allocated (the head of the block that holds them is freed back) and freed (they are
+    // split in aligned blocks), and every run is physically contiguous.
+    class Buddy
+    {
+    public:
+        typedef List_Elements::Doubly_Linked_Ordered<Frame, unsigned int> Element;
+
+    private:
+        typedef List<Frame, Element> Free_List;
+
+    public:
+        Buddy(): _color(WHITE), _frames(0) {}
+
+        void color(const Color & c) { _color = c; }
+
+        unsigned int frames() const { return _frames; }
+        unsigned int largest() const {
+            for(unsigned int o = ORDERS; o > 0; o--)
+                if(!_free[o - 1].empty())
+                    return 1 << (o - 1);
+            return 0;
+        }
+
+        Phy_Addr alloc(unsigned int n);
+        void free(const Phy_Addr & addr, unsigned int n);
+
+        void statistics(Statistics * s) const;
+
+    private:
+        unsigned int tag(unsigned int order) const { return (_color << 8) | (order + 1); }
+
+        void insert(unsigned int frame, unsigned int order);
+        void remove(unsigned int frame, unsigned int order);
+
+    private:
+        Color _color;
+        unsigned int _frames;
+        Free_List _free[ORDERS];
+    };
+
 public:
     // Page Flags
     class IA32_Flags
@@ -38,7 +100,7 @@ public:
             DRT  = 0x040, // Dirty (only for PTEs, 0=clean, 1=dirty)
             PS   = 0x080, // Page Size (for PDEs, 0=4KBytes, 1=4MBytes)
             GLB  = 0X100, // Global Page (0=local, 1=global)
-            EX   = 0x200, // User Def. (0=non-executable, 1=executable)
+            COW  = 0x200, // User Def. (0=private, 1=copy-on-write, mapped read-only until written)
             CT   = 0x400, // User Def. (0=non-contiguous, 1=contiguous)
             IO   = 0x800, // User Def. (0=memory, 1=I/O)
             APP  = (PRE | RW  | ACC | USR),
@@ -101,10 +163,38 @@ public:
             }
         }
 
+        // Leaves pages to be allocated at first touch (see IA32_MMU::fault()): their entries are kept
+        // non-present, holding the flags and the color of the frames they will be mapped to
+        void reserve(int from, int to, const IA32_Flags & flags, const Color & color) {
+            for( ; from < to; from++) {
+                Log_Addr * tmp = phy2log(&_entry[from]);
+                *tmp = (color << PAGE_SHIFT) | (flags & ~IA32_Flags::PRE);
+            }
+        }
+
+        // Maps the frames of pt (entries from + offset ...) copy-on-write, write-protecting them in pt as well
+        void share(Page_Table * pt, int offset, int from, int to, const IA32_Flags & flags) {
+            bool disabled = lock();
+            for( ; from < to; from++) {
+                PT_Entry * src = phy2log(&pt->_entry[from + offset]);
+                PT_Entry * dst = phy2log(&_entry[from]);
+                unsigned int e = *src;
+                if(!(e & IA32_Flags::PRE)) // not mapped yet (demand-zero pages get their own frames)
+                    *dst = e ? (indexes(e) | (flags & ~IA32_Flags::PRE)) : 0;
+                else {
+                    if(e & IA32_Flags::RW)
+                        *src = (e & ~IA32_Flags::RW) | IA32_Flags::COW;
+                    *dst = indexes(e) | ((flags & IA32_Flags::RW) ? ((flags & ~IA32_Flags::RW) | IA32_Flags::COW) : static_cast<unsigned int>(flags));
+                    _shares[indexes(e) >> PAGE_SHIFT]++;
+                }
+            }
+            unlock(disabled);
+        }
+
         void unmap(int from, int to) {
             for( ; from < to; from++) {
-                free(_entry[from]);
                 Log_Addr * tmp = phy2log(&_entry[from]);
+                release(*tmp);
                 *tmp = 0;
             }
         }
@@ -127,31 +217,78 @@ public:
     };
 
     // Chunk (for Segment)
+    // Chunks whose size is a multiple of LARGE_PAGE (and whose physical memory
+    // can be aligned to it) are mapped with 4 MiB pages: they have no page
+    // tables, _pt holds the physical address of the first large page, _pts
+    // counts large pages and _flags carries PS, so Directory::attach() fills
+    // one PDE per large page.
     class Chunk
     {
     public:
         Chunk() {}
 
         Chunk(unsigned int bytes, const Flags & flags, const Color & color = WHITE)
-        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)) {
-            if(flags & IA32_Flags::CT)
-                _pt->map_contiguous(_from, _to, _flags, color);
-            else
-                _pt->map(_from, _to, _flags, color);
+        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(0) {
+            if(large_pages && (color == WHITE) && !(bytes % LARGE_PAGE) && !(flags & Flags::DZ))
+                _pt = alloc_large(_pts);
+            if(_pt)
+                _flags = _flags | IA32_Flags::PS | IA32_Flags::CT;
+            else {
+                _pt = calloc(_pts, WHITE);
+                if(flags & IA32_Flags::CT)
+                    _pt->map_contiguous(_from, _to, _flags, color);
+                else if(flags & Flags::DZ)
+                    _pt->reserve(_from, _to, _flags, color);
+                else
+                    _pt->map(_from, _to, _flags, color);
+            }
+        }
+
+        // A chunk with the contents of another one. With Flags::COW, the frames of a non-contiguous chunk are
+        // shared and both chunks map them read-only until one of them writes to a page, which then gets a
+        // private copy (see IA32_MMU::fault()). Otherwise (or for contiguous chunks) the contents are copied.
+        // On multicores, other CPUs could go on writing through stale TLB entries (there is no shootdown), so COW is ignored.
+        Chunk(const Chunk & origin, const Flags & flags)
+        : _from(0), _to(origin._to - origin._from), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)) {
+            if(!smp && (flags & Flags::COW) && _shares && !(origin._flags & (IA32_Flags::CT | IA32_Flags::PS | IA32_Flags::IO))) {
+                _pt->share(origin._pt, origin._from, _from, _to, _flags);
+                flush_tlb(); // origin's pages were write-protected and it might be attached to the current address space
+            } else {
+                _pt->map(_from, _to, _flags, WHITE);
+                for(unsigned int i = 0; i < _to - _from; i++) {
+                    Phy_Addr src = origin.frame(i);
+                    if(src)
+                        memcpy(phy2log(frame(i)), phy2log(src), sizeof(Page));
+                    else
+                        memset(phy2log(frame(i)), 0, sizeof(Page));
+                }
+            }
         }
 
         Chunk(const Phy_Addr & phy_addr, unsigned int bytes, const Flags & flags)
-        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(calloc(_pts, WHITE)) {
-            _pt->remap(phy_addr, _from, _to, flags);
+        : _from(0), _to(pages(bytes)), _pts(page_tables(_to - _from)), _flags(IA32_Flags(flags)), _pt(0) {
+            if(large_pages && !(phy_addr % LARGE_PAGE) && !(bytes % LARGE_PAGE)) {
+                _flags = _flags | IA32_Flags::PS | IA32_Flags::CT;
+                _pt = reinterpret_cast<Page_Table *>(static_cast<unsigned int>(phy_addr));
+            } else {
+                _pt = calloc(_pts, WHITE);
+                _pt->remap(phy_addr, _from, _to, flags);
+            }
         }
 
         ~Chunk() {
+            if(_flags & IA32_Flags::PS) {
+                if(!(_flags & IA32_Flags::IO))
+                    free(_pt, _pts * PT_ENTRIES);
+                return;
+            }
+
             if(!(_flags & IA32_Flags::IO)) {
                 if(_flags & IA32_Flags::CT)
                     free((*static_cast<Page_Table *>(phy2log(_pt)))[_from], _to - _from);
                 else
                     for( ; _from < _to; _from++)
-                        free((*static_cast<Page_Table *>(phy2log(_pt)))[_from]);
+                        release((*static_cast<Page_Table *>(phy2log(_pt)))[_from]);
             }
             free(_pt, _pts);
         }
@@ -162,11 +299,13 @@ public:
         unsigned int size() const { return (_to - _from) * sizeof(Page); }
 
         Phy_Addr phy_address() const {
+            if(_flags & IA32_Flags::PS)
+                return Phy_Addr(_pt);
             return (_flags & IA32_Flags::CT) ? Phy_Addr(indexes((*_pt)[_from])) : Phy_Addr(false);
         }
 
         int resize(unsigned int amount) {
-            if(_flags & IA32_Flags::CT)
+            if(_flags & (IA32_Flags::CT | IA32_Flags::PS))
                 return 0;
 
             unsigned int pgs = pages(amount);
@@ -189,6 +328,61 @@ public:
             return pgs * sizeof(Page);
         }
 
+        // Color of the frame mapped to the i-th page of the chunk (WHITE if there is none)
+        Color color(unsigned int i) const {
+            Phy_Addr f = frame(i);
+            return f ? phy2color(f) : WHITE;
+        }
+
+        // Whether the i-th page has been accessed since the last time its Accessed bit was cleared (with clear)
+        // The TLB must be flushed before the bits are sampled again, or cached translations won't set them
+        bool referenced(unsigned int i, bool clear = false) {
+            if(_flags & (IA32_Flags::PS | IA32_Flags::CT))
+                return true;
+            PT_Entry * e = phy2log(&(*_pt)[_from + i]);
+            unsigned int pte = *e;
+            bool tmp = (pte & (IA32_Flags::PRE | IA32_Flags::ACC)) == (IA32_Flags::PRE | IA32_Flags::ACC);
+            if(tmp && clear)
+                *e = pte & ~IA32_Flags::ACC;
+            return tmp;
+        }
+
+        // Moves the i-th page to a frame of the given color, keeping its contents. Pages not yet touched, shared or
+        // in contiguous chunks stay where they are. The caller must make sure no other CPU is using the page and
+        // flush the TLB afterwards.
+        bool recolor(unsigned int i, const Color & color) {
+            if(!colorful || (_flags & (IA32_Flags::PS | IA32_Flags::CT | IA32_Flags::IO)))
+                return false;
+
+            Phy_Addr f = alloc(1, color);
+            if(!f)
+                return false;
+
+            Phy_Addr old = 0;
+            bool disabled = lock();
+            PT_Entry * e = phy2log(&(*_pt)[_from + i]);
+            unsigned int pte = *e;
+            if((pte & IA32_Flags::PRE) && !(pte & IA32_Flags::COW) && !(_shares && _shares[indexes(pte) >> PAGE_SHIFT])) {
+                memcpy(phy2log(f), phy2log(indexes(pte)), sizeof(Page));
+                *e = f | offset(pte);
+                old = indexes(pte);
+            }
+            unlock(disabled);
+
+            free(old ? old : f);
+
+            return (old != 0);
+        }
+
+    private:
+        // Frame mapped to the i-th page of the chunk (or 0, if it hasn't been touched yet)
+        Phy_Addr frame(unsigned int i) const {
+            if(_flags & IA32_Flags::PS)
+                return Phy_Addr(_pt) + i * sizeof(Page);
+            unsigned int e = (*static_cast<Page_Table *>(phy2log(_pt)))[_from + i];
+            return (e & IA32_Flags::PRE) ? indexes(e) : 0;
+        }
+
     private:
         unsigned int _from;
         unsigned int _to;
@@ -250,7 +444,10 @@ public:
         }
 
         Phy_Addr physical(const Log_Addr & addr) {
-            Page_Table * pt = reinterpret_cast<Page_Table *>((void *)(*_pd)[directory(addr)]);
+            PD_Entry pde = (*_pd)[directory(addr)];
+            if(pde & IA32_Flags::PS)
+                return large_indexes(pde) | large_offset(addr);
+            Page_Table * pt = reinterpret_cast<Page_Table *>((void *)pde);
             return (*pt)[page(addr)] | offset(addr);
         }
 
@@ -259,8 +456,11 @@ public:
             for(unsigned int i = from; i < from + n; i++)
                 if((*static_cast<Page_Directory *>(phy2log(_pd)))[i])
                     return false;
-            for(unsigned int i = from; i < from + n; i++, pt++)
-                (*static_cast<Page_Directory *>(phy2log(_pd)))[i] = Phy_Addr(pt) | flags;
+            // Large pages are contiguous in physical memory, so each PDE points LARGE_PAGE bytes ahead of the previous one
+            unsigned int stride = (flags & IA32_Flags::PS) ? LARGE_PAGE : sizeof(Page_Table);
+            Phy_Addr addr = Phy_Addr(pt);
+            for(unsigned int i = from; i < from + n; i++, addr += stride)
+                (*static_cast<Page_Directory *>(phy2log(_pd)))[i] = addr | flags;
             return true;
         }
 
@@ -312,11 +512,13 @@ public:
         Phy_Addr phy(false);
 
         if(frames) {
-            List::Element * e = _free[color].search_decrementing(frames);
-            if(e) {
-                phy = e->object() + e->size();
+            bool disabled = lock();
+            phy = _free[color].alloc(frames);
+            unlock(disabled);
+
+            if(phy)
                 db<MMU>(TRC) << "MMU::alloc(frames=" << frames << ",color=" << color << ") => " << phy << endl;
-            } else
+            else
                 db<MMU>(WRN) << "MMU::alloc(frames=" << frames << ",color=" << color << ") => failed!" << endl;
         }
 
@@ -339,26 +541,93 @@ public:
         db<MMU>(TRC) << "MMU::free(frame=" << frame << ",color=" << color << ",n=" << n << ")" << endl;
 
         if(frame && n) {
-            List::Element * e = new (phy2log(frame)) List::Element(frame, n);
-            List::Element * m1, * m2;
-            _free[color].insert_merging(e, &m1, &m2);
+            bool disabled = lock();
+            _free[color].free(frame, n);
+            unlock(disabled);
         }
     }
 
+    // Frees the frame mapped by a page table entry, unless other chunks still share it copy-on-write
+    static void release(const PT_Entry & entry) {
+        if(!(entry & IA32_Flags::PRE)) // unused or not touched yet (demand-zero)
+            return;
+
+        bool disabled = lock();
+        unsigned int f = indexes(entry) >> PAGE_SHIFT;
+        if(_shares && _shares[f])
+            _shares[f]--;
+        else
+            free(entry);
+        unlock(disabled);
+    }
+
+    // Resolves page faults on demand-zero and on copy-on-write pages of the current address space
+    // (present, write and user tell whether the page was present, and whether the access was a write from user mode)
+    // Returns false for any other fault (e.g. an access to an address not mapped by any segment)
+    static bool fault(const Log_Addr & addr, bool present, bool write, bool user) {
+        PD_Entry pde = (*static_cast<Page_Directory *>(phy2log(current())))[directory(addr)];
+        if(!(pde & IA32_Flags::PRE) || (pde & IA32_Flags::PS))
+            return false;
+        PT_Entry * entry = phy2log(&(*reinterpret_cast<Page_Table *>(indexes(pde)))[page(addr)]);
+
+        bool resolved = true;
+        bool disabled = lock();
+        unsigned int e = *entry; // read it with the lock, another thread of the task might have just resolved the fault
+        if(!(e & IA32_Flags::PRE)) {
+            if(e) { // demand-zero
+                Phy_Addr frame = alloc(1, static_cast<Color>(e >> PAGE_SHIFT));
+                if(frame) {
+                    memset(phy2log(frame), 0, sizeof(Page));
+                    *entry = frame | (offset(e) | IA32_Flags::PRE);
+                } else
+                    resolved = false;
+            } else
+                resolved = false;
+        } else if(write && (e & IA32_Flags::COW) && (!user || (e & IA32_Flags::USR))) {
+            unsigned int f = indexes(e) >> PAGE_SHIFT;
+            unsigned int flags = (offset(e) & ~IA32_Flags::COW) | IA32_Flags::RW;
+            if(!_shares[f]) // the other sharers already got their copies
+                *entry = indexes(e) | flags;
+            else {
+                Phy_Addr frame = alloc(1, colorful ? phy2color(indexes(e)) : WHITE);
+                if(frame) {
+                    memcpy(phy2log(frame), phy2log(indexes(e)), sizeof(Page));
+                    _shares[f]--;
+                    *entry = frame | flags;
+                } else
+                    resolved = false;
+            }
+        } else // spurious if the entry now allows the access (e.g. the page was mapped meanwhile)
+            resolved = (!user || (e & IA32_Flags::USR)) && (!write || (e & IA32_Flags::RW)) && (!present || write);
+        unlock(disabled);
+
+        if(resolved)
+            flush_tlb(addr);
+
+        db<MMU>(TRC) << "MMU::fault(addr=" << addr << ",p=" << present << ",w=" << write << ",u=" << user << ",pte=" << reinterpret_cast<void *>(e) << ") => " << resolved << endl;
+
+        return resolved;
+    }
+
     static void white_free(Phy_Addr frame, int n) {
         // Clean up MMU flags in frame address
         frame = indexes(frame);
 
         db<MMU>(TRC) << "MMU::free(frame=" << frame << ",color=" << WHITE << ",n=" << n << ")" << endl;
 
-        if(frame && n) {
-            List::Element * e = new (phy2log(frame)) List::Element(frame, n);
-            List::Element * m1, * m2;
-            _free[WHITE].insert_merging(e, &m1, &m2);
-        }
+        if(frame && n)
+            _free[WHITE].free(frame, n);
     }
 
-    static unsigned int allocable(const Color & color = WHITE) { return _free[color].head() ? _free[color].head()->size() : 0; }
+    static unsigned int allocable(const Color & color = WHITE) { return _free[color].largest(); }
+
+    static Statistics statistics(const Color & color = WHITE) {
+        Statistics s;
+        bool disabled = lock();
+        _free[color].statistics(&s);
+        unlock(disabled);
+        return s;
+    }
 
     static Page_Directory * volatile current() {
         return reinterpret_cast<Page_Directory * volatile>(CPU::pdp());
@@ -366,10 +635,15 @@ public:
 
     static Phy_Addr physical(const Log_Addr & addr) {
         Page_Directory * pd = current();
-        Page_Table * pt = (*pd)[directory(addr)];
+        PD_Entry pde = (*pd)[directory(addr)];
+        if(pde & IA32_Flags::PS)
+            return large_indexes(pde) | large_offset(addr);
+        Page_Table * pt = pde;
         return (*pt)[page(addr)] | offset(addr);
     }
 
+    // Reloading CR3 preserves global entries. Only the system mappings built by SETUP are global and
+    // they never change afterwards, so no flush ever needs to drop them
     static void flush_tlb() {
         ASM("movl %cr3,%eax");
         ASM("movl %eax,%cr3");
@@ -383,21 +657,50 @@ private:
 
     static Log_Addr phy2log(const Phy_Addr & phy) { return phy | PHY_MEM; }
 
+    // The free lists are also used by the page-fault handler, so they are only touched with interrupts disabled
+    static bool lock() {
+        bool disabled = CPU::int_disabled();
+        CPU::int_disable();
+        if(smp)
+            _lock.acquire();
+        return disabled;
+    }
+    static void unlock(bool disabled) {
+        if(smp)
+            _lock.release();
+        if(!disabled)
+            CPU::int_enable();
+    }
+
+    static unsigned int large_offset(const Log_Addr & addr) { return addr & (LARGE_PAGE - 1); }
+    static unsigned int large_indexes(const Log_Addr & addr) { return addr & ~(LARGE_PAGE - 1); }
+
+    // Allocates n large pages (buddy blocks of PT_ENTRIES frames or more are aligned to LARGE_PAGE)
+    static Page_Table * alloc_large(unsigned int n) {
+        Phy_Addr base = alloc(n * PT_ENTRIES, WHITE);
+
+        db<MMU>(TRC) << "MMU::alloc_large(n=" << n << ") => " << base << endl;
+
+        return reinterpret_cast<Page_Table *>(static_cast<unsigned int>(base));
+    }
+
     static Color phy2color(const Phy_Addr & phy) { return static_cast<Color>(colorful ? ((phy >> PAGE_SHIFT) & 0x7f) % COLORS : WHITE); } // TODO: what is 0x7f
 
     static Color log2color(const Log_Addr & log) {
         if(colorful) {
-            Page_Directory * pd = current();
-            Page_Table * pt = (*pd)[directory(log)];
-            Phy_Addr phy = (*pt)[page(log)] | offset(log);
+            Phy_Addr phy = physical(log);
             return static_cast<Color>(((phy >> PAGE_SHIFT) & 0x7f) % COLORS);
         } else
             return WHITE;
     }
 
 private:
-    static List _free[colorful * COLORS + 1]; // +1 for WHITE
+    static Buddy _free[colorful * COLORS + 1]; // +1 for WHITE
+    static Buddy::Element * _blocks; // an element per frame, ranked (color << 8 | order + 1) if a free block starts at it, 0 otherwise
+    static unsigned int _memory_frames; // frames covered by _blocks
     static Page_Directory * _master;
+    static unsigned short * _shares; // number of chunks, besides the first one, mapping each frame copy-on-write
+    static Spin _lock;
 };
 
 __END_SYS
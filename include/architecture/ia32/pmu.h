@@ -7,6 +7,7 @@
 #include <pmu.h>
 #include <ic.h>
 #include <utility/handler.h>
+#include <utility/ring.h>
 
 __BEGIN_SYS
 
@@ -1143,12 +1144,72 @@ class PMU_Select_Engine<Traits<PMU>::V3>: public Intel_PMU_V3 {};
 class IA32_PMU: public PMU_Select_Engine<Traits<PMU>::VERSION>
 {
     friend class IA32;
+    friend class PC_IC;
+
+private:
+    static const unsigned int CPUS = Traits<Build>::CPUS;
+    static const unsigned int SAMPLING_PERIOD = Traits<PMU>::SAMPLING_PERIOD;
+
+public:
+    static const bool virtualized = Traits<PMU>::enabled && Traits<PMU>::virtualized;
+    static const bool sampling = virtualized && Traits<PMU>::sampling;
+
+    // Per-thread virtual counters (see account())
+    class Context
+    {
+        friend class IA32_PMU;
+
+    public:
+        enum {
+            CYCLES,
+            INSTRUCTIONS,
+            BRANCH_MISSES,
+            LLC_MISSES,
+            COUNTERS
+        };
+
+    public:
+        Context() { for(unsigned int i = 0; i < COUNTERS; i++) _count[i] = 0; }
+
+        const Count & operator[](unsigned int i) const { return _count[i]; }
+
+    private:
+        Count _count[COUNTERS];
+    };
+
+    // Where a CPU was when its clock counter overflowed (see sample())
+    struct Sample {
+        Log_Addr ip;
+        unsigned int thread; // This_Thread::id()
+    };
+    typedef SPSC_Ring<Sample, sampling ? Traits<PMU>::SAMPLES : 1> Samples;
 
 public:
     IA32_PMU() {}
 
+    // Adds what this CPU has counted since the last call to ctx, i.e. to the thread leaving it (see Thread::dispatch()).
+    // Counters are never rewritten (but for sampling's clock), so others (e.g. Page_Coloring) can still read them
+    static void account(Context * ctx) { collect(ctx, true); }
+
+    // Adds what this CPU has counted since the last account() to ctx, without accounting it
+    static void peek(Context * ctx) { collect(ctx, false); }
+
+    // Each CPU's samples are produced by its PMIs and must be consumed by one thread at a time
+    static Samples * samples(unsigned int cpu) { return &_samples[cpu]; }
+
 private:
+    static void collect(Context * ctx, bool account);
+    static void virtualize();
+    static void sample(const Log_Addr & ip);
+
     static void init();
+
+private:
+    static const Channel _channels[Context::COUNTERS];
+    static Count _mask;
+    static Count _last[CPUS][Context::COUNTERS];
+    static bool _virtualized[CPUS];
+    static Samples _samples[CPUS];
 };
 
 __END_SYS
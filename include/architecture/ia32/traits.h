@@ -14,6 +14,7 @@ template<> struct Traits<IA32>: public Traits<void>
     static const unsigned int WORD_SIZE         = 32;
     static const unsigned int CLOCK             = 2000000000;
     static const bool unaligned_memory_access   = true;
+    static const bool sse2                      = false; // use SSE2 in memory-bound kernels (e.g. IP checksums)
 };
 
 template<> struct Traits<IA32_TSC>: public Traits<void>
@@ -24,11 +25,17 @@ template<> struct Traits<IA32_MMU>: public Traits<void>
 {
     static const bool colorful = false;
     static const unsigned int COLORS = 1;
+    static const bool global_pages = true;      // kernel mappings, identical in every address space, survive CR3 reloads (CR4.PGE)
+    static const bool large_pages = true;       // 4 MiB pages (CR4.PSE) for the physical memory window and aligned segments
+    static const bool partitioning = false;     // grow and shrink the set of colors of each colored heap following its LLC misses (see Page_Coloring)
+    static const unsigned int PARTITION_GROW = 10000;   // LLC misses per color between repartitions above which a partition gets another color
+    static const unsigned int PARTITION_SHRINK = 100;   // LLC misses per color between repartitions below which a partition gives a borrowed color back
 };
 
 template<> struct Traits<IA32_FPU>: public Traits<void>
 {
-    static const bool enabled = false;
+    // Give each thread its own FPU/SSE context, switched lazily on its first FPU instruction after a dispatch
+    static const bool enabled = true;
 };
 
 template<> struct Traits<IA32_PMU>: public Traits<void>
@@ -36,6 +43,10 @@ template<> struct Traits<IA32_PMU>: public Traits<void>
     static const bool enabled = true;
     enum { V1, V2, V3, DUO, MICRO, ATOM, NEHALEN, NETBURST, SANDY_BRIDGE };
     static const unsigned int VERSION = V2;
+    static const bool virtualized = false;                  // per-thread counters, accounted at each dispatch (see Profiler)
+    static const bool sampling = false;                     // sample the running thread's instruction pointer at counter overflows (requires virtualized)
+    static const unsigned int SAMPLING_PERIOD = 1000000;    // clock cycles between samples
+    static const unsigned int SAMPLES = 1024;               // per-CPU sample ring size (must be a power of 2)
 };
 
 __END_SYS
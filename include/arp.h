@@ -7,6 +7,7 @@
 #include <utility/spin.h>
 #include <system.h>
 #include <alarm.h>
+#include <tsc.h>
 #include <semaphore.h>
 
 __BEGIN_SYS
@@ -20,11 +21,15 @@ public:
     typedef typename NIC::Address HA;
 
 private:
-    static const unsigned int ENTRIES = Traits<Build>::NODES;
+    static const unsigned int BUCKETS = 64;
+    static const unsigned int AGE = 20 * 60; // s, before a mapping must be confirmed by a new request
+
+    typedef TSC::Time_Stamp Time_Stamp;
 
     class Mapping;
-    typedef Simple_Hash<Mapping, ENTRIES, PA> Table;
+    typedef Hash<Mapping, BUCKETS, PA> Table;
     typedef typename Table::Element Element;
+    typedef typename Table::List List;
 
 public:
     // ARP/RARP Operations
@@ -82,38 +87,70 @@ public:
 
 
 private:
+    // Mappings are either resolved, in which case they expire AGE seconds after the last confirmation
+    // (static ones, inserted with insert(), never do), or pending, in which case a resolver thread is
+    // broadcasting requests for them and any other thread resolving the same address waits for it
     class Mapping
     {
     public:
-        Mapping(const PA & pa, const HA & ha): _ha(ha), _sem(0), _link(this, pa) {}
-        Mapping(const PA & pa, Semaphore * sem): _ha(HA::NULL), _sem(sem), _link(this, pa) {}
+        Mapping(const PA & pa, const HA & ha, const Time_Stamp & e = 0): _ha(ha), _expiration(e), _reply(0), _waiting(0), _waiters(0), _link(this, pa) {}
+        Mapping(const PA & pa, Semaphore * reply): _ha(HA::NULL), _expiration(0), _reply(reply), _waiting(0), _waiters(0), _link(this, pa) {}
 
         const HA & ha() const { return _ha; }
-        Semaphore * semaphore() { return _sem; }
         Element * link() { return &_link; }
 
-        void update(const HA & ha) {
+        bool pending() const { return _reply; }
+        bool expired(const Time_Stamp & now) const { return !pending() && _expiration && (now > _expiration); }
+
+        // Returns whether the hardware address has changed
+        bool update(const HA & ha, const Time_Stamp & e) {
+            bool changed = (_ha != ha);
             _ha = ha;
-            if(_sem) {
-                _sem->v();
-                _sem = 0;
+            if(_expiration)
+                _expiration = e;
+            if(_reply) {
+                _expiration = e;
+                _reply->v();
+                _reply = 0;
             }
+            return changed;
+        }
+
+        void renew(Semaphore * reply) { _reply = reply; }
+
+        // Threads resolving the address while it is pending join the resolver's result
+        void join() { _waiters++; }
+        void wait() { _waiting.p(); }
+        bool leave() { return !--_waiters; }
+
+        bool joined() const { return _waiters; }
+
+        // Called by the resolver once the address has been resolved or it has given up
+        void release(bool resolved) {
+            if(!resolved)
+                _ha = HA::NULL;
+            _reply = 0;
+            for(unsigned int i = 0; i < _waiters; i++)
+                _waiting.v();
         }
 
         friend Debug & operator<<(Debug & db, const Mapping & m) {
-            db  << "{pa=" << m._link.key() << ",ha=" << m._ha << ",sem=" << m._sem << "}";
+            db  << "{pa=" << m._link.key() << ",ha=" << m._ha << ",exp=" << m._expiration << ",rep=" << m._reply << ",wt=" << m._waiters << "}";
             return db;
         }
 
     private:
         HA _ha;
-        Semaphore * _sem;
+        Time_Stamp _expiration;
+        Semaphore * _reply;
+        Semaphore _waiting;
+        unsigned int _waiters;
         Element _link; // PA is the key
     };
 
 
 public:
-    ARP(NIC * nic, Network * net): _nic(nic), _net(net) {
+    ARP(NIC * nic, Network * net): _version(0), _sweep(0), _nic(nic), _net(net) {
         db<ARP>(TRC) << "ARP::ARP(nic=" << nic << ",net=" << net << ") => " << this << endl;
 
         _nic->attach(this, NIC::ARP);
@@ -125,12 +162,11 @@ public:
         _nic->detach(this, NIC::ARP);
 
         lock();
-        for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++) {
-            if(it) {
-                db<ARP>(INF) << "ARP::~ARP: removing and deleting " << *it->object() << endl;
-
-                _table.remove(it);
-                delete it->object();
+        for(unsigned int i = 0; i < BUCKETS; i++) {
+            List * list = _table.bucket(i);
+            while(Element * e = list->remove_head()) {
+                db<ARP>(INF) << "ARP::~ARP: removing and deleting " << *e->object() << endl;
+                delete e->object();
             }
         }
         unlock();
@@ -143,13 +179,21 @@ public:
 
         lock();
         _table.insert(map->link());
+        _version++;
         unlock();
     }
 
     void remove(const PA & pa) {
         db<ARP>(TRC) << "ARP::remove(pa=" << pa << ")" << endl;
 
-        Element * el = _table.remove_key(pa);
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el && !el->object()->pending()) {
+            _table.remove(el);
+            _version++;
+        } else
+            el = 0;
+        unlock();
         if(el) {
             db<ARP>(INF) << "ARP::remove: removing and deleting " << *el->object() << endl;
             delete el->object();
@@ -159,52 +203,97 @@ public:
     HA resolve(const PA & pa) {
         db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => ";
 
-        volatile HA ha = HA(HA::NULL);
+        HA ha = HA(HA::NULL);
 
         lock();
+        Time_Stamp now = TSC::time_stamp();
         Element * el = _table.search_key(pa);
-        unlock();
+        Mapping * map = el ? el->object() : 0;
 
-        if(el)
-            ha = el->object()->ha();
-        else {
-            db<ARP>(TRC) << "sending requests" << endl;
+        if(map && !map->pending() && !map->expired(now)) { // hit
+            ha = map->ha();
+            unlock();
+
+            db<ARP>(TRC) << ha << endl;
+
+            return ha;
+        }
+
+        if(map && map->pending()) { // coalesce with the ongoing resolution
+            db<ARP>(TRC) << "waiting for an ongoing resolution" << endl;
+
+            map->join();
+            unlock();
+
+            map->wait();
 
-            Semaphore sem(0);
-            Mapping * map = new (SYSTEM) Mapping(pa, &sem);
             lock();
-            _table.insert(map->link());
+            ha = map->ha();
+            bool last = map->leave();
+            bool failed = !ha;
             unlock();
+            if(last && failed)
+                delete map;
 
-            for(unsigned int i = 0; (i < Traits<Network>::RETRIES) && !ha; i++) {
-                Packet request(REQUEST, _nic->address(), _net->address(), HA::BROADCAST, pa);
-                db<ARP>(INF) << "ARP::resolve:request=" << request << endl;
-                _nic->send(HA::BROADCAST, NIC::ARP, &request, sizeof(Packet));
+            db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => " << ha << endl;
 
-                Semaphore_Handler handler(&sem);
-                Alarm alarm(Traits<Network>::TIMEOUT * 1000000, &handler, 1);
-                sem.p();
+            return ha;
+        }
 
-                ha = map->ha();
-            }
+        // Miss (or expired mapping): this thread becomes the resolver
+        Semaphore sem(0);
+        if(map)
+            map->renew(&sem);
+        else {
+            purge(pa, now);
+            map = new (SYSTEM) Mapping(pa, &sem);
+            _table.insert(map->link());
+        }
+        unlock();
+
+        db<ARP>(TRC) << "sending requests" << endl;
+
+        for(unsigned int i = 0; (i < Traits<Network>::RETRIES) && !ha; i++) {
+            Packet request(REQUEST, _nic->address(), _net->address(), HA::BROADCAST, pa);
+            db<ARP>(INF) << "ARP::resolve:request=" << request << endl;
+            _nic->send(HA::BROADCAST, NIC::ARP, &request, sizeof(Packet));
+
+            Semaphore_Handler handler(&sem);
+            Alarm alarm(Traits<Network>::TIMEOUT * 1000000, &handler, 1);
+            sem.p();
 
             lock();
-            if(!ha) {
-                _table.remove(map->link());
-                delete map;
-            }
+            if(!map->pending())
+                ha = map->ha();
             unlock();
+        }
 
-            db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => ";
+        lock();
+        bool last = true;
+        if(!ha) {
+            _table.remove(map->link());
+            _version++;
+            last = !map->joined();
         }
+        map->release(ha); // wakes up the threads that joined this resolution, also if it failed
+        unlock();
+        if(!ha && last)
+            delete map;
 
-        // Even being declared volatile, "ha" gets messed up and a PF occurs without the memcpy
-        HA ha2;
-        memcpy(&ha2, const_cast<HA *>(&ha), sizeof(HA));
+        db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => " << ha << endl;
 
-        db<ARP>(TRC) << ha2 << endl;
+        return ha;
+    }
 
-        return ha2;
+    // Changes whenever mappings are inserted, removed or changed, and also every AGE seconds,
+    // so resolutions cached elsewhere are invalidated and eventually confirmed again
+    unsigned int version() {
+        Time_Stamp now = TSC::time_stamp();
+        if(now > _sweep) {
+            _sweep = now + AGE * static_cast<Time_Stamp>(TSC::frequency());
+            _version++;
+        }
+        return _version;
     }
 
 //    PA resolve(const HA & ha) {
@@ -228,6 +317,9 @@ public:
 //        return ha;
 //    }
 
+    // Changes whenever mappings are inserted or removed, so resolutions cached elsewhere can be invalidated
+    unsigned int version() const { return _version; }
+
     void update(typename NIC::Observed * obs, typename NIC::Protocol prot, typename NIC::Buffer * buf)
     {
         db<ARP>(TRC) << "ARP::update(obs=" << obs << ",prot=" << prot << ",buf=" << buf << ")" << endl;
@@ -235,23 +327,34 @@ public:
         Packet * packet = buf->frame()->template data<Packet>();
         db<ARP>(INF) << "ARP::update:pkt=" << packet << " => " << *packet << endl;
 
-        if((packet->op() == REQUEST) && (packet->tpa() == _net->address())) {
+        bool for_me = (packet->tpa() == _net->address());
 
-            Packet reply(REPLY, _nic->address(), _net->address(), packet->sha(), packet->spa());
-            db<ARP>(TRC) << "ARP::update: replying query for " << packet->tpa() << " with " << reply << endl;
-            _nic->send(packet->sha(), NIC::ARP, &reply, sizeof(Packet));
-
-        } else if((packet->op() == REPLY) && (packet->tha() == _nic->address())) {
+        // Any ARP packet refreshes (or completes) the sender's mapping, and requests for us create it, since
+        // the sender is about to talk to us (RFC 826). This saves a request per peer when many come online.
+        if(packet->spa() && ((packet->op() == REQUEST) || (packet->tha() == _nic->address()))) {
+            Time_Stamp now = TSC::time_stamp();
+            Time_Stamp expiration = now + AGE * static_cast<Time_Stamp>(TSC::frequency());
 
             lock();
             Element * el = _table.search_key(packet->spa());
             if(el) {
-                db<ARP>(TRC) << "ARP::update: got reply for query on " << packet->spa() << ": " << packet->sha() << endl;
-                el->object()->update(packet->sha());
-            } else
+                db<ARP>(TRC) << "ARP::update: " << packet->spa() << " is at " << packet->sha() << endl;
+                if(el->object()->update(packet->sha(), expiration))
+                    _version++;
+            } else if(for_me) {
+                db<ARP>(TRC) << "ARP::update: learned that " << packet->spa() << " is at " << packet->sha() << endl;
+                purge(packet->spa(), now);
+                Mapping * map = new (SYSTEM) Mapping(packet->spa(), packet->sha(), expiration);
+                _table.insert(map->link());
+            } else if(packet->op() == REPLY)
                 db<ARP>(WRN) << "ARP::update: got reply for query on " << packet->spa() << ", which is not in table!" << endl;
             unlock();
+        }
 
+        if((packet->op() == REQUEST) && for_me) {
+            Packet reply(REPLY, _nic->address(), _net->address(), packet->sha(), packet->spa());
+            db<ARP>(TRC) << "ARP::update: replying query for " << packet->tpa() << " with " << reply << endl;
+            _nic->send(packet->sha(), NIC::ARP, &reply, sizeof(Packet));
         }
 
         _nic->free(buf);
@@ -259,14 +362,25 @@ public:
 
     void dump() {
         db<ARP>(INF) << "ARP::Table => {" << endl;
-        for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++) {
-            if(it)
-                db<ARP>(INF) << hex << it << " => {" << it->key() << "," << it->object()->ha() << "}" << endl;
-            else
-                db<ARP>(INF) << hex << it << " => EMPTY" << endl;
-        }
+        for(unsigned int i = 0; i < BUCKETS; i++)
+            for(Element * e = _table.bucket(i)->head(); e; e = e->next())
+                db<ARP>(INF) << i << " => " << *e->object() << endl;
         db<ARP>(INF) << "}" << endl;
+    }
 
+private:
+    // Deletes the expired mappings that share the bucket of "pa", so the table does not grow forever (must be called locked)
+    void purge(const PA & pa, const Time_Stamp & now) {
+        List * list = _table[pa];
+        for(Element * e = list->head(), * next; e; e = next) {
+            next = e->next();
+            if(e->object()->expired(now)) {
+                db<ARP>(INF) << "ARP::purge: removing and deleting " << *e->object() << endl;
+                list->remove(e);
+                delete e->object();
+                _version++;
+            }
+        }
     }
 
 private:
@@ -284,6 +398,8 @@ private:
 
 private:
     Table _table;
+    volatile unsigned int _version;
+    Time_Stamp _sweep;
     Spin _lock;
     NIC * _nic;
     Network * _net;
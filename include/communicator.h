@@ -84,6 +84,26 @@ public:
         return Channel::reply(message);
     }
 
+    // Zero-copy interface: payload is written and read in place, in the channel's buffers
+    Buffer * alloc(const Address & to, unsigned int size) {
+        return Channel::alloc(to, size);
+    }
+    int send(const Address & to, Buffer * pool) {
+        return Channel::send(_local, to, pool);
+    }
+    Buffer * receive() { // the buffer is lent until release(), or 0 for an empty message (which needs no release)
+        Buffer * buf;
+        int size;
+        do {
+            buf = updated();
+            size = Channel::receive(buf);
+        } while(size < 0);
+        return size ? buf : 0;
+    }
+    void release(Buffer * buf) {
+        Channel::release(buf);
+    }
+
 private:
     void update(typename Channel::Observed * obs, Observing_Condition c, Buffer * buf) { Observer::update(c, buf); }
     Buffer * updated() { return Observer::updated(); }
@@ -153,6 +173,14 @@ public:
         return r;
     }
 
+    // Zero-copy reception: the segment is lent until release()
+    Buffer * receive() {
+        return updated();
+    }
+    void release(Buffer * buf) {
+        _connection->release(buf);
+    }
+
 private:
     void update(typename Channel::Observed * obs, Observing_Condition c, Buffer * buf) { Observer::update(c, buf); }
     Buffer * updated() { return Observer::updated(); }
@@ -175,6 +203,7 @@ public:
     // Channel imports
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
+    typedef typename Channel::Buffer Buffer;
 
 public:
     Link(const Local_Address & local, const Address & peer = Address::NULL): Base(local), _peer(peer) {}
@@ -184,6 +213,10 @@ public:
     int receive(void * data, unsigned int size) { return Base::receive(data, size); }
     int receive_all(void * data, unsigned int size) { return Base::receive_all(data, size); }
 
+    Buffer * alloc(unsigned int size) { return Base::alloc(_peer, size); }
+    int send(Buffer * pool) { return Base::send(_peer, pool); }
+    Buffer * receive() { return Base::receive(); }
+
     int read(void * data, unsigned int size) { return receive_all(data, size); }
     int write(const void * data, unsigned int size) { return send(data, size); }
 
@@ -204,6 +237,7 @@ public:
     // Channel imports
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
+    typedef typename Channel::Buffer Buffer;
 
 public:
     Link(const Local_Address & local, const Address & peer = Address::NULL): Base(local, peer), _peer(peer) {}
@@ -213,6 +247,8 @@ public:
     int receive(void * data, unsigned int size) { return Base::receive(data, size); }
     int receive_all(void * data, unsigned int size) { return Base::receive_all(data, size); }
 
+    Buffer * receive() { return Base::receive(); }
+
     int read(void * data, unsigned int size) { return receive_all(data, size); }
     int write(const void * data, unsigned int size) { return send(data, size); }
 
@@ -234,6 +270,7 @@ public:
     // Channel imports
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
+    typedef typename Channel::Buffer Buffer;
 
 public:
     Port(const Local_Address & local): Base(local) {}
@@ -242,10 +279,12 @@ public:
     template<typename Message>
     int send(const Message & message) { return Base::send(message); }
     int send(const Address & to, const void * data, unsigned int size) { return Base::send(to, data, size); }
+    int send(const Address & to, Buffer * pool) { return Base::send(to, pool); }
 
     template<typename Message>
     int receive(const Message & message) { return Base::receive(message); }
     int receive(Address * from, void * data, unsigned int size) { return Base::receive(from, data, size); }
+    Buffer * receive() { return Base::receive(); }
 
     template<typename Message>
     int reply(const Message & message) { return Base::reply(message); }
@@ -74,8 +74,15 @@ public:
 
     class Context;
 
+    // FPU context of a thread, for architectures that switch it apart from Context (see IA32)
+    class FPU_Context {};
+
 public:
     static void halt() { for(;;); }
+    static void pause() {}
+
+    static void fpu_switch(FPU_Context * prev, FPU_Context * next) {}
+    static void fpu_release(FPU_Context * c) {}
 
     static bool tsl(volatile bool & lock) {
         bool old = lock;
@@ -108,6 +115,47 @@ public:
     static Reg32 ntohl(Reg32 v) { return htonl(v); }
     static Reg16 ntohs(Reg16 v) { return htons(v); }
 
+    // Sum of the 32-bit words in "data" (size must be a multiple of 4), in native byte order, with the
+    // carries deferred to a 64-bit accumulator, for one's complement checksums (e.g. IP::checksum)
+    static unsigned long long sum32(const void * data, unsigned int size) {
+        const Reg32 * ptr = reinterpret_cast<const Reg32 *>(data);
+        unsigned long long sum = 0;
+
+        for(; size >= 16; size -= 16, ptr += 4) {
+            sum += ptr[0];
+            sum += ptr[1];
+            sum += ptr[2];
+            sum += ptr[3];
+        }
+        for(; size >= 4; size -= 4)
+            sum += *ptr++;
+
+        return sum;
+    }
+
+    // Same as sum32(), but also copies the words to "to", so data is touched only once
+    static unsigned long long copy_and_sum32(void * to, const void * from, unsigned int size) {
+        Reg32 * dst = reinterpret_cast<Reg32 *>(to);
+        const Reg32 * src = reinterpret_cast<const Reg32 *>(from);
+        unsigned long long sum = 0;
+
+        for(; size >= 16; size -= 16, dst += 4, src += 4) {
+            Reg32 w0 = src[0], w1 = src[1], w2 = src[2], w3 = src[3];
+            dst[0] = w0;
+            dst[1] = w1;
+            dst[2] = w2;
+            dst[3] = w3;
+            sum += w0;
+            sum += w1;
+            sum += w2;
+            sum += w3;
+        }
+        for(; size >= 4; size -= 4)
+            sum += (*dst++ = *src++);
+
+        return sum;
+    }
+
 protected:
     static Reg32 swap32(Reg32 v) { return (v & 0xff000000) >> 24 | (v & 0x00ff0000) >> 8 | (v & 0x0000ff00) << 8 | (v & 0x000000ff) << 24; }
     static Reg16 swap16(Reg16 v) { return (v & 0xff00) >> 8 | (v & 0x00ff) << 8; }
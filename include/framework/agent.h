@@ -129,6 +129,12 @@ void Agent::handle_task()
     Result res = 0;
 
     switch(method()) {
+    case CREATE2: {
+        Adapter<Task> * parent;
+        int (*entry)();
+        in(parent, entry);
+        id(Id(TASK_ID, reinterpret_cast<Id::Unit_Id>(new Adapter<Task>(*parent, entry))));
+    } break;
     case CREATE3: {
         Segment * cs, * ds;
         int (*entry)();
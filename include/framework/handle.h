@@ -64,6 +64,10 @@ public:
     template<typename ... Tn>
     Handle(Handle<Segment> * cs, Handle<Segment> * ds, const Tn & ... an) { _stub = new _Stub(*cs->_stub, *ds->_stub, an ...); }
 
+    // Dereferencing handles for Task(parent, ...) (i.e. clones)
+    template<typename ... Tn>
+    Handle(Handle<Task> * parent, const Tn & ... an) { _stub = new _Stub(*parent->_stub, an ...); }
+
     ~Handle() { if(_stub) delete _stub; }
 
     static Handle<Component> * self() { return new (_Stub::self()) Handled<Component>; }
@@ -31,6 +31,10 @@ public:
     template<typename ... Tn>
     Stub(const Stub<Segment, true> & cs, const Stub<Segment, true> & ds, const Tn & ... an): Proxy<Component>(cs.id().unit(), ds.id().unit(), an ...) {}
 
+    // Dereferencing stubs for Task(parent, ...)
+    template<typename ... Tn>
+    Stub(const Stub<Task, true> & parent, const Tn & ... an): Proxy<Component>(parent.id().unit(), an ...) {}
+
     ~Stub() {}
 };
 
@@ -179,9 +179,15 @@ private:
     // Fragment key = f(from, id) = (from & ~_netmask) << 16 | id (fragmentation can only happen on localnet)
     typedef unsigned long Key;
 
-    // List to hold received Buffers containing datagram fragments
+    // Sweeps of the reassembly pool per TIMEOUT
+    static const unsigned int SWEEPS = 4;
+
+    // Datagrams being reassembled. Their descriptors come from a pool and each fragment is placed, as it
+    // arrives, in the slot given by its offset, so reassembly is linear on the number of fragments and
+    // causes no heap allocation. A single periodic Alarm sweeps the pool, dropping the datagrams that
+    // have not been reassembled within TIMEOUT.
     class Fragmented;
-    typedef Simple_Hash<Fragmented, Traits<Build>::NODES, Key> Reassembling;
+    typedef Simple_Hash<Fragmented, Traits<IP>::FRAGMENTED, Key> Reassembling;
 
     class Fragmented
     {
@@ -192,40 +198,53 @@ private:
         typedef Reassembling::Element Element;
 
     public:
-        Fragmented(const Key & key): _frags(MAX_FRAGMENTS), _handler(&timeout, this), _alarm(TIMEOUT, &_handler), _link(this, key) {}
+        Fragmented(): _frags(MAX_FRAGMENTS), _age(0), _link(this) {}
+
+        void reset(const Key & key) {
+            _frags = MAX_FRAGMENTS;
+            _age = 0;
+            _bitmap = Bitmap<MAX_FRAGMENTS>();
+            _link.rank(key);
+        }
 
-        void insert(Buffer * buf) {
+        // Returns false for duplicates, which are not kept
+        bool insert(Buffer * buf) {
             Packet * packet = buf->frame()->data<Packet>();
+            unsigned int i = packet->offset() / MFS;
 
-            if(_bitmap.set(packet->offset() / MFS)) // if not a dup, then insert
-                _list.insert(buf->link());
+            db<IP>(TRC) << "IP::Fragmented::insert(frags=" << _frags << ",buf=" << buf << ") => " << *packet << endl;
 
+            if(!_bitmap.set(i))
+                return false;
+
+            _slot[i] = buf;
             if(!(packet->flags() & Header::MF))
-                _frags = (packet->offset() + MFS) / MFS;
+                _frags = i + 1;
 
-            db<IP>(TRC) << "IP::Fragmented::insert(frags=" << _frags << ",buf=" << buf << ") => " << *packet << endl;
+            return true;
         }
 
         bool reassembled() const { return _bitmap.full(_frags); }
 
-        void reorder();
+        // Links the fragments received so far, in order, into a pool
+        Buffer * pool() {
+            Buffer::List list;
+            for(unsigned int i = 0; i < MAX_FRAGMENTS; i++)
+                if(_bitmap[i])
+                    list.insert(_slot[i]->link());
+            return list.head()->object();
+        }
 
-        Buffer * pool() { return _list.head()->object(); }
+        // Returns true once the datagram has been around for more than TIMEOUT
+        bool age() { return ++_age > SWEEPS; }
 
         Element * link() { return &_link; }
 
-    private:
-        static void timeout(Fragmented * frag) {
-            frag->pool()->nic()->free(frag->pool());
-            delete frag;
-        }
-
     private:
         unsigned int _frags;
+        unsigned int _age; // in sweeps
         Bitmap<MAX_FRAGMENTS> _bitmap;
-        Buffer::List _list;
-        Functor_Handler<Fragmented> _handler;
-        Alarm _alarm;
+        Buffer * _slot[MAX_FRAGMENTS];
         Element _link;
     };
 
@@ -237,12 +256,11 @@ private:
         friend class Router;
 
     private:
-        typedef Simple_List<Route> Table;
-        typedef Table::Element Element;
+        typedef List_Elements::Singly_Linked_Ordered<Route, unsigned long long> Element; // key = destination and prefix length
 
     public:
         Route(NIC * nic, IP * ip, ARP<NIC, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0):
-            _destination(d), _gateway(g), _genmask(m), _flags(t), _metric(w), _nic(nic), _ip(ip), _arp(arp), _link(this) {}
+            _destination(d), _gateway(g), _genmask(m), _prefix(prefix(m)), _flags(t), _metric(w), _nic(nic), _ip(ip), _arp(arp), _link(this, key(d, _prefix)) {}
 
         const Address & gateway() const { return _gateway; }
         NIC * nic() { return _nic; }
@@ -261,10 +279,33 @@ private:
             return db;
         }
 
+    private:
+        static unsigned int prefix(const Address & mask) {
+            unsigned int len = 0;
+            for(unsigned int i = 0; i < sizeof(Address); i++)
+                for(unsigned char b = mask[i]; b & 0x80; b <<= 1)
+                    len++;
+            return len;
+        }
+
+        static Address mask(unsigned int len) {
+            Address mask;
+            for(unsigned int i = 0; i < sizeof(Address); i++, len = (len > 8) ? len - 8 : 0)
+                mask[i] = (len >= 8) ? 0xff : (0xff << (8 - len)) & 0xff;
+            return mask;
+        }
+
+        static unsigned long long key(const Address & d, unsigned int len) {
+            // Bytes are promoted to int, so shift them as unsigned int for addresses from 128.0.0.0 on not to sign-extend
+            unsigned long long tmp = static_cast<unsigned int>(d[0]) << 24 | static_cast<unsigned int>(d[1]) << 16 | static_cast<unsigned int>(d[2]) << 8 | d[3];
+            return (tmp << 8) | len;
+        }
+
     private:
         Address _destination;
         Address _gateway;
         Address _genmask;
+        unsigned int _prefix;
         unsigned int _flags;
         unsigned int _metric;
         NIC * _nic;
@@ -275,49 +316,148 @@ private:
     };
 
 
+    // Routes are hashed by destination and prefix length, and searched from the longest prefix in use
+    // to the shortest one (i.e. Longest Prefix Match), so the order of insertion no longer matters.
+    // Destinations recently reached are kept in a direct-mapped cache along with the MAC address of
+    // their next hops, which spares IP::alloc() both the route search and the ARP resolution.
+    // Cached destinations are invalidated whenever a route is inserted or removed or the ARP table
+    // of the route changes.
     class Router
     {
     private:
-        typedef Route::Table::Element Element;
+        static const unsigned int BUCKETS = 16;
+        static const unsigned int PREFIXES = sizeof(Address) * 8 + 1;
+        static const unsigned int CACHE = Traits<IP>::CACHE;
+
+        typedef Route::Element Element;
+        typedef Hash<Route, BUCKETS, unsigned long long> Table;
+
+        struct Destination {
+            Destination(): route(0) {}
+
+            Address to;
+            Route * route;
+            MAC_Address mac;
+            unsigned int version;
+            unsigned int arp_version;
+        };
 
     public:
+        Router(): _version(0) {
+            for(unsigned int i = 0; i < PREFIXES; i++)
+                _prefixes[i] = 0;
+        }
+
         void insert(NIC * nic, IP * ip, ARP<NIC, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0) {
             Route * route = new (SYSTEM) Route(nic, ip, arp, d, g, m, t, w);
 
             db<IP>(TRC) << "IP::Router::insert() => " << *route << endl;
 
+            lock();
             _table.insert(&route->_link);
+            _prefixes[route->_prefix]++;
+            _version++;
+            unlock();
         }
 
         void remove(const Address & to) {
             db<IP>(TRC) << "IP::Router::remove(to=" << to << ")" << endl;
 
-            Element * e = _table.head();
-            for(; e && ((to & e->object()->_genmask) != e->object()->_destination); e = e->next());
-            if(e) {
-                db<IP>(INF) << "IP::Router::remove: removing and deleting " << *e->object() << endl;
+            lock();
+            Route * route = lookup(to);
+            if(route) {
+                db<IP>(INF) << "IP::Router::remove: removing and deleting " << *route << endl;
 
-                _table.remove(e);
-                delete e->object();
+                _table.remove(&route->_link);
+                _prefixes[route->_prefix]--;
+                _version++;
             }
+            unlock();
+
+            if(route)
+                delete route;
         }
 
-        Route * search(Address to) {
-            // Assume default (0.0.0.0) to have genmask 0.0.0.0 and be the last route in table
-            // Assume all routes to be network routes (i.g. flags "G")
+        Route * search(const Address & to) {
             db<IP>(TRC) << "IP::Route::search(to=" << to << ")" << endl;
 
-            Element * e = _table.head();
-            for(; e && ((to & e->object()->_genmask) != e->object()->_destination); e = e->next());
-            if(e) {
-                db<IP>(INF) << "IP::Route::search: found route to " << to << " => " << *e->object() << endl;
-                return e->object();
-            } else
+            lock();
+            Route * route = lookup(to);
+            unlock();
+
+            if(route)
+                db<IP>(INF) << "IP::Route::search: found route to " << to << " => " << *route << endl;
+
+            return route;
+        }
+
+        // Returns the cached route to "to" and the MAC address of its next hop, or 0 on a miss
+        Route * cached(const Address & to, MAC_Address * mac) {
+            if(!CACHE)
                 return 0;
+
+            Route * route = 0;
+
+            lock();
+            Destination * d = &_cache[to % CACHE];
+            if(d->route && (d->to == to) && (d->version == _version) && (d->arp_version == d->route->arp()->version())) {
+                route = d->route;
+                *mac = d->mac;
+            }
+            unlock();
+
+            return route;
+        }
+
+        // Versions must be read before the search and the resolution whose results are being cached
+        void cache(const Address & to, Route * route, const MAC_Address & mac, unsigned int version, unsigned int arp_version) {
+            if(!CACHE)
+                return;
+
+            lock();
+            Destination * d = &_cache[to % CACHE];
+            d->to = to;
+            d->route = route;
+            d->mac = mac;
+            d->version = version;
+            d->arp_version = arp_version;
+            unlock();
+        }
+
+        unsigned int version() const { return _version; }
+
+    private:
+        Route * lookup(const Address & to) {
+            for(int len = PREFIXES - 1; len >= 0; len--) {
+                if(!_prefixes[len])
+                    continue;
+
+                unsigned long long k = Route::key(to & Route::mask(len), len);
+                Element * e = _table.search_key(k);
+                if(e)
+                    return e->object();
+            }
+            return 0;
+        }
+
+        void lock() {
+            CPU::int_disable();
+            if(Traits<System>::multicore)
+                _lock.acquire();
+        }
+
+        void unlock() {
+            if(Traits<System>::multicore)
+                _lock.release();
+            CPU::int_enable();
         }
 
     private:
-        Route::Table _table;
+        Table _table;
+        unsigned short _prefixes[PREFIXES]; // number of routes with each prefix length
+        volatile unsigned int _version;
+        Destination _cache[CACHE ? CACHE : 1];
+        Spin _lock;
     };
 
 
@@ -359,7 +499,12 @@ public:
 
     static const unsigned int mtu() { return MTU; }
 
+    // One's complement checksum engine
+    // sum() adds "data" as 16-bit big-endian words to "partial" (the return of a previous call for the preceding
+    // data, which must have had an even size) and returns the folded sum; copy_and_sum() also copies it to "to"
     static unsigned short checksum(const void * data, unsigned int size);
+    static unsigned short sum(const void * data, unsigned int size, unsigned short partial = 0);
+    static unsigned short copy_and_sum(void * to, const void * from, unsigned int size, unsigned short partial = 0);
 
     static void attach(Observer * obs, const Protocol & prot) { _observed.attach(obs, prot); }
     static void detach(Observer * obs, const Protocol & prot) { _observed.detach(obs, prot); }
@@ -384,6 +529,21 @@ private:
 
     static bool notify(const Protocol & prot, Buffer * buf) { return _observed.notify(prot, buf); }
 
+    Buffer * reassemble(Buffer * buf);
+    static void sweep();
+
+    static void lock() {
+        CPU::int_disable();
+        if(Traits<System>::multicore)
+            _lock.acquire();
+    }
+
+    static void unlock() {
+        if(Traits<System>::multicore)
+            _lock.release();
+        CPU::int_enable();
+    }
+
     static void init(unsigned int unit);
 
 protected:
@@ -398,6 +558,11 @@ protected:
     static IP * _networks[Traits<NIC>::UNITS];
     static Router _router;
     static Reassembling _reassembling;
+    static Fragmented _fragmented[Traits<IP>::FRAGMENTED];
+    static Bitmap<Traits<IP>::FRAGMENTED> _free_fragmented;
+    static Function_Handler _sweeper;
+    static Alarm * _sweep;
+    static Spin _lock;
     static Observed _observed; // shared by all IP instances, so the default for binding on a port is for all IPs
 };
 
@@ -145,6 +145,9 @@ public:
     using Timer_Common::Handler;
     using Timer_Common::Channel;
 
+    // SysTick always ticks (see PC_Timer for the tickless mode)
+    static const bool tickless = false;
+
     // Channels
     enum {
         SCHEDULER,
@@ -190,6 +193,12 @@ public:
         return percentage;
     }
 
+    // Restart the countdown with t ticks (t = 0 is ignored, since channels are periodic)
+    void arm(const Tick & t) {
+        if(t)
+            _current[Machine::cpu_id()] = t;
+    }
+
     void handler(const Handler & handler) { _handler = handler; }
 
     static void enable() { Engine::enable(); }
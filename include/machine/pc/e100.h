@@ -347,6 +347,10 @@ private:
          RX_BUFS * ((sizeof(Buffer) + 15) & ~15U)  +
          TX_BUFS * ((sizeof(Buffer) + 15) & ~15U); // align128() cannot be used here
 
+    // Deferred (bottom-half) reception
+    static const bool deferred = Traits<Network>::deferred && Traits<System>::multithread;
+    static const unsigned int BUDGET = Traits<Network>::BUDGET;
+
     // Interrupt dispatching binding
     struct Device {
         E100 * device;
@@ -373,10 +377,15 @@ public:
 
     void reset();
 
+    void defer();
+
     static E100 * get(unsigned int unit = 0) { return get_by_unit(unit); }
 
 private:
     void handle_int();
+    unsigned int poll(unsigned int budget);
+
+    static int receiver(E100 * dev);
 
     static void int_handler(const IC::Interrupt_Id & interrupt);
 
@@ -507,6 +516,9 @@ private:
     Buffer * _rx_buffer[RX_BUFS];
     Buffer * _tx_buffer[TX_BUFS];
 
+    Thread * _receiver;
+    Semaphore * _rx_ready;
+
     Buffer * _tx_buffer_prev; // Previously transmitted buffer
 
     DMA_Buffer * _dma_buffer;
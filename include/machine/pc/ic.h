@@ -62,14 +62,15 @@ public:
     };
 
     // Interrupts
-    static const unsigned int INTS = 50;
+    static const unsigned int INTS = 51;
     enum {
         INT_FIRST_HARD  = HARD_INT,
         INT_TIMER       = HARD_INT + IRQ_TIMER,
         INT_KEYBOARD    = HARD_INT + IRQ_KEYBOARD,
         INT_LAST_HARD   = HARD_INT + IRQ_LAST,
         INT_RESCHEDULER = SOFT_INT,
-        INT_SYSCALL
+        INT_SYSCALL,
+        INT_PMU         // performance counter overflows, always delivered by the local APIC (see APIC::enable_perf())
     };
 
 public:
@@ -166,6 +167,7 @@ public:
         INT_KEYBOARD    = i8259A::INT_KEYBOARD,
         INT_RESCHEDULER = i8259A::INT_RESCHEDULER, // in multicores, reschedule goes via IPI, which must be acknowledged just like hardware
         INT_SYSCALL     = i8259A::INT_SYSCALL,
+        INT_PMU         = i8259A::INT_PMU,
         INT_LAST_HARD   = INT_RESCHEDULER
     };
 
@@ -397,6 +399,18 @@ public:
         enable();
     }
 
+    // Delivering a PMI masks LVT_PERF, so it must be enabled again by the handler
+    static void enable_perf() {
+        if(!Traits<System>::multicore) {
+            remap(); // only Machine::smp_init() maps the local APIC on multicores
+            if(!(read(SVR) & SVR_APIC_ENABLED)) { // see reset()
+                write(LVT_LINT0, LVT_EXTINT); // i8259A keeps interrupting through LINT0 (virtual wire mode)
+                enable();
+            }
+        }
+        write(LVT_PERF, INT_PMU);
+    }
+
 private:
     static int maxlvt() {
         Reg32 v = read(VERSION);
@@ -471,6 +485,7 @@ public:
     using Engine::INT_SYSCALL;
     using Engine::INT_TIMER;
     using Engine::INT_KEYBOARD;
+    using Engine::INT_PMU;
 
     using Engine::ipi_send;
 
@@ -534,6 +549,9 @@ private:
 
     // Physical handlers
     static void entry();
+    static void exc_pf_entry();
+    static void pmi_entry();
+    static void pmi(Reg32 eip);
     static void exc_not(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
     static void exc_pf (Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
     static void exc_gpf(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error);
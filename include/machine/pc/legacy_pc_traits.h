@@ -70,6 +70,12 @@ template<> struct Traits<PC_Timer>: public Traits<PC_Common>
     // 10000 Hz. The choice must respect the scheduler time-slice, i. e.,
     // it must be higher than the scheduler invocation frequency.
     static const int FREQUENCY = 1000; // Hz
+
+    // In tickless mode, the timer only interrupts when a channel (e.g. the
+    // next alarm or the scheduler's quantum) expires, thus FREQUENCY only
+    // sets the resolution of alarms and can be raised up to 100 kHz.
+    // Multicore configurations always tick.
+    static const bool tickless = false;
 };
 
 template<> struct Traits<PC_RTC>: public Traits<PC_Common>
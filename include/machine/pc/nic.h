@@ -47,7 +47,8 @@ public:
 
     void reset() { _dev->reset(); }
 
-    void attach(Observer * obs, const Protocol & prot) { _dev->Ethernet::Observed::attach(obs, prot); }
+    // Observers attach in thread context, so that is when devices can start deferred reception
+    void attach(Observer * obs, const Protocol & prot) { _dev->defer(); _dev->Ethernet::Observed::attach(obs, prot); }
     void detach(Observer * obs, const Protocol & prot) { _dev->Ethernet::Observed::detach(obs, prot); }
     void notify(const Protocol & prot, Buffer * buf) { _dev->Ethernet::Observed::notify(prot, buf); }
 
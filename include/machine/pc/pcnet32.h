@@ -407,6 +407,10 @@ private:
         RX_BUFS * ((sizeof(Rx_Desc) + 15) & ~15U) + TX_BUFS * ((sizeof(Tx_Desc) + 15) & ~15U) +
         RX_BUFS * ((sizeof(Buffer) + 15) & ~15U) + TX_BUFS * ((sizeof(Buffer) + 15) & ~15U); // align128() cannot be used here
 
+    // Deferred (bottom-half) reception
+    static const bool deferred = Traits<Network>::deferred && Traits<System>::multithread;
+    static const unsigned int BUDGET = Traits<Network>::BUDGET;
+
     // Interrupt dispatching binding
     struct Device {
         PCNet32 * device;
@@ -433,10 +437,15 @@ public:
 
     void reset();
 
+    void defer();
+
     static PCNet32 * get(unsigned int unit = 0) { return get_by_unit(unit); }
 
 private:
     void handle_int();
+    unsigned int poll(unsigned int budget);
+
+    static int receiver(PCNet32 * dev);
 
     static void int_handler(const IC::Interrupt_Id & interrupt);
 
@@ -478,6 +487,9 @@ private:
     Buffer * _rx_buffer[RX_BUFS];
     Buffer * _tx_buffer[TX_BUFS];
 
+    Thread * _receiver;
+    Semaphore * _rx_ready;
+
     static Device _devices[UNITS];
 };
 
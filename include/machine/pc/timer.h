@@ -91,6 +91,8 @@ public:
             cnt = CNT_0;
             control = DEF_CTRL_C0;
         }
+        if(!periodic) // one-shot
+            control = (control & ~MODE_MASK) | IOTC;
 
         CPU::out8(CTRL, control);
         CPU::out8(cnt, count & 0xff);
@@ -236,6 +238,11 @@ public:
 
 
 // Tick timer used by the system
+// In tickless mode (uniprocessor only), channels are one-shot: the engine is
+// programmed for the earliest armed channel and the time elapsed in between
+// is accounted in ticks from the TSC, so no interrupts happen while no
+// channel is due. Channels created with retrigger re-arm themselves when they
+// expire, and arm() reprograms a channel for a given number of ticks.
 class PC_Timer: private Timer_Common
 {
     friend class PC;
@@ -250,6 +257,8 @@ protected:
     static const unsigned int FREQUENCY = Traits<PC_Timer>::FREQUENCY;
 
 public:
+    static const bool tickless = Traits<PC_Timer>::tickless && !Traits<System>::multicore;
+
     enum {
         SCHEDULER,
         ALARM,
@@ -264,7 +273,7 @@ public:
 
 protected:
     PC_Timer(const Hertz & frequency, const Handler & handler, const Channel & channel, bool retrigger = true)
-    : _channel(channel), _initial(FREQUENCY / frequency), _retrigger(retrigger), _handler(handler) {
+    : _channel(channel), _initial(FREQUENCY / frequency), _retrigger(retrigger), _armed(false), _handler(handler) {
         db<Timer>(TRC) << "Timer(f=" << frequency << ",h=" << reinterpret_cast<void*>(handler)
                        << ",ch=" << channel << ") => {count=" << _initial << "}" << endl;
 
@@ -275,6 +284,9 @@ protected:
 
         for(unsigned int i = 0; i < Traits<Machine>::CPUS; i++)
             _current[i] = _initial;
+
+        if(tickless && (_channels[channel] == this))
+            arm(_initial);
     }
 
 public:
@@ -296,11 +308,17 @@ public:
         	       << ",count=" << _current[Machine::cpu_id()] << "}" << endl;
 
         int percentage = _current[Machine::cpu_id()] * 100 / _initial;
-        _current[Machine::cpu_id()] = _initial;
+        if(tickless)
+            arm(_initial);
+        else
+            _current[Machine::cpu_id()] = _initial;
 
         return percentage;
     }
 
+    // Expire once, t ticks from now (t = 0 disarms the channel); for periodic timers, restart the countdown
+    void arm(const Tick & t);
+
     static void enable() { IC::enable(IC::INT_TIMER); }
     static void disable() { IC::disable(IC::INT_TIMER); }
 
@@ -308,6 +326,9 @@ public:
     static Hertz count2freq(const Count & c) { return c ? Engine::clock() / c : 0; }
     static Count freq2count(const Hertz & f) { return f ? Engine::clock() / f : 0; }
 
+    static void account();
+    static void program();
+
     static void int_handler(const Interrupt_Id & i);
 
     static void init();
@@ -316,10 +337,12 @@ protected:
     unsigned int _channel;
     Count _initial;
     bool _retrigger;
+    volatile bool _armed;
     volatile Count _current[Traits<Machine>::CPUS];
     Handler _handler;
 
     static PC_Timer * _channels[CHANNELS];
+    static TSC::Time_Stamp _last;
 };
 
 
@@ -44,6 +44,8 @@ public:
             CD  = 0x010, // Cache Disable (0=cacheable, 1=non-cacheable)
             CT  = 0x020, // Contiguous (0=non-contiguous, 1=contiguous)
             IO  = 0x040, // Memory Mapped I/O (0=memory, 1=I/O)
+            DZ  = 0x080, // Demand Zero (0=allocated at creation, 1=allocated and zeroed at first touch)
+            COW = 0x100, // Copy-on-Write (0=private, 1=shares the frames of another segment until written)
             SYS = (PRE | RW ),
             APP = (PRE | RW | USR)
         };
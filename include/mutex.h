@@ -11,14 +11,38 @@ __BEGIN_SYS
 class Mutex: protected Synchronizer_Common
 {
 public:
-    Mutex();
+    // Protocols to bound priority inversion
+    enum Protocol {
+        NONE,           // waiters just sleep
+        INHERITANCE,    // the owner inherits the priority of its highest-priority waiter (transitively)
+        CEILING         // immediate priority ceiling: the owner runs at the ceiling while holding the mutex
+    };
+
+public:
+    Mutex(const Protocol & p = NONE, int ceiling = Thread::HIGH);
     ~Mutex();
 
     void lock();
     void unlock();
 
 private:
-    volatile bool _locked;
+    // Lock states, so the fast path can tell whether there are sleepers to wake up
+    enum {
+        FREE,
+        LOCKED,
+        CONTENDED
+    };
+
+    void acquire(Thread * owner);
+    void release();
+
+private:
+    volatile int _state;
+    Protocol _protocol;
+    int _ceiling;
+    Thread * volatile _owner;
+    int _natural; // the owner's priority before it acquired any of the mutexes it holds
+    Mutex * _next; // next mutex held by the owner (see Thread::_mutexes)
 };
 
 
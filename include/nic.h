@@ -90,6 +90,19 @@ public:
             return false;
         }
 
+        // Lexicographic order, so addresses can rank ordered lists (e.g. hash table synonyms)
+        bool operator<(const Address & a) const {
+            for(unsigned int i = 0; i < LENGTH; ++i) {
+                if(_address[i] != a._address[i])
+                    return _address[i] < a._address[i];
+            }
+            return false;
+        }
+
+        bool operator<=(const Address & a) const {
+            return !(a < *this);
+        }
+
         Address operator&(const Address & a) const {
             Address ret;
             for(unsigned int i = 0; i < LENGTH; ++i)
@@ -192,6 +205,8 @@ public:
         virtual const typename Family::Statistics & statistics() = 0;
 
         virtual void reset() = 0;
+
+        virtual void defer() {}
     };
 
     // Monomorphic NIC Base
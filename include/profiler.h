@@ -0,0 +1,59 @@
+// EPOS Profiler Abstraction Declarations
+
+// The Profiler reports what each thread has been doing while on a CPU.
+// Counters come from the PMU's virtual counters, which are accounted to
+// the thread leaving a CPU at each dispatch (Traits<PMU>::virtualized).
+// Samples come from the PMU's overflow interrupts, which record where
+// the running thread was every Traits<PMU>::SAMPLING_PERIOD cycles
+// (Traits<PMU>::sampling). Samples are kept in per-CPU rings until they
+// are drained (by samples() or dump()); those taken while a ring is full
+// are lost, so the rings must be drained at least every SAMPLES periods.
+
+#ifndef __profiler_h
+#define __profiler_h
+
+#include <utility/ostream.h>
+#include <utility/list.h>
+#include <pmu.h>
+#include <thread.h>
+
+__BEGIN_SYS
+
+class Profiler
+{
+    friend class Thread;
+
+public:
+    typedef PMU::Context Counters;
+    typedef PMU::Sample Sample;
+
+    enum {
+        CYCLES          = Counters::CYCLES,
+        INSTRUCTIONS    = Counters::INSTRUCTIONS,
+        BRANCH_MISSES   = Counters::BRANCH_MISSES,
+        LLC_MISSES      = Counters::LLC_MISSES
+    };
+
+public:
+    Profiler() {}
+
+    // What t has counted so far. The running thread includes the ongoing dispatch, but threads running on other CPUs don't
+    static Counters counters(const Thread * t = Thread::self());
+
+    // Moves up to n samples out of the CPUs' rings into buffer, returning how many were moved
+    static unsigned int samples(Sample * buffer, unsigned int n);
+
+    // Prints the counters of every thread followed by (and draining) every sample
+    static void dump(OStream & out = kout);
+
+private:
+    static void insert(Thread * t) { _threads.insert(new (SYSTEM) List<Thread>::Element(t)); }
+    static void remove(Thread * t) { List<Thread>::Element * el = _threads.remove(t); if(el) delete el; }
+
+private:
+    static List<Thread> _threads;
+};
+
+__END_SYS
+
+#endif
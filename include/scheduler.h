@@ -4,6 +4,7 @@
 #define __scheduler_h
 
 #include <utility/list.h>
+#include <utility/spin.h>
 #include <cpu.h>
 #include <machine.h>
 
@@ -17,6 +18,7 @@ namespace Scheduling_Criteria
     // Priority (static and dynamic)
     class Priority
     {
+        friend class _SYS::Thread;
         friend class _SYS::RT_Thread;
 
     public:
@@ -31,6 +33,10 @@ namespace Scheduling_Criteria
         static const bool timed = false;
         static const bool dynamic = false;
         static const bool preemptive = true;
+        static const bool stealing = false;
+
+        // Priority levels for bitmap-indexed queues (see level())
+        static const unsigned int LEVELS = 128;
 
     public:
         Priority(int p = NORMAL): _priority(p) {}
@@ -40,6 +46,25 @@ namespace Scheduling_Criteria
         void update() {}
         unsigned int queue() const { return 0; }
 
+        // Maps the priority, which can be as large as a period for RM, into
+        // one of LEVELS preserving their order: small priorities map
+        // directly, NORMAL, LOW, and IDLE get the last levels, and everything
+        // in between falls into logarithmic buckets (4 per power of two).
+        // Distinct priorities within a bucket (e.g. RM periods of 1024 and
+        // 1100) share a level, which Bitmap_Scheduling_List splits into FIFO
+        // runs of equal priorities
+        unsigned int level() const {
+            static const int DIRECT = 16;
+            static const int BITS = sizeof(int) * 8;
+
+            if(_priority < DIRECT)
+                return (_priority < 0) ? 0 : _priority;
+            if(_priority >= NORMAL)
+                return LEVELS - 1 - (IDLE - _priority);
+            unsigned int msb = BITS - 1 - __builtin_clz(_priority);
+            return DIRECT + (msb - 4) * 4 + ((_priority >> (msb - 2)) & 3);
+        }
+
     protected:
         volatile int _priority;
     };
@@ -92,6 +117,7 @@ namespace Scheduling_Criteria
 
     public:
         const volatile unsigned int & queue() const volatile { return _queue; }
+        void queue(unsigned int q) { _queue = q; }
 
     protected:
         volatile unsigned int _queue;
@@ -129,6 +155,33 @@ namespace Scheduling_Criteria
         static unsigned int current_queue() { return Machine::cpu_id(); }
     };
 
+    // Partitioned Round-Robin with Work Stealing
+    // Each CPU owns a run queue protected by its own lock (see Scheduler),
+    // so choosing the next thread only looks at the local queue. Thread
+    // states still change under the global Thread lock, but idle CPUs steal
+    // READY threads from their busy neighbours holding just the two queues'
+    // locks (see Thread::idle()). Threads created with an explicit CPU are
+    // never stolen.
+    class PRR: public CPU_Affinity
+    {
+    public:
+        static const bool timed = true;
+        static const bool dynamic = false;
+        static const bool preemptive = true;
+        static const bool stealing = true;
+
+    public:
+        PRR(int p = NORMAL, int cpu = ANY)
+        : CPU_Affinity(p, cpu), _pinned((cpu != ANY) || (p == IDLE) || (p == MAIN)) {}
+
+        using CPU_Affinity::queue;
+
+        bool migratable() const { return !_pinned; }
+
+    private:
+        bool _pinned;
+    };
+
 
     // Real-time Algorithms
     class RT_Common: public Priority
@@ -269,6 +322,18 @@ namespace Scheduling_Criteria
 template<typename T, typename R = typename T::Criterion>
 class Scheduling_Queue: public Scheduling_List<T> {};
 
+template<typename T>
+class Scheduling_Queue<T, Scheduling_Criteria::Priority>:
+public Bitmap_Scheduling_List<T> {};
+
+template<typename T>
+class Scheduling_Queue<T, Scheduling_Criteria::RM>:
+public Bitmap_Scheduling_List<T> {};
+
+template<typename T>
+class Scheduling_Queue<T, Scheduling_Criteria::DM>:
+public Bitmap_Scheduling_List<T> {};
+
 template<typename T>
 class Scheduling_Queue<T, Scheduling_Criteria::GRR>:
 public Multihead_Scheduling_List<T> {};
@@ -277,18 +342,30 @@ template<typename T>
 class Scheduling_Queue<T, Scheduling_Criteria::CPU_Affinity>:
 public Scheduling_Multilist<T> {};
 
+template<typename T>
+class Scheduling_Queue<T, Scheduling_Criteria::PRR>:
+public Scheduling_Multilist<T> {};
+
+template<typename T>
+class Scheduling_Queue<T, Scheduling_Criteria::EDF>:
+public Heap_Scheduling_List<T> {};
+
 template<typename T>
 class Scheduling_Queue<T, Scheduling_Criteria::GEDF>:
-public Multihead_Scheduling_List<T> {};
+public Multihead_Heap_Scheduling_List<T> {};
 
 template<typename T>
 class Scheduling_Queue<T, Scheduling_Criteria::PEDF>:
-public Scheduling_Multilist<T> {};
-
+public Scheduling_Multilist<T, Scheduling_Criteria::PEDF,
+                            List_Elements::Pairing_Heap_Scheduling<T, Scheduling_Criteria::PEDF>,
+                            Heap_Scheduling_List<T> > {};
 
 template<typename T>
 class Scheduling_Queue<T, Scheduling_Criteria::CEDF>:
-public Multihead_Scheduling_Multilist<T> {};
+public Scheduling_Multilist<T, Scheduling_Criteria::CEDF,
+                            List_Elements::Pairing_Heap_Scheduling<T, Scheduling_Criteria::CEDF>,
+                            Multihead_Heap_Scheduling_List<T>,
+                            Scheduling_Criteria::CEDF::QUEUES> {};
 
 
 // Scheduler
@@ -296,6 +373,9 @@ public Multihead_Scheduling_Multilist<T> {};
 // that will be used as the scheduling queue sorting criterion (viz, through
 // operators <, >, and ==) and must also define a method "link" to export the
 // list element pointing to the object being handled.
+// Criteria featuring per-CPU queues and work stealing (i.e. stealing = true)
+// get a lock per queue, which is acquired by every operation on the queue,
+// and additionally require objects to export "state()" and "READY".
 template<typename T>
 class Scheduler: public Scheduling_Queue<T>
 {
@@ -304,14 +384,25 @@ private:
 
 public:
     typedef typename T::Criterion Criterion;
-    typedef Scheduling_List<T, Criterion> Queue;
-    typedef typename Queue::Element Element;
+    typedef typename Base::Element Element;
+
+private:
+    static const bool stealing = Criterion::stealing;
+    static const unsigned int LOCKS = stealing ? Traits<Machine>::CPUS : 1;
+
+    template<bool> struct Stealing {};
 
 public:
     Scheduler() {}
 
     unsigned int schedulables() { return Base::size(); }
 
+    // Whether an object besides the chosen one and those ranked IDLE is waiting in the current queue
+    bool contended() {
+        Element * e = Base::head();
+        return e && (e->rank() != Criterion::IDLE);
+    }
+
     T * volatile chosen() {
     	// If called before insert(), chosen will dereference a null pointer!
     	// For threads, we this won't happen (see Thread::init()).
@@ -324,31 +415,44 @@ public:
     void insert(T * obj) {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::insert(" << obj << ")" << endl;
 
+        unsigned int q = lock(obj);
         Base::insert(obj->link());
+        unlock(q);
     }
 
     T * remove(T * obj) {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::remove(" << obj << ")" << endl;
 
-        return Base::remove(obj->link()) ? obj : 0;
+        unsigned int q = lock(obj);
+        obj = Base::remove(obj->link()) ? obj : 0;
+        unlock(q);
+
+        return obj;
     }
 
     void suspend(T * obj) {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::suspend(" << obj << ")" << endl;
 
+        unsigned int q = lock(obj);
         Base::remove(obj->link());
+        unlock(q);
     }
 
     void resume(T * obj) {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::resume(" << obj << ")" << endl;
 
+        unsigned int q = lock(obj);
         Base::insert(obj->link());
+        unlock(q);
     }
 
     T * choose() {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::choose() => ";
 
+        unsigned int q = current_queue();
+        lock(q);
         T * obj = Base::choose()->object();
+        unlock(q);
 
         db<Scheduler>(TRC) << obj << endl;
 
@@ -358,7 +462,10 @@ public:
     T * choose_another() {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::choose_another() => ";
 
+        unsigned int q = current_queue();
+        lock(q);
         T * obj = Base::choose_another()->object();
+        unlock(q);
 
         db<Scheduler>(TRC) << obj << endl;
 
@@ -368,13 +475,85 @@ public:
     T * choose(T * obj) {
         db<Scheduler>(TRC) << "Scheduler[chosen=" << chosen() << "]::choose(" << obj;
 
+        unsigned int q = lock(obj);
         if(!Base::choose(obj->link()))
             obj = 0;
+        unlock(q);
 
         db<Scheduler>(TRC) << obj << endl;
 
         return obj;
     }
+
+    // Migrates the highest ranked READY object that is allowed to migrate
+    // from queue "from" to the current CPU's queue, but the one "*busy"
+    // points to. "*busy" is read after each candidate's state, with the
+    // victim's queue locked, so its owner must publish it before setting
+    // the object READY
+    T * steal(unsigned int from, T * const volatile * busy = 0) {
+        return steal(from, busy, Stealing<stealing>());
+    }
+
+private:
+    static unsigned int current_queue() { return stealing ? Machine::cpu_id() : 0; }
+
+    void lock(unsigned int q) {
+        if(stealing)
+            _lock[q].acquire();
+    }
+
+    unsigned int lock(T * obj) {
+        unsigned int q = obj->link()->rank().queue();
+        if(stealing) {
+            _lock[q].acquire();
+            while(q != obj->link()->rank().queue()) { // obj got stolen before we acquired the lock
+                _lock[q].release();
+                q = obj->link()->rank().queue();
+                _lock[q].acquire();
+            }
+        }
+        return q;
+    }
+
+    void unlock(unsigned int q) {
+        if(stealing)
+            _lock[q].release();
+    }
+
+    T * steal(unsigned int from, T * const volatile * busy, const Stealing<false> &) { return 0; }
+
+    T * steal(unsigned int from, T * const volatile * busy, const Stealing<true> &) {
+        unsigned int to = current_queue();
+
+        if((from == to) || !Base::size(from)) // cheap, lock-free check before bothering the victim
+            return 0;
+
+        // Locks are always acquired in the same order to avoid deadlocks among thieves
+        lock((from < to) ? from : to);
+        lock((from < to) ? to : from);
+
+        T * obj = 0;
+        for(Element * e = Base::head(from); e; e = e->next()) {
+            T * candidate = e->object();
+            if((candidate->state() == T::READY) && (!busy || (candidate != *busy)) && e->rank().migratable()) {
+                Base::remove(e);
+                const_cast<Criterion &>(e->rank()).queue(to);
+                Base::insert(e);
+                obj = candidate;
+                break;
+            }
+        }
+
+        unlock((from < to) ? to : from);
+        unlock((from < to) ? from : to);
+
+        db<Scheduler>(TRC) << "Scheduler::steal(from=" << from << ",to=" << to << ") => " << obj << endl;
+
+        return obj;
+    }
+
+private:
+    Spin _lock[LOCKS];
 };
 
 __END_SYS
@@ -4,6 +4,7 @@
 #define __semaphore_h
 
 #include <utility/handler.h>
+#include <utility/ring.h>
 #include <synchronizer.h>
 
 __BEGIN_SYS
@@ -17,6 +18,9 @@ public:
     void p();
     void v();
 
+private:
+    bool down();
+
 private:
     volatile int _value;
 };
@@ -128,6 +132,97 @@ private:
     typename Semaphore_Observed<D, C>::Element _link;
 };
 
+
+// Blocking Ring: an IPC channel made of a lock-free ring (see utility/ring.h) whose send() and receive() only resort
+// to semaphores to put threads to sleep while the ring is full or empty, respectively, instead of once per object
+// R is SPSC_Ring, MPSC_Ring or MPMC_Ring, according to how many threads send and receive
+template<typename R>
+class Blocking_Ring
+{
+public:
+    typedef R Ring;
+    typedef typename R::Object_Type Object_Type;
+
+public:
+    Blocking_Ring(): _senders(0), _receivers(0), _room(0), _objects(0) {}
+
+    bool empty() const { return _ring.empty(); }
+    bool full() const { return _ring.full(); }
+    unsigned int size() const { return _ring.size(); }
+
+    void send(const Object_Type & o) {
+        while(!_ring.insert(o)) {
+            // Register as a sleeper before checking again, so a receiver that makes room meanwhile will know about us
+            CPU::finc(_senders);
+            if(_ring.insert(o)) {
+                withdraw(_senders, _room);
+                break;
+            }
+            _room.p();
+        }
+        signal(_receivers, _objects);
+    }
+
+    Object_Type receive() {
+        Object_Type o;
+        while(!_ring.remove(&o)) {
+            CPU::finc(_receivers);
+            if(_ring.remove(&o)) {
+                withdraw(_receivers, _objects);
+                break;
+            }
+            _objects.p();
+        }
+        signal(_senders, _room);
+        return o;
+    }
+
+    bool try_send(const Object_Type & o) {
+        if(!_ring.insert(o))
+            return false;
+        signal(_receivers, _objects);
+        return true;
+    }
+
+    bool try_receive(Object_Type * o) {
+        if(!_ring.remove(o))
+            return false;
+        signal(_senders, _room);
+        return true;
+    }
+
+private:
+    // Wakes up a sleeper, if any registered. Reading the count with a CAS also fences the preceding ring operation,
+    // so a sleeper that registered and then found the ring unchanged cannot be missed
+    static void signal(volatile int & sleepers, Semaphore & s) {
+        for(int n = CPU::cas(sleepers, 0, 0); n > 0; n = sleepers)
+            if(CPU::cas(sleepers, n, n - 1) == n) {
+                s.v();
+                break;
+            }
+    }
+
+    // Withdraws a registration. If a signal() has already claimed it, the semaphore is (or is about to be) incremented
+    // on our behalf, so that must be consumed
+    static void withdraw(volatile int & sleepers, Semaphore & s) {
+        for(int n = sleepers; ; n = sleepers) {
+            if(n <= 0) {
+                s.p();
+                break;
+            }
+            if(CPU::cas(sleepers, n, n - 1) == n)
+                break;
+        }
+    }
+
+private:
+    R _ring;
+    volatile int _senders;
+    volatile int _receivers;
+    Semaphore _room;
+    Semaphore _objects;
+};
+
 __END_SYS
 
 #endif
@@ -13,14 +13,34 @@ class Synchronizer_Common
 protected:
     typedef Thread::Queue Queue;
 
+    // On SMP, synchronizers first try a lock-free fast path, which doesn't touch the scheduler lock, and
+    // then spin for a while before blocking
+    static const bool smp = Traits<Thread>::smp;
+    static const bool spinning = smp && Traits<Synchronizer>::SPIN;
+    static const unsigned int SPIN = Traits<Synchronizer>::SPIN;
+    static const unsigned int SPIN_MIN = 16;
+
 protected:
-    Synchronizer_Common() {}
+    Synchronizer_Common(): _spin(SPIN) {}
     ~Synchronizer_Common() { begin_atomic(); wakeup_all(); }
 
     // Atomic operations
     bool tsl(volatile bool & lock) { return CPU::tsl(lock); }
     int finc(volatile int & number) { return CPU::finc(number); }
     int fdec(volatile int & number) { return CPU::fdec(number); }
+    int cas(volatile int & value, int compare, int replacement) { return CPU::cas(value, compare, replacement); }
+
+    // Adaptive spinning: the budget follows twice the iterations successful spins took and is halved whenever a
+    // spin exhausts it, so synchronizers held for long quickly go back to blocking right away
+    unsigned int spin_budget() const { return (_spin < SPIN_MIN) ? SPIN_MIN : _spin; }
+    void spun(unsigned int iterations, bool succeeded) {
+        if(succeeded)
+            _spin += (int(2 * iterations) - int(_spin)) / 8;
+        else if(iterations >= spin_budget())
+            _spin /= 2;
+        if(_spin > SPIN)
+            _spin = SPIN;
+    }
 
     // Thread operations
     void begin_atomic() { Thread::lock(); }
@@ -32,6 +52,7 @@ protected:
 
 protected:
     Queue _queue;
+    volatile unsigned int _spin;
 };
 
 __END_SYS
@@ -166,6 +166,7 @@ namespace Scheduling_Criteria
     class EDF;
     class GRR;
     class CPU_Affinity;
+    class PRR;
     class GEDF;
     class PEDF;
     class CEDF;
@@ -29,7 +29,7 @@ protected:
     // This constructor is only used by Init_First
     template<typename ... Tn>
     Task(Address_Space * as, Segment * cs, Segment * ds, int (* entry)(Tn ...), const Log_Addr & code, const Log_Addr & data, Tn ... an)
-    : _as(as), _cs(cs), _ds(ds), _entry(entry), _code(code), _data(data) {
+    : _as(as), _cs(cs), _ds(ds), _entry(entry), _code(code), _data(data), _clone(false) {
         db<Task, Init>(TRC) << "Task(as=" << _as << ",cs=" << _cs << ",ds=" << _ds << ",entry=" << _entry << ",code=" << _code << ",data=" << _data << ") => " << this << endl;
 
         _current = this;
@@ -40,18 +40,30 @@ protected:
 public:
     template<typename ... Tn>
     Task(Segment * cs, Segment * ds, int (* entry)(Tn ...), Tn ... an)
-    : _as (new (SYSTEM) Address_Space), _cs(cs), _ds(ds), _entry(entry), _code(_as->attach(_cs)), _data(_as->attach(_ds)) {
+    : _as (new (SYSTEM) Address_Space), _cs(cs), _ds(ds), _entry(entry), _code(_as->attach(_cs)), _data(_as->attach(_ds)), _clone(false) {
         db<Task>(TRC) << "Task(as=" << _as << ",cs=" << _cs << ",ds=" << _ds << ",entry=" << _entry << ",code=" << _code << ",data=" << _data << ") => " << this << endl;
 
         _main = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::MAIN, WHITE, this, 0), entry, an ...);
     }
     template<typename ... Tn>
     Task(const Thread::Configuration & conf, Segment * cs, Segment * ds, int (* entry)(Tn ...), Tn ... an)
-    : _as (new (SYSTEM) Address_Space), _cs(cs), _ds(ds), _entry(entry), _code(_as->attach(_cs)), _data(_as->attach(_ds)) {
+    : _as (new (SYSTEM) Address_Space), _cs(cs), _ds(ds), _entry(entry), _code(_as->attach(_cs)), _data(_as->attach(_ds)), _clone(false) {
         db<Task>(TRC) << "Task(as=" << _as << ",cs=" << _cs << ",ds=" << _ds << ",entry=" << _entry << ",code=" << _code << ",data=" << _data << ") => " << this << endl;
 
         _main = new (SYSTEM) Thread(Thread::Configuration(conf.state, conf.criterion, this, 0), entry, an ...);
     }
+
+    // A clone shares the code segment of its parent and gets a copy-on-write copy of its data segment
+    // (including the heap), both attached at the same addresses, so pointers to data remain valid
+    template<typename ... Tn>
+    Task(const Task & parent, int (* entry)(Tn ...), Tn ... an)
+    : _as (new (SYSTEM) Address_Space), _cs(parent._cs), _ds(new (SYSTEM) Segment(*parent._ds, Segment::Flags::APP | Segment::Flags::COW)), _entry(entry),
+      _code(_as->attach(_cs, parent._code)), _data(_as->attach(_ds, parent._data)), _clone(true) {
+        db<Task>(TRC) << "Task(parent=" << &parent << ",cs=" << _cs << ",ds=" << _ds << ",entry=" << _entry << ",code=" << _code << ",data=" << _data << ") => " << this << endl;
+
+        // entry is not crt0's _start, so it must return to __exit like ordinary threads do
+        _main = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::NORMAL, WHITE, this, 0), entry, an ...);
+    }
     ~Task();
 
     Address_Space * address_space() const { return _as; }
@@ -86,6 +98,7 @@ private:
     Log_Addr _data;
     Thread * _main;
     Queue _threads;
+    bool _clone; // owns its (copy-on-write) data segment
 
     static Task * volatile _current;
 };
@@ -5,8 +5,10 @@
 
 #include <utility/handler.h>
 #include <utility/random.h>
+#include <tsc.h>
 #include <alarm.h>
 #include <condition.h>
+#include <semaphore.h>
 #include <ip.h>
 #include <icmp.h>
 #include <udp.h> // TCP::Address == UDP_Address
@@ -24,6 +26,14 @@ public:
     static const unsigned int RETRIES = Traits<TCP>::RETRIES;
     static const unsigned int TIMEOUT = Traits<TCP>::TIMEOUT * 1000000;
     static const unsigned int WINDOW = Traits<TCP>::WINDOW;
+    static const unsigned int SEGMENTS = Traits<TCP>::SEGMENTS;
+    static const bool SACK = Traits<TCP>::SACK;
+    static const unsigned int REORDER = Traits<TCP>::REORDER;
+    static const unsigned int DELAYED_ACK = Traits<TCP>::DELAYED_ACK;
+
+    static const unsigned int DUPLICATES = 3; // duplicate ACKs that trigger a fast retransmit (RFC 5681)
+    static const unsigned int RTO_MIN = 200 * 1000; // us
+    static const unsigned int RTO_MAX = 60 * 1000 * 1000; // us
 
     typedef IP::Buffer Buffer;
 
@@ -52,6 +62,16 @@ public:
             CWR = 0x80
         };
 
+        // Options
+        enum {
+            END                 = 0,
+            NOP                 = 1,
+            SEGMENT_SIZE        = 2, // Maximum Segment Size (RFC 793)
+            WINDOW_SCALE        = 3, // RFC 7323
+            SACK_PERMITTED      = 4, // RFC 2018
+            SELECTIVE_ACK       = 5  // RFC 2018
+        };
+
     public:
         Header() {}
         Header(const Port & from, const Port & to, unsigned int sequence, unsigned short window)
@@ -65,8 +85,48 @@ public:
         unsigned int flags() const { return _flags; }
         unsigned int window() const { return ntohs(_window); }
 
+        void sequence(unsigned int s) { _sequence = htonl(s); }
+        void flags(const Flags & f) { _flags = f; }
+        void window(unsigned int w) { _window = htons(w); }
+
+        unsigned int size() const { return _data_offset * 4; } // including options
+        void size(unsigned int s) { _data_offset = s / 4; }
+
         unsigned short checksum() const { return ntohs(_checksum); }
 
+        // Returns the first option of the given kind, or 0 if the segment carries none
+        const unsigned char * option(unsigned char kind) const {
+            const unsigned char * o = reinterpret_cast<const unsigned char *>(this) + sizeof(Header);
+            const unsigned char * end = reinterpret_cast<const unsigned char *>(this) + size();
+            while((o < end) && (*o != END)) {
+                if(*o == NOP) {
+                    o++;
+                    continue;
+                }
+                if((o + 1 >= end) || (o[1] < 2) || (o + o[1] > end))
+                    break;
+                if(*o == kind)
+                    return o;
+                o += o[1];
+            }
+            return 0;
+        }
+
+        // Makes n SACK blocks ({left edge, right edge}) the only option, aligned by two NOPs (RFC 2018)
+        void sack(const unsigned int blocks[][2], unsigned int n) {
+            unsigned char * o = reinterpret_cast<unsigned char *>(this) + sizeof(Header);
+            o[0] = NOP;
+            o[1] = NOP;
+            o[2] = SELECTIVE_ACK;
+            o[3] = 2 + 8 * n;
+            for(unsigned int i = 0; i < n; i++)
+                for(unsigned int b = 0; b < 4; b++) {
+                    o[4 + 8 * i + b] = blocks[i][0] >> (24 - 8 * b);
+                    o[8 + 8 * i + b] = blocks[i][1] >> (24 - 8 * b);
+                }
+            size(sizeof(Header) + 4 + 8 * n);
+        }
+
         friend OStream & operator<<(OStream & db, const Header & h) {
             db << "{sp=" << hex << ntohs(h._from) << ",dp=" << ntohs(h._to)
                << ",seq=" << ntohl(h._sequence) << ",ack=" << ntohl(h._acknowledgment)
@@ -91,6 +151,17 @@ public:
     static const unsigned int MTU = IP::MTU - sizeof(Header);
     static const unsigned int MSS = IP::MFS - sizeof(Header);
     static const unsigned int HEADERS_SIZE = sizeof(IP::Header) + sizeof(Header);
+    static const unsigned int OPTIONS = 12; // MSS, window scale and SACK permitted, sent in SYN segments
+
+private:
+    // Window scale (RFC 7323) that makes WINDOW fit in the 16-bit window field
+    template<unsigned int W, unsigned int S = 0>
+    struct Scale { enum { Result = (W > 0xffff) ? Scale<(W >> 1), S + 1>::Result : S }; };
+    template<unsigned int S>
+    struct Scale<0, S> { enum { Result = S }; };
+
+public:
+    static const unsigned int SCALE = Scale<WINDOW>::Result;
 
     typedef unsigned char Data[MTU];
 
@@ -101,10 +172,12 @@ public:
 
         Header * header() { return this; }
 
+        // Payload, right after the options
         template<typename T>
-        T * data() { return reinterpret_cast<T *>(&_data); }
+        T * data() { return reinterpret_cast<T *>(reinterpret_cast<unsigned char *>(this) + size()); }
 
         void sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int length);
+        void fill(const IP::Address & from, const IP::Address & to, const void * data, unsigned int length); // copy and sum in a single pass
         bool check(unsigned int length) { return IP::checksum(this, length) != 0xffff; } // FIXME
 
         friend Debug & operator<<(Debug & db, const Segment & m) {
@@ -117,6 +190,121 @@ public:
     } __attribute__((packed));
 
 
+    // NewReno congestion window (RFC 5681 and RFC 6582), in bytes
+    class Reno
+    {
+    public:
+        static const unsigned int INITIAL = 4; // initial window, in segments (RFC 3390)
+
+    public:
+        Reno(): _mss(MSS), _window(INITIAL * MSS), _threshold(~0U) {}
+
+        unsigned int window() const { return _window; }
+        void window(unsigned int w) { _window = w; }
+        unsigned int threshold() const { return _threshold; }
+
+        void mss(unsigned int mss) { _mss = mss; _window = INITIAL * mss; }
+
+        // New data has been acknowledged (outside a recovery): slow start or congestion avoidance
+        void acknowledged(unsigned int bytes) {
+            if(_window < _threshold)
+                _window += (bytes < _mss) ? bytes : _mss;
+            else
+                _window += (_mss * _mss / _window) ? _mss * _mss / _window : 1;
+        }
+
+        // A loss was detected, either by duplicate ACKs or by a retransmission time-out
+        void lost(unsigned int flight, bool timeout) {
+            _threshold = (flight / 2 > 2 * _mss) ? flight / 2 : 2 * _mss;
+            _window = timeout ? _mss : _threshold;
+        }
+
+        // Fast recovery's window inflation (one segment per duplicate ACK) and partial deflation (RFC 6582)
+        void inflate(unsigned int bytes) { _window += bytes; }
+        void deflate(unsigned int bytes) { _window = ((_window > bytes) ? _window - bytes : 0) + _mss; }
+
+    protected:
+        unsigned int _mss;
+        unsigned int _window;
+        unsigned int _threshold;
+    };
+
+    // CUBIC congestion window (RFC 8312): after a loss, the window grows as a cubic function of the time
+    // elapsed since it, centered at the window in which the loss happened, instead of once per RTT
+    class Cubic: public Reno
+    {
+    private:
+        static const unsigned int BETA = 717; // multiplicative decrease (0.7 in 1/1024)
+        static const unsigned int C = 410; // scaling constant (0.4 in 1/1024)
+        static const unsigned int HORIZON = 1 << 16; // cap of |t - K|, in 1/1024 s, for the cube not to overflow
+
+    public:
+        Cubic(): _maximum(0), _k(0), _epoch(0) {}
+
+        void acknowledged(unsigned int bytes) {
+            if(_window < _threshold) {
+                Reno::acknowledged(bytes);
+                return;
+            }
+
+            if(!_epoch) {
+                _epoch = TSC::time_stamp();
+                if(_maximum < _window / _mss) {
+                    _maximum = _window / _mss;
+                    _k = 0;
+                }
+            }
+
+            // W(t) = C * (t - K)^3 + W_max, with t and K in 1/1024 s and windows in segments
+            long long t = (TSC::time_stamp() - _epoch) * 1024 / TSC::frequency();
+            long long d = t - _k;
+            unsigned long long offset = (d < 0) ? -d : d;
+            if(offset > HORIZON)
+                offset = HORIZON;
+            unsigned int delta = (C * offset * offset * offset) >> 40;
+            unsigned int target = (d < 0) ? ((_maximum > delta) ? _maximum - delta : 0) : _maximum + delta;
+
+            // Grow towards the target within an RTT, but never slower than Reno would
+            unsigned int window = _window / _mss;
+            unsigned int cubic = (target > window) ? _mss * (target - window) / window : 0;
+            unsigned int reno = (_mss * _mss / _window) ? _mss * _mss / _window : 1;
+            _window += (cubic > reno) ? cubic : reno;
+        }
+
+        void lost(unsigned int flight, bool timeout) {
+            unsigned int window = _window / _mss;
+
+            // Fast convergence: release bandwidth for new flows if the window did not reach the previous maximum
+            _maximum = (window < _maximum) ? window * (1024 + BETA) / 2048 : window;
+            _k = cbrt(static_cast<unsigned long long>(_maximum) * (1024 - BETA) * (1 << 30) / C);
+            _epoch = 0;
+
+            _threshold = static_cast<unsigned long long>(_window) * BETA / 1024;
+            if(_threshold < 2 * _mss)
+                _threshold = 2 * _mss;
+            _window = timeout ? _mss : _threshold;
+        }
+
+    private:
+        static unsigned int cbrt(unsigned long long x) {
+            unsigned int r = 0;
+            for(int b = 20; b >= 0; b--) {
+                unsigned long long t = r | (1U << b);
+                if(t * t * t <= x)
+                    r = t;
+            }
+            return r;
+        }
+
+    private:
+        unsigned int _maximum; // W_max, in segments
+        unsigned int _k; // time W(t) takes to reach W_max again, in 1/1024 s
+        TSC::Time_Stamp _epoch; // start of the current congestion avoidance period
+    };
+
+    typedef IF<Traits<TCP>::CUBIC, Cubic, Reno>::Result Congestion;
+
+
     class Connection: public Header, private TCP::Observer, public TCP::Observed
     {
         friend class TCP;
@@ -138,18 +326,41 @@ public:
 
         typedef void (Connection:: * State_Handler)();
 
+        // Retransmission queue entry: a segment in flight, whose payload is still in the buffer being streamed by send()
+        struct Transmission
+        {
+            unsigned int sequence;
+            unsigned int length;
+            TSC::Time_Stamp sent;
+            bool sacked;
+            bool lost; // must be retransmitted
+            bool retransmitted; // does not yield RTT samples (Karn's algorithm)
+        };
+
     public:
         Connection(const Port & from, const Address & to)
-        : Header(from, to.port(), Random::random() & 0x00ffffff, WINDOW), _peer(to.ip()), _peer_window(0), _next(ntohl(_sequence)),
+        : Header(from, to.port(), Random::random() & 0x00ffffff, (WINDOW > 0xffff) ? 0xffff : WINDOW), _peer(to.ip()), _peer_window(0), _next(ntohl(_sequence)),
           _unacknowledged(_next), _initial(_next), _state(CLOSED), _handler(&Connection::closed), _current(0), _length(0), _valid(false),
-          _streaming(false), _retransmiting(false), _timeout_handler(&timeout,this), _alarm(0), _tries(0), _observer(0) {}
-        ~Connection() { if(_alarm) delete _alarm; close(); }
+          _streaming(false), _stream(0), _data(0), _base(0), _first(0), _queued(0), _mss(MSS), _peer_shift(0), _scaling(true), _sack(SACK),
+          _recover(0), _duplicates(0), _recovering(false), _srtt(0), _rttvar(0), _rto(TIMEOUT), _timer(0),
+          _reordering(0), _latest(0), _buffered(0), _edge(0), _pending(0), _delay_handler(&delayed, this), _delay(0),
+          _timeout_handler(&timeout,this), _alarm(0), _tries(0), _observer(0) {}
+        ~Connection() {
+            if(_alarm)
+                delete _alarm;
+            close();
+            if(_delay)
+                delete _delay;
+            for(unsigned int i = 0; i < _reordering; i++)
+                _reordered[i]->nic()->free(_reordered[i]);
+        }
 
         const volatile State & state() const { return _state; }
         const Header * header() const { return this; }
 
         int send(const void * data, unsigned int size);
         int receive(Buffer * buf, void * data, unsigned int size);
+        void release(Buffer * buf); // returns a segment received through notify() and reopens the window
 
         const IP::Address & peer() const { return _peer; }
 
@@ -177,7 +388,8 @@ public:
 
         friend Debug & operator<<(Debug & db, const Connection & c) {
             db << *c.header()
-               << ",peer=" << c._peer << ",pwin=" << c._peer_window << ",uack=" << ntohl(c._unacknowledged) << ",stat=" << c._state;
+               << ",peer=" << c._peer << ",pwin=" << c._peer_window << ",uack=" << c._unacknowledged << ",cwnd=" << c._congestion.window()
+               << ",rto=" << c._rto << ",stat=" << c._state;
             if(c._current)
                 db << ",curr=" << c._current << " => " << *c._current << ",len=" << c._length;
             return db;
@@ -190,6 +402,7 @@ public:
         }
 
         void update(TCP::Observed * osb, unsigned long long socket, Buffer * buf);
+        bool process(unsigned long long socket, Buffer * buf);
 
         // State Transition Initiators
         void listen();
@@ -210,17 +423,51 @@ public:
         void closed();
 
         void fsend(const Flags & flags);
-        int dsend(const void * data, unsigned int size);
+        int dsend(unsigned int sequence, const void * data, unsigned int size);
+
+        // Send pipeline
+        void transmit(unsigned int end, bool probe);
+        bool acknowledge();
+        bool expired();
+        void negotiate();
+        void sack();
+        void rtt(const TSC::Time_Stamp & sample);
+        void backoff() { _rto = (_rto < RTO_MAX / 2) ? _rto * 2 : RTO_MAX; }
+
+        Transmission * transmission(unsigned int i) { return &_queue[(_first + i) % SEGMENTS]; }
+
+        // Receive pipeline
+        bool reorder(Buffer * buf);
+        Buffer * deliverable();
+        unsigned int selective(unsigned int blocks[][2]);
+        void ack(bool now = false);
+        void acked();
+        static void delayed(Connection * c);
+        unsigned int advertised(bool syn);
+
+        Segment * reordered(unsigned int i) { return _reordered[i]->frame()->data<Packet>()->data<Segment>(); }
 
         bool check_sequence();
         void process_fin();
 
         static void timeout(Connection * c);
-        void set_timeout(const Alarm::Microsecond & time = TIMEOUT);
+        void set_timeout(const Alarm::Microsecond & time);
+
+        void lock() {
+            CPU::int_disable();
+            if(Traits<System>::multicore)
+                _lock.acquire();
+        }
+
+        void unlock() {
+            if(Traits<System>::multicore)
+                _lock.release();
+            CPU::int_enable();
+        }
 
     private:
         IP::Address _peer;
-        unsigned short  _peer_window;   // (host endianness)
+        unsigned int _peer_window;      // already scaled (host endianness)
         unsigned int _next;             // next regular sequence number to be sent, it tells how far the conversation has gone (host endianness)
         unsigned int _unacknowledged;   // earliest unacknowledged sequence number sent (host endianness)
         const unsigned int _initial;    // initial sequence number (host endianness)
@@ -237,8 +484,40 @@ public:
 
         // Stream stuff
         volatile bool _streaming;
-        volatile bool _retransmiting;
-        Condition _stream;
+        Semaphore _stream;              // signaled by ACKs that move the pipeline
+        const unsigned char * _data;    // buffer being streamed by send()
+        unsigned int _base;             // sequence number of _data[0]
+        Transmission _queue[SEGMENTS];  // retransmission queue, a ring of the segments in flight, oldest first
+        unsigned int _first;
+        unsigned int _queued;
+        unsigned int _mss;              // smaller of ours and the peer's
+        unsigned char _peer_shift;      // peer's window scale
+        bool _scaling;                  // window scale offered (before SYN) or negotiated (after it)
+        bool _sack;                     // SACK offered (before SYN) or negotiated (after it)
+
+        // Congestion control
+        Congestion _congestion;
+        unsigned int _recover;          // SND.NXT when the loss that started the current recovery was detected
+        unsigned int _duplicates;       // consecutive duplicate ACKs
+        bool _recovering;
+
+        // Round-trip time estimation (Jacobson/Karels, RFC 6298)
+        unsigned int _srtt;             // smoothed RTT, scaled by 8 (us)
+        unsigned int _rttvar;           // RTT variation, scaled by 4 (us)
+        unsigned int _rto;              // retransmission time-out (us)
+        TSC::Time_Stamp _timer;         // when the retransmission timer was last (re)started
+
+        // Reception stuff
+        Buffer * _reordered[REORDER ? REORDER : 1]; // out-of-order segments, sorted by sequence number
+        unsigned int _reordering;
+        unsigned int _latest;           // sequence number of the latest segment reordered (reported in the first SACK block)
+        unsigned int _buffered;         // bytes received but not yet released by the observer
+        unsigned int _edge;             // right edge of the last window advertised (RCV.NXT + RCV.WND)
+        unsigned int _pending;          // segments received but not yet acknowledged
+        Functor_Handler<Connection> _delay_handler;
+        Alarm * _delay;                 // delayed ACK timer
+
+        Spin _lock;
 
         // Timeout stuff
         Functor_Handler<Connection> _timeout_handler;
@@ -273,6 +552,7 @@ public:
             conn->listen();
 
         if(conn->state() != Connection::ESTABLISHED) {
+            _observed.detach(conn, conn->id());
             delete conn;
             conn = 0;
         }
@@ -283,10 +563,16 @@ public:
     static void detach(Observer * obs, Connection * conn) {
         unsigned long long id = conn->id();
         conn->detach(obs);
-        delete conn;
         _observed.detach(conn, id);
+        delete conn;
     }
 
+    // Zero-copy reception: segments notified to observers are read in place and must be released afterwards
+    // (through Connection::release(), so the space they held is advertised in the window again)
+    static void * payload(Buffer * buf) { return buf->frame()->data<Packet>()->data<Segment>()->data<void>(); }
+    static unsigned int payload_size(Buffer * buf) { return buf->size() - sizeof(IP::Header) - buf->frame()->data<Packet>()->data<Segment>()->size(); }
+    static void release(Buffer * pool) { pool->nic()->free(pool); }
+
 private:
     void update(IP::Observed * obs, IP::Protocol prot, Buffer * pool);
 
@@ -295,7 +581,9 @@ private:
     }
 
 private:
-    static Observed _observed; // Channel protocols are singletons
+    typedef IF<(Traits<TCP>::DEMUX > 0), Hashed_Data_Observed<Buffer, unsigned long long, Traits<TCP>::DEMUX>, Observed>::Result Demux;
+
+    static Demux _observed; // Channel protocols are singletons
 };
 
 __END_SYS
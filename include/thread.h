@@ -7,6 +7,7 @@
 #include <utility/handler.h>
 #include <cpu.h>
 #include <machine.h>
+#include <pmu.h>
 #include <system.h>
 #include <scheduler.h>
 #include <segment.h>
@@ -21,14 +22,17 @@ class Thread
     friend class System;
     friend class Scheduler<Thread>;
     friend class Synchronizer_Common;
+    friend class Mutex;
     friend class Alarm;
     friend class Task;
     friend class IA32;
     friend class Agent;
+    friend class Profiler;
 
 protected:
     static const bool smp = Traits<Thread>::smp;
     static const bool preemptive = Traits<Thread>::Criterion::preemptive;
+    static const bool stealing = smp && Traits<Thread>::Criterion::stealing;
     static const bool multitask = Traits<System>::multitask;
     static const bool reboot = Traits<System>::reboot;
 
@@ -111,7 +115,13 @@ protected:
     Queue::Element * link() { return &_link; }
 
     Criterion & criterion() { return const_cast<Criterion &>(_link.rank()); }
+    void update_criterion();
+    void inherit(int p);
 
+    // _lock protects every thread's _state and its membership in the scheduler's queues, so every
+    // transition of them, including yield, time slicing, and forced reschedules with per-CPU queues
+    // (Criterion::stealing), happens with it held. Only thieves (see steal()) go without it: they hold
+    // both queues' locks and move nothing but READY threads, whose _state they leave untouched
     static void lock() {
         CPU::int_disable();
         if(smp)
@@ -140,6 +150,7 @@ protected:
     static void dispatch(Thread * prev, Thread * next, bool charge = true);
 
     static int idle();
+    static bool steal();
 
 private:
     static void init();
@@ -150,15 +161,21 @@ protected:
 
     char * _stack;
     Context * volatile _context;
+    CPU::FPU_Context _fpu;
     volatile State _state;
     Queue * _waiting;
     Thread * volatile _joining;
     Queue::Element _link;
+    Mutex * _mutexes;           // priority inheritance/ceiling mutexes held, most recent first (see Mutex)
+    Mutex * volatile _blocker;  // the priority inheritance/ceiling mutex this thread is waiting for
+    Color _color;               // home color, whose partition gets this thread's LLC misses (see Page_Coloring)
+    PMU::Context _pmu;          // virtual PMU counters, accounted each time this thread leaves a CPU (see Profiler)
 
     static volatile unsigned int _thread_count;
     static Scheduler_Timer * _timer;
     static Scheduler<Thread> _scheduler;
     static Spin _lock;
+    static Thread * volatile _leaving[Traits<Machine>::CPUS];
 };
 
 __END_SYS
@@ -169,7 +186,7 @@ __BEGIN_SYS
 
 template<typename ... Tn>
 inline Thread::Thread(int (* entry)(Tn ...), Tn ... an)
-: _task(Task::self()), _user_stack(0), _state(READY), _waiting(0), _joining(0), _link(this, NORMAL)
+: _task(Task::self()), _user_stack(0), _state(READY), _waiting(0), _joining(0), _link(this, NORMAL), _mutexes(0), _blocker(0)
 {
     constructor_prologue(WHITE, STACK_SIZE);
     _context = CPU::init_stack(0, _stack + STACK_SIZE, &__exit, entry, an ...);
@@ -178,11 +195,11 @@ inline Thread::Thread(int (* entry)(Tn ...), Tn ... an)
 
 template<typename ... Tn>
 inline Thread::Thread(const Configuration & conf, int (* entry)(Tn ...), Tn ... an)
-: _task(conf.task ? conf.task : Task::self()), _state(conf.state), _waiting(0), _joining(0), _link(this, conf.criterion)
+: _task(conf.task ? conf.task : Task::self()), _state(conf.state), _waiting(0), _joining(0), _link(this, conf.criterion), _mutexes(0), _blocker(0)
 {
     if(multitask && !conf.stack_size) { // Auto-expand, user-level stack
         constructor_prologue(conf.color, STACK_SIZE);
-        _user_stack = new (SYSTEM) Segment(USER_STACK_SIZE);
+        _user_stack = new (SYSTEM) Segment(USER_STACK_SIZE, WHITE, Segment::Flags::APP | Segment::Flags::DZ); // only touched pages get frames
 
         // Attach the thread's user-level stack to the current address space so we can initialize it
         Log_Addr ustack = Task::self()->address_space()->attach(_user_stack);
@@ -108,6 +108,7 @@ public:
 
         void sum_header(const IP::Address & from, const IP::Address & to);
         void sum_data(const void * data, unsigned int size);
+        void copy_data(void * to, const void * from, unsigned int size); // copy and sum in a single pass
         void sum_trailer();
         bool check() { return Traits<UDP>::checksum ? (IP::checksum(this, length()) != 0xffff) : true; }
 
@@ -135,14 +136,28 @@ public:
     static int send(const Port & from, const Address & to, const void * data, unsigned int size);
     static int receive(Buffer * buf, void * data, unsigned int size);
 
+    // Zero-copy interface
+    // The payload is written (before send) or read (after receive) in place, in the NIC buffers
+    // of the pool, one IP fragment per buffer, by walking it with payload() and payload_size()
+    static Buffer * alloc(const Address & to, unsigned int size);
+    static int send(const Port & from, const Address & to, Buffer * pool);
+    static int receive(Buffer * pool); // the pool is lent to the caller until release(), unless the datagram is empty (0) or wrong (-1)
+    static void release(Buffer * pool) { pool->nic()->free(pool); }
+
+    static void * payload(Buffer * buf);
+    static unsigned int payload_size(Buffer * buf);
+
     static void attach(Observer * obs, const Port & port) { _observed.attach(obs, port); }
     static void detach(Observer * obs, const Port & port) { _observed.detach(obs, port); }
     static bool notify(const Port & port, Buffer * buf) { return _observed.notify(port, buf); }
 
+private:
+    typedef IF<(Traits<UDP>::DEMUX > 0), Hashed_Data_Observed<Buffer, Port, Traits<UDP>::DEMUX>, Observed>::Result Demux;
+
 private:
     void update(IP::Observed * obs, IP::Protocol prot, Buffer * buf);
 
-    static Observed _observed; // Channel protocols are singletons
+    static Demux _observed; // Channel protocols are singletons
 };
 
 __END_SYS
@@ -44,6 +44,18 @@ public:
         return true;
     }
 
+    bool operator[](unsigned int index) const {
+        return (index < BITS) && (_map[index / BPI] & (1 << (index & mask)));
+    }
+
+    // Index of the lowest bit set or -1 if none
+    int first() const {
+        for(unsigned int i = 0; i < SIZE; i++)
+            if(_map[i])
+                return i * BPI + __builtin_ctz(_map[i]);
+        return -1;
+    }
+
     bool empty(unsigned int upto = BITS) const {
         unsigned int i;
         for(i = 0; i < upto / BPI; i++)
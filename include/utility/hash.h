@@ -9,9 +9,22 @@
 
 __BEGIN_UTIL
 
+// Hash Function
+// Keys are reduced to table indices with the operator %. Wider integral keys, such
+// as TCP connection ids, are folded first, so all of their bits take part in it.
+template<typename Key>
+inline unsigned int hash(const Key & key, unsigned int size) { return key % size; }
+
+template<>
+inline unsigned int hash(const unsigned long long & key, unsigned int size) {
+    unsigned int k = static_cast<unsigned int>(key >> 32) ^ static_cast<unsigned int>(key);
+    return (k ^ (k >> 16)) % size;
+}
+
+
 // Hash Table with a single Synonym List
 // In order to change the hash function, simply redefine the operator % for
-// objects of type T and Key.
+// objects of type Key (or specialize hash() for it).
 template<typename T, unsigned int SIZE, typename Key = int>
 class Simple_Hash
 {
@@ -83,7 +96,7 @@ public:
     }
 
     void insert(Element * e) {
-        if(!_vector.insert(e, e->key() % SIZE))
+        if(!_vector.insert(e, hash(e->key(), SIZE)))
             _synonyms.insert(e);
     }
 
@@ -107,16 +120,16 @@ public:
     }
 
     Element * search_key(const Key & key) {
-        Element * e = _vector[key % SIZE];
+        Element * e = _vector[hash(key, SIZE)];
         if(e && (e->key() == key))
             return e;
         return _synonyms.search_rank(key);
     }
 
     Element * remove_key(const Key & key) {
-        Element * e = _vector[key % SIZE];
+        Element * e = _vector[hash(key, SIZE)];
         if(e && (e->key() == key))
-            return _vector.remove(key % SIZE);
+            return _vector.remove(hash(key, SIZE));
         return _synonyms.remove_rank(key);
     }
 
@@ -143,28 +156,28 @@ public:
     Hash() {}
 
     bool empty() const {
-        for(int i; i < SIZE; i++)
+        for(unsigned int i = 0; i < SIZE; i++)
             if(!_table[i].empty())
         	return false;
         return true;
     }
 
     unsigned int size() const {
-        int size = 0;
-        for(int i; i < SIZE; i++)
+        unsigned int size = 0;
+        for(unsigned int i = 0; i < SIZE; i++)
             size += _table[i].size();
         return size;
     }
 
     void insert(Element * e) {
-        _table[e->key() % SIZE].insert(e);
+        _table[hash(e->key(), SIZE)].insert(e);
     }
 
     Element * remove(Element * e) {
-        return _table[e->key() % SIZE].remove(e);
+        return _table[hash(e->key(), SIZE)].remove(e);
     }
     Element * remove(const Object_Type * obj) {
-        for(int i = 0; i < SIZE; i++) {
+        for(unsigned int i = 0; i < SIZE; i++) {
             Element * e = _table[i].remove(obj);
             if(e)
         	return e;
@@ -173,7 +186,7 @@ public:
     }
 
     Element * search(const Object_Type * obj) {
-        for(int i = 0; i < SIZE; i++) {
+        for(unsigned int i = 0; i < SIZE; i++) {
             Element * e = _table[i].search(obj);
             if(e)
         	return e;
@@ -182,15 +195,20 @@ public:
     }
 
     Element * search_key(const Key & key) {
-        return _table[key % SIZE].search_rank(key);
+        return _table[hash(key, SIZE)].search_rank(key);
     }
 
     Element * remove_key(const Key & key) {
-        return _table[key % SIZE].remove_rank(key);
+        return _table[hash(key, SIZE)].remove_rank(key);
     }
 
     List * operator[](const Key & key) {
-        return &_table[key % SIZE];
+        return &_table[hash(key, SIZE)];
+    }
+
+    // Synonym list at a given position of the table, for traversals
+    List * bucket(unsigned int i) {
+        return &_table[i];
     }
 
 private:
@@ -4,16 +4,43 @@
 #define __heap_h
 
 #include <utility/debug.h>
+#include <utility/string.h>
 #include <utility/list.h>
 #include <utility/spin.h>
 
 __BEGIN_UTIL
 
 // Heap
+// Small blocks (up to MAX_CLASS bytes, including the header) are served by
+// a slab front-end: sizes are rounded up to a power of two (size class) and
+// each class keeps a free list of blocks carved SLAB bytes at a time from
+// the grouping list, so allocating and freeing them take O(1). Larger blocks
+// go through the grouping list's first-fit search. Slabs are never merged
+// back into the grouping list, which trades some memory for not fragmenting
+// it with short-lived small objects.
 class Simple_Heap: private Grouping_List<char>
 {
 protected:
     static const bool typed = Traits<System>::multiheap;
+    static const bool slab = Traits<Heaps>::slab;
+
+public:
+    static const unsigned int MIN_CLASS = 16;
+    static const unsigned int CLASSES = 5; // 16, 32, 64, 128 and 256 bytes
+    static const unsigned int MAX_CLASS = MIN_CLASS << (CLASSES - 1);
+    static const unsigned int SLAB = 1024;
+
+    // Allocations and frees are counted per class, with large blocks at [CLASSES]
+    struct Statistics {
+        unsigned int allocations[CLASSES + 1];
+        unsigned int frees[CLASSES + 1];
+        unsigned int slabs[CLASSES];
+        unsigned int cached[CLASSES];   // blocks in the free lists
+        unsigned int in_use;            // bytes, including headers and class rounding
+        unsigned int high_water;        // maximum in_use so far
+        unsigned int free;              // bytes left in the grouping list
+        unsigned int fragments;         // number of disjoint free regions in the grouping list
+    };
 
 public:
     using Grouping_List<char>::empty;
@@ -21,11 +48,14 @@ public:
 
     Simple_Heap() {
         db<Init, Heaps>(TRC) << "Heap() => " << this << endl;
+
+        clear();
     }
 
     Simple_Heap(void * addr, unsigned int bytes) {
         db<Init, Heaps>(TRC) << "Heap(addr=" << addr << ",bytes=" << bytes << ") => " << this << endl;
 
+        clear();
         free(addr, bytes);
     }
 
@@ -35,29 +65,13 @@ public:
         if(!bytes)
             return 0;
 
-        if(!Traits<CPU>::unaligned_memory_access)
-            while((bytes % sizeof(void *)))
-                ++bytes;
-
-        if(typed)
-            bytes += sizeof(void *);  // add room for heap pointer
-        bytes += sizeof(int);         // add room for size
-        if(bytes < sizeof(Element))
-            bytes = sizeof(Element);
-
-        Element * e = search_decrementing(bytes);
-        if(!e) {
+        void * addr = allocate(bytes);
+        if(!addr) {
             out_of_memory();
             return 0;
         }
 
-        int * addr = reinterpret_cast<int *>(e->object() + e->size());
-
-        if(typed)
-            *addr++ = reinterpret_cast<int>(this);
-        *addr++ = bytes;
-
-        db<Heaps>(TRC) << ") => " << reinterpret_cast<void *>(addr) << endl;
+        db<Heaps>(TRC) << ") => " << addr << endl;
 
         return addr;
     }
@@ -65,28 +79,167 @@ public:
     void free(void * ptr, unsigned int bytes) {
         db<Heaps>(TRC) << "Heap::free(this=" << this << ",ptr=" << ptr << ",bytes=" << bytes << ")" << endl;
 
-        if(ptr && (bytes >= sizeof(Element))) {
+        unsigned int c = slab ? size_class(bytes) : CLASSES;
+        if(ptr && (c < CLASSES) && (bytes == (MIN_CLASS << c))) {
+            Block * b = reinterpret_cast<Block *>(ptr);
+            b->next = _free[c];
+            _free[c] = b;
+            _statistics.cached[c]++;
+        } else if(ptr && (bytes >= sizeof(Element))) {
             Element * e = new (ptr) Element(reinterpret_cast<char *>(ptr), bytes);
             Element * m1, * m2;
             insert_merging(e, &m1, &m2);
         }
     }
 
+    Statistics statistics() const {
+        Statistics tmp = _statistics;
+        tmp.free = grouped_size();
+        tmp.fragments = Grouping_List<char>::size();
+        return tmp;
+    }
+
     static void typed_free(void * ptr) {
         int * addr = reinterpret_cast<int *>(ptr);
         unsigned int bytes = *--addr;
         Simple_Heap * heap = reinterpret_cast<Simple_Heap *>(*--addr);
-        heap->free(addr, bytes);
+        heap->release(addr, bytes);
     }
 
     static void untyped_free(Simple_Heap * heap, void * ptr) {
         int * addr = reinterpret_cast<int *>(ptr);
         unsigned int bytes = *--addr;
-        heap->free(addr, bytes);
+        heap->release(addr, bytes);
+    }
+
+protected:
+    // Size class that serves a request for "bytes", or CLASSES if it goes to the grouping list
+    static unsigned int request_class(unsigned int bytes) {
+        return slab ? size_class(block_size(bytes)) : CLASSES;
+    }
+
+    // Size class of a block returned by alloc(), or CLASSES if it came from the grouping list
+    static unsigned int block_class(void * ptr) {
+        unsigned int bytes = reinterpret_cast<int *>(ptr)[-1];
+        unsigned int c = slab ? size_class(bytes) : CLASSES;
+        return ((c < CLASSES) && (bytes == (MIN_CLASS << c))) ? c : CLASSES;
+    }
+
+    // Like alloc(), but returns 0 instead of panicking if there is no room left
+    void * allocate(unsigned int bytes) {
+        bytes = block_size(bytes);
+
+        unsigned int c = slab ? size_class(bytes) : CLASSES;
+        int * addr;
+        if(c < CLASSES) {
+            bytes = MIN_CLASS << c;
+            addr = reinterpret_cast<int *>(take(c));
+        } else {
+            Element * e = search_decrementing(bytes);
+            addr = e ? reinterpret_cast<int *>(e->object() + e->size()) : 0;
+        }
+
+        if(!addr)
+            return 0;
+
+        _statistics.allocations[c]++;
+        _statistics.in_use += bytes;
+        if(_statistics.in_use > _statistics.high_water)
+            _statistics.high_water = _statistics.in_use;
+
+        if(typed)
+            *addr++ = reinterpret_cast<int>(this);
+        *addr++ = bytes;
+
+        return addr;
     }
 
 private:
+    struct Block { Block * next; };
+
+    // Size of the block needed to hold "bytes" plus the header
+    static unsigned int block_size(unsigned int bytes) {
+        if(!Traits<CPU>::unaligned_memory_access)
+            while((bytes % sizeof(void *)))
+                ++bytes;
+
+        if(typed)
+            bytes += sizeof(void *);  // add room for heap pointer
+        bytes += sizeof(int);         // add room for size
+        if(bytes < sizeof(Element))
+            bytes = sizeof(Element);
+
+        return bytes;
+    }
+
+    // Smallest class that fits "bytes", or CLASSES if none does
+    static unsigned int size_class(unsigned int bytes) {
+        unsigned int c = 0;
+        for(unsigned int s = MIN_CLASS; (c < CLASSES) && (s < bytes); s <<= 1)
+            c++;
+        return c;
+    }
+
+    void * take(unsigned int c) {
+        if(!_free[c] && !refill(c))
+            return 0;
+
+        Block * b = _free[c];
+        _free[c] = b->next;
+        _statistics.cached[c]--;
+
+        return b;
+    }
+
+    // Carves a new slab for class c, or at least a single block if memory is short
+    bool refill(unsigned int c) {
+        unsigned int bytes = MIN_CLASS << c;
+        unsigned int n = (SLAB > bytes) ? SLAB / bytes : 1;
+
+        Element * e = search_decrementing(n * bytes);
+        if(!e) {
+            n = 1;
+            e = search_decrementing(bytes);
+            if(!e)
+                return false;
+        }
+
+        char * base = e->object() + e->size();
+        for(unsigned int i = n; i > 0; i--) { // keep the free list in address order
+            Block * b = reinterpret_cast<Block *>(base + (i - 1) * bytes);
+            b->next = _free[c];
+            _free[c] = b;
+        }
+        _statistics.cached[c] += n;
+        _statistics.slabs[c]++;
+
+        db<Heaps>(INF) << "Heap::refill(this=" << this << ",class=" << bytes << ",blocks=" << n << ")" << endl;
+
+        return true;
+    }
+
+    // Frees a block previously returned by alloc()
+    void release(void * ptr, unsigned int bytes) {
+        unsigned int c = slab ? size_class(bytes) : CLASSES;
+        if((c < CLASSES) && (bytes != (MIN_CLASS << c)))
+            c = CLASSES;
+        _statistics.frees[c]++;
+        _statistics.in_use -= bytes;
+
+        free(ptr, bytes);
+    }
+
+    void clear() {
+        for(unsigned int i = 0; i < CLASSES; i++)
+            _free[i] = 0;
+        memset(&_statistics, 0, sizeof(Statistics));
+    }
+
     void out_of_memory();
+
+private:
+    Block * _free[CLASSES];
+    Statistics _statistics;
 };
 
 
@@ -97,13 +250,40 @@ class Heap_Wrapper: public T
 public:
     Heap_Wrapper() {}
     Heap_Wrapper(void * addr, unsigned int bytes): T(addr, bytes) {}
+
+    using T::allocate;
+};
+
+
+// Forwarder to the current CPU id
+class This_CPU
+{
+public:
+    static unsigned int id();
 };
 
 
 // Wrapper for atomic heap
+// Small blocks are cached in per-CPU magazines (one per size class), so most
+// allocations and frees only disable interrupts (to keep the thread from
+// migrating) and do not touch the shared lock. An empty magazine is refilled
+// and a full one is flushed MAGAZINE / 2 blocks at a time with a single lock
+// acquisition, which also returns blocks freed on a CPU other than the one
+// that allocated them in batches.
 template<typename T>
 class Heap_Wrapper<T, true>: public T
 {
+private:
+    static const unsigned int CPUS = Traits<Build>::CPUS;
+    static const unsigned int MAGAZINE = T::slab ? Traits<Heaps>::MAGAZINE : 0;
+
+    struct Magazine {
+        Magazine(): count(0) {}
+
+        unsigned int count;
+        void * block[MAGAZINE ? MAGAZINE : 1];
+    };
+
 public:
     Heap_Wrapper() {}
     Heap_Wrapper(void * addr, unsigned int bytes): T(addr, bytes) {}
@@ -123,16 +303,48 @@ public:
     }
 
     void * alloc(unsigned int bytes) {
+        unsigned int c = T::request_class(bytes);
+        if(MAGAZINE && bytes && (c < T::CLASSES)) {
+            CPU::int_disable();
+            Magazine * m = &_magazine[This_CPU::id()][c];
+            if(!m->count)
+                refill(m, bytes);
+            void * tmp = m->count ? m->block[--m->count] : 0;
+            CPU::int_enable();
+
+            if(tmp)
+                return tmp;
+        }
+
 	enter();
 	void * tmp = T::alloc(bytes);
 	leave();
 	return tmp;
     }
 
+    // Like alloc(), but returns 0 instead of panicking if there is no room left (magazines are not used)
+    void * allocate(unsigned int bytes) {
+        enter();
+        void * tmp = T::allocate(bytes);
+        leave();
+        return tmp;
+    }
+
+    // Frees a block previously returned by alloc()
     void free(void * ptr) {
-	enter();
-	T::free(ptr);
-	leave();
+        unsigned int c = T::block_class(ptr);
+        if(MAGAZINE && (c < T::CLASSES)) {
+            CPU::int_disable();
+            Magazine * m = &_magazine[This_CPU::id()][c];
+            if(m->count == MAGAZINE)
+                flush(m);
+            m->block[m->count++] = ptr;
+            CPU::int_enable();
+        } else {
+            enter();
+            T::untyped_free(this, ptr);
+            leave();
+        }
     }
 
     void free(void * ptr, unsigned int bytes) {
@@ -141,6 +353,31 @@ public:
 	leave();
     }
 
+    // Blocks held in magazines are reported as cached, not in use
+    typename T::Statistics statistics() {
+        enter();
+        typename T::Statistics tmp = T::statistics();
+        leave();
+
+        if(MAGAZINE)
+            for(unsigned int i = 0; i < CPUS; i++)
+                for(unsigned int c = 0; c < T::CLASSES; c++) {
+                    tmp.cached[c] += _magazine[i][c].count;
+                    tmp.in_use -= _magazine[i][c].count * (T::MIN_CLASS << c);
+                }
+
+        return tmp;
+    }
+
+    static void typed_free(void * ptr) {
+        Heap_Wrapper * heap = reinterpret_cast<Heap_Wrapper *>(reinterpret_cast<int *>(ptr)[-2]);
+        heap->free(ptr);
+    }
+
+    static void untyped_free(Heap_Wrapper * heap, void * ptr) {
+        heap->free(ptr);
+    }
+
 private:
     void enter() {
         _lock.acquire();
@@ -152,8 +389,26 @@ private:
         CPU::int_enable();
     }
 
+    // Both must be called with interrupts disabled
+    void refill(Magazine * m, unsigned int bytes) {
+        _lock.acquire();
+        for(void * p; (m->count < MAGAZINE / 2) && (p = T::allocate(bytes)); )
+            m->block[m->count++] = p;
+        _lock.release();
+
+        db<Heaps>(INF) << "Heap::refill(this=" << this << ",bytes=" << bytes << ",blocks=" << m->count << ")" << endl;
+    }
+
+    void flush(Magazine * m) {
+        _lock.acquire();
+        while(m->count > MAGAZINE / 2)
+            T::untyped_free(this, m->block[--m->count]);
+        _lock.release();
+    }
+
 private:
     Spin _lock;
+    Magazine _magazine[CPUS][T::CLASSES];
 };
 
 
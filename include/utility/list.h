@@ -4,6 +4,7 @@
 #define __list_h
 
 #include <system/config.h>
+#include <utility/bitmap.h>
 
 __BEGIN_UTIL
 
@@ -231,6 +232,42 @@ namespace List_Elements
         Element * _next;
     };
 
+    // Heap Scheduling List Element
+    // Prev and next are reused as siblings in the heap, so these elements
+    // can also be used in doubly-linked lists while not in a heap
+    template<typename T, typename R = Rank>
+    class Pairing_Heap_Scheduling
+    {
+    public:
+        typedef T Object_Type;
+        typedef R Rank_Type;
+        typedef Pairing_Heap_Scheduling Element;
+
+    public:
+        Pairing_Heap_Scheduling(const T * o,  const R & r = 0): _object(o), _rank(r), _prev(0), _next(0), _child(0) {}
+
+        T * object() const { return const_cast<T *>(_object); }
+
+        Element * prev() const { return _prev; }
+        Element * next() const { return _next; }
+        Element * child() const { return _child; }
+        void prev(Element * e) { _prev = e; }
+        void next(Element * e) { _next = e; }
+        void child(Element * e) { _child = e; }
+
+        const R & rank() const { return _rank; }
+        void rank(const R & r) { _rank = r; }
+        int promote(const R & n = 1) { _rank -= n; return _rank; }
+        int demote(const R & n = 1) { _rank += n; return _rank; }
+
+    private:
+        const T * _object;
+        R _rank;
+        Element * _prev;
+        Element * _next;
+        Element * _child;
+    };
+
 
     // Grouping List Element
     template<typename T>
@@ -327,6 +364,48 @@ namespace List_Iterators
     private:
         Element * _current;
     };
+
+    // Pre-order Iterator (for pairing heaps, whose first children have their parents as prev)
+    template<typename El>
+    class Heap
+    {
+    private:
+        typedef Heap<El> Iterator;
+
+    public:
+        typedef El Element;
+
+    public:
+        Heap(): _current(0) {}
+        Heap(Element * e): _current(e) {}
+
+        operator Element *() const { return _current; }
+
+        Element & operator*() const { return *_current; }
+        Element * operator->() const { return _current; }
+
+        Iterator & operator++() {
+            if(_current->child())
+                _current = _current->child();
+            else {
+                while(_current && !_current->next()) { // climb up to the first ancestor with a next sibling
+                    while(_current->prev() && (_current->prev()->child() != _current))
+                        _current = _current->prev();
+                    _current = _current->prev();
+                }
+                if(_current)
+                    _current = _current->next();
+            }
+            return *this;
+        }
+        Iterator operator++(int) { Iterator tmp = *this; ++*this; return tmp; }
+
+        bool operator==(const Iterator & i) const { return _current == i._current; }
+        bool operator!=(const Iterator & i) const { return _current != i._current; }
+
+    private:
+        Element * _current;
+    };
 }
 
 // Singly-Linked List
@@ -1088,6 +1167,554 @@ private:
 };
 
 
+// Bitmap-indexed, Doubly-Linked Scheduling List
+// Besides declaring "Criterion", objects subject to scheduling policies that
+// use this list must export the LEVELS constant to indicate the number of
+// priority levels and the level() method to map a rank into a level. Levels
+// are checked in increasing order, so level() must preserve the order of
+// ranks. A bitmap of non-empty levels makes choose() independent of the
+// number of objects in the list. Several ranks might share a level (e.g.
+// RM periods), so each level is kept in rank order and remembers, for up to
+// RUNS distinct ranks, the last object of each (i.e. a FIFO run of equal
+// ranks). An object is inserted right after the last one of its rank or of
+// the closest smaller rank, so insert() and remove() only look at the runs,
+// taking constant time regardless of the number of objects. Only when more
+// than RUNS distinct ranks share a level at once do the extra ones fall back
+// to a walk from the level's tail.
+// As with Scheduling_List, the chosen element is kept outside the list.
+template<typename T,
+          typename R = typename T::Criterion,
+          typename El = List_Elements::Doubly_Linked_Scheduling<T, R>,
+          unsigned int L = R::LEVELS>
+class Bitmap_Scheduling_List
+{
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+    typedef List_Iterators::Bidirecional<El> Iterator;
+
+private:
+    class Level: public List<T, El>
+    {
+    private:
+        typedef List<T, El> Base;
+
+        static const unsigned int RUNS = 8;
+
+        struct Run {
+            int rank;
+            Element * last;
+        };
+
+    public:
+        using Base::empty;
+        using Base::head;
+        using Base::tail;
+
+        Level(): _runs(0), _strays(0) {}
+
+        void insert(Element * e) {
+            int rank = e->rank();
+
+            int r = run(rank);
+            if(r >= 0) {
+                place(e, _run[r].last);
+                _run[r].last = e;
+                return;
+            }
+
+            // Without strays, the last object of the closest smaller run is the last one of a smaller rank
+            if(!_strays && (_runs < RUNS)) {
+                Element * prev = 0;
+                int closest = 0;
+                for(unsigned int i = 0; i < _runs; i++)
+                    if((_run[i].rank < rank) && (!prev || (_run[i].rank > closest))) {
+                        prev = _run[i].last;
+                        closest = _run[i].rank;
+                    }
+                place(e, prev);
+                _run[_runs].rank = rank;
+                _run[_runs].last = e;
+                _runs++;
+                return;
+            }
+
+            // Too many distinct ranks in this level: walk
+            Element * prev = tail();
+            for(; prev && (prev->rank() > e->rank()); prev = prev->prev());
+            place(e, prev);
+            _strays++;
+        }
+
+        Element * remove(Element * e) {
+            int rank = e->rank();
+
+            int r = run(rank);
+            if(r < 0)
+                _strays--;
+            else if(_run[r].last == e) {
+                if(e->prev() && (int(e->prev()->rank()) == rank))
+                    _run[r].last = e->prev();
+                else
+                    _run[r] = _run[--_runs];
+            }
+
+            return Base::remove(e);
+        }
+
+        Element * remove_head() { return empty() ? 0 : remove(head()); }
+
+    private:
+        int run(int rank) const {
+            for(unsigned int i = 0; i < _runs; i++)
+                if(_run[i].rank == rank)
+                    return i;
+            return -1;
+        }
+
+        void place(Element * e, Element * prev) {
+            if(!prev)
+                Base::insert_head(e);
+            else if(prev == tail())
+                Base::insert_tail(e);
+            else
+                Base::insert(e, prev, prev->next());
+        }
+
+    private:
+        Run _run[RUNS];
+        unsigned int _runs;
+        unsigned int _strays; // objects whose rank has no run
+    };
+
+public:
+    Bitmap_Scheduling_List(): _size(0), _chosen(0) {}
+
+    bool empty() const { return (_size == 0); }
+    unsigned int size() const { return _size; }
+
+    Element * head() {
+        int l = _map.first();
+        return (l < 0) ? 0 : _level[l].head();
+    }
+
+    Element * volatile & chosen() { return _chosen; }
+
+    void insert(Element * e) {
+        db<Lists>(TRC) << "Bitmap_Scheduling_List::insert(e=" << e
+                       << ") => {p=" << (e ? e->prev() : (void *) -1)
+                       << ",o=" << (e ? e->object() : (void *) -1)
+                       << ",n=" << (e ? e->next() : (void *) -1)
+                       << "}" << endl;
+
+        if(_chosen)
+            enqueue(e);
+        else
+            _chosen = e;
+    }
+
+    Element * remove(Element * e) {
+        db<Lists>(TRC) << "Bitmap_Scheduling_List::remove(e=" << e
+                       << ") => {p=" << (e ? e->prev() : (void *) -1)
+                       << ",o=" << (e ? e->object() : (void *) -1)
+                       << ",n=" << (e ? e->next() : (void *) -1)
+                       << "}" << endl;
+
+        if(e == _chosen)
+            _chosen = dequeue();
+        else
+            dequeue(e);
+
+        return e;
+    }
+
+    Element * choose() {
+        db<Lists>(TRC) << "Bitmap_Scheduling_List::choose()" << endl;
+
+        if(!empty()) {
+            enqueue(_chosen);
+            _chosen = dequeue();
+        }
+
+        return _chosen;
+    }
+
+    Element * choose_another() {
+        db<Lists>(TRC) << "Bitmap_Scheduling_List::choose_another()" << endl;
+
+        if(!empty() && head()->rank() != R::IDLE) {
+            Element * tmp = _chosen;
+            _chosen = dequeue();
+            enqueue(tmp);
+        }
+
+        return _chosen;
+    }
+
+    Element * choose(Element * e) {
+        db<Lists>(TRC) << "Bitmap_Scheduling_List::choose(e=" << e
+                       << ") => {p=" << (e ? e->prev() : (void *) -1)
+                       << ",o=" << (e ? e->object() : (void *) -1)
+                       << ",n=" << (e ? e->next() : (void *) -1)
+                       << "}" << endl;
+
+        if(e != _chosen) {
+            enqueue(_chosen);
+            _chosen = dequeue(e);
+        }
+
+        return _chosen;
+    }
+
+private:
+    void enqueue(Element * e) {
+        unsigned int l = e->rank().level();
+        _level[l].insert(e);
+        _map.set(l);
+        _size++;
+    }
+
+    Element * dequeue() {
+        int l = _map.first();
+        if(l < 0)
+            return 0;
+        Element * e = _level[l].remove_head();
+        if(_level[l].empty())
+            _map.reset(l);
+        _size--;
+        return e;
+    }
+
+    Element * dequeue(Element * e) {
+        unsigned int l = e->rank().level();
+        _level[l].remove(e);
+        if(_level[l].empty())
+            _map.reset(l);
+        _size--;
+        return e;
+    }
+
+private:
+    unsigned int _size;
+    Element * volatile _chosen;
+    Level _level[L];
+    Bitmap<L> _map;
+};
+
+
+// Pairing Heap
+// A heap-ordered multiway tree in which each node points to its first child
+// and to its siblings. Insertions take O(1), while removals, of the head or
+// of an arbitrary element, take O(log n) amortized. On ties, the elements
+// already in the heap are favored, thus re-inserting the head of a heap with
+// several elements of the same rank (e.g. on yield) lets another one run.
+template<typename T,
+          typename R = List_Element_Rank,
+          typename El = List_Elements::Pairing_Heap_Scheduling<T, R> >
+class Pairing_Heap
+{
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+    typedef List_Iterators::Heap<El> Iterator;
+
+public:
+    Pairing_Heap(): _size(0), _root(0) {}
+
+    bool empty() const { return (_size == 0); }
+    unsigned int size() const { return _size; }
+
+    Element * head() { return _root; }
+
+    Iterator begin() { return Iterator(_root); }
+    Iterator end() { return Iterator(0); }
+
+    void insert(Element * e) {
+        db<Lists>(TRC) << "Pairing_Heap::insert(e=" << e << ")" << endl;
+
+        e->prev(0);
+        e->next(0);
+        e->child(0);
+        _root = meld(_root, e);
+        _size++;
+    }
+
+    Element * remove() {
+        db<Lists>(TRC) << "Pairing_Heap::remove()" << endl;
+
+        Element * e = _root;
+        if(e) {
+            _root = merge_pairs(e->child());
+            e->child(0);
+            _size--;
+        }
+        return e;
+    }
+
+    Element * remove(Element * e) {
+        db<Lists>(TRC) << "Pairing_Heap::remove(e=" << e << ")" << endl;
+
+        if(e == _root)
+            return remove();
+
+        // Cut e's subtree (prev is either the parent or the previous sibling)
+        if(e->prev()->child() == e)
+            e->prev()->child(e->next());
+        else
+            e->prev()->next(e->next());
+        if(e->next())
+            e->next()->prev(e->prev());
+        e->prev(0);
+        e->next(0);
+
+        _root = meld(_root, merge_pairs(e->child()));
+        e->child(0);
+        _size--;
+
+        return e;
+    }
+
+private:
+    // Makes the greater root the first child of the other (ties favor a)
+    static Element * meld(Element * a, Element * b) {
+        if(!a)
+            return b;
+        if(!b)
+            return a;
+        if(b->rank() < a->rank()) {
+            Element * tmp = a;
+            a = b;
+            b = tmp;
+        }
+        b->prev(a);
+        b->next(a->child());
+        if(a->child())
+            a->child()->prev(b);
+        a->child(b);
+        return a;
+    }
+
+    // Standard two-pass merge of a sibling list: meld pairs from left to
+    // right, then meld the results from right to left
+    static Element * merge_pairs(Element * first) {
+        Element * paired = 0;
+        while(first) {
+            Element * a = first;
+            Element * b = a->next();
+            first = b ? b->next() : 0;
+            a->prev(0);
+            a->next(0);
+            if(b) {
+                b->prev(0);
+                b->next(0);
+                a = meld(a, b);
+            }
+            a->next(paired); // results are stacked through next
+            paired = a;
+        }
+
+        Element * root = 0;
+        while(paired) {
+            Element * next = paired->next();
+            paired->next(0);
+            root = meld(paired, root);
+            paired = next;
+        }
+        if(root)
+            root->prev(0);
+
+        return root;
+    }
+
+private:
+    unsigned int _size;
+    Element * _root;
+};
+
+
+// Heap Scheduling List
+// A Scheduling_List backed by a Pairing_Heap, so inserting and removing
+// objects don't walk the list. Since ranks are only compared on insertion,
+// dynamic criteria (e.g. EDF) must remove and reinsert queued objects whose
+// ranks change (see Thread::update_criterion()).
+// As with Scheduling_List, the chosen element is kept outside the heap.
+template<typename T,
+          typename R = typename T::Criterion,
+          typename El = List_Elements::Pairing_Heap_Scheduling<T, R> >
+class Heap_Scheduling_List: private Pairing_Heap<T, R, El>
+{
+private:
+    typedef Pairing_Heap<T, R, El> Base;
+
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+    typedef typename Base::Iterator Iterator;
+
+public:
+    Heap_Scheduling_List(): _chosen(0) {}
+
+    using Base::empty;
+    using Base::size;
+    using Base::head;
+    using Base::begin;
+    using Base::end;
+
+    Element * volatile & chosen() { return _chosen; }
+
+    void insert(Element * e) {
+        db<Lists>(TRC) << "Heap_Scheduling_List::insert(e=" << e << ")" << endl;
+
+        if(_chosen)
+            Base::insert(e);
+        else
+            _chosen = e;
+    }
+
+    Element * remove(Element * e) {
+        db<Lists>(TRC) << "Heap_Scheduling_List::remove(e=" << e << ")" << endl;
+
+        if(e == _chosen)
+            _chosen = Base::remove();
+        else
+            e = Base::remove(e);
+
+        return e;
+    }
+
+    Element * choose() {
+        db<Lists>(TRC) << "Heap_Scheduling_List::choose()" << endl;
+
+        if(!empty()) {
+            Base::insert(_chosen);
+            _chosen = Base::remove();
+        }
+
+        return _chosen;
+    }
+
+    Element * choose_another() {
+        db<Lists>(TRC) << "Heap_Scheduling_List::choose_another()" << endl;
+
+        if(!empty() && head()->rank() != R::IDLE) {
+            Element * tmp = _chosen;
+            _chosen = Base::remove();
+            Base::insert(tmp);
+        }
+
+        return _chosen;
+    }
+
+    Element * choose(Element * e) {
+        db<Lists>(TRC) << "Heap_Scheduling_List::choose(e=" << e << ")" << endl;
+
+        if(e != _chosen) {
+            Base::insert(_chosen);
+            _chosen = Base::remove(e);
+        }
+
+        return _chosen;
+    }
+
+private:
+    Element * volatile _chosen;
+};
+
+
+// Multihead Heap Scheduling List
+// A Multihead_Scheduling_List backed by a Pairing_Heap (see
+// Heap_Scheduling_List). All heads share the same heap.
+template<typename T,
+          typename R = typename T::Criterion,
+          typename El = List_Elements::Pairing_Heap_Scheduling<T, R>,
+          unsigned int H = R::HEADS>
+class Multihead_Heap_Scheduling_List: private Pairing_Heap<T, R, El>
+{
+private:
+    typedef Pairing_Heap<T, R, El> Base;
+
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+    typedef typename Base::Iterator Iterator;
+
+public:
+    Multihead_Heap_Scheduling_List() {
+        for(unsigned int i = 0; i < H; i++)
+            _chosen[i] = 0;
+    }
+
+    using Base::empty;
+    using Base::size;
+    using Base::head;
+    using Base::begin;
+    using Base::end;
+
+    Element * volatile & chosen() { return _chosen[R::current_head()]; }
+
+    void insert(Element * e) {
+        db<Lists>(TRC) << "Multihead_Heap_Scheduling_List::insert(e=" << e << ")" << endl;
+
+        if(_chosen[R::current_head()])
+            Base::insert(e);
+        else
+            _chosen[R::current_head()] = e;
+    }
+
+    Element * remove(Element * e) {
+        db<Lists>(TRC) << "Multihead_Heap_Scheduling_List::remove(e=" << e << ")" << endl;
+
+        if(e == _chosen[R::current_head()])
+            _chosen[R::current_head()] = Base::remove();
+        else
+            e = Base::remove(e);
+
+        return e;
+    }
+
+    Element * choose() {
+        db<Lists>(TRC) << "Multihead_Heap_Scheduling_List::choose()" << endl;
+
+        if(!empty()) {
+            Base::insert(_chosen[R::current_head()]);
+            _chosen[R::current_head()] = Base::remove();
+        }
+
+        return _chosen[R::current_head()];
+    }
+
+    Element * choose_another() {
+        db<Lists>(TRC) << "Multihead_Heap_Scheduling_List::choose_another()" << endl;
+
+        if(!empty() && head()->rank() != R::IDLE) {
+            Element * tmp = _chosen[R::current_head()];
+            _chosen[R::current_head()] = Base::remove();
+            Base::insert(tmp);
+        }
+
+        return _chosen[R::current_head()];
+    }
+
+    Element * choose(Element * e) {
+        db<Lists>(TRC) << "Multihead_Heap_Scheduling_List::choose(e=" << e << ")" << endl;
+
+        if(e != _chosen[R::current_head()]) {
+            Base::insert(_chosen[R::current_head()]);
+            _chosen[R::current_head()] = Base::remove(e);
+        }
+
+        return _chosen[R::current_head()];
+    }
+
+private:
+    Element * volatile _chosen[H];
+};
+
+
 // Doubly-Linked, Multihead Scheduling List
 // Besides declaring "Criterion", objects subject to scheduling policies that
 // use the Multihead list must export the HEADS constant to indicate the
@@ -1223,6 +1850,7 @@ public:
     bool empty() const { return _list[R::current_queue()].empty(); }
 
     unsigned int size() const { return _list[R::current_queue()].size(); }
+    unsigned int size(unsigned int queue) const { return _list[queue].size(); }
     unsigned int total_size() const {
         unsigned int s = 0;
         for(unsigned int i = 0; i < Q; i++)
@@ -1231,6 +1859,7 @@ public:
     }
 
     Element * head() { return _list[R::current_queue()].head(); }
+    Element * head(unsigned int queue) { return _list[queue].head(); }
     Element * tail() { return _list[R::current_queue()].tail(); }
 
     Iterator begin() { return Iterator(_list[R::current_queue()].head()); }
@@ -49,9 +49,26 @@ void operator delete[](void * ptr);
 
 __BEGIN_SYS
 
+// Page Coloring
+// Memory allocated with "new (color)" comes from the heap of the partition
+// whose home color is "color". Heaps are created at their first allocation
+// and grow on demand by segments of GROWTH bytes, taken from the colors
+// assigned to the partition in a round-robin fashion. With
+// Traits<MMU>::partitioning, the LLC misses of threads created with a color
+// are charged to that color's partition at each dispatch (see Thread) and
+// repartition(), which is meant to be called periodically, grants free colors
+// to partitions that miss more than PARTITION_GROW times per color (moving
+// part of their most referenced pages to them) and takes borrowed colors back
+// from those that miss less than PARTITION_SHRINK times (moving their pages
+// back to the colors that remain). A color borrowed by a partition is also
+// taken back when its home partition gets its first allocation. Pages are
+// only moved on uniprocessors, since other CPUs could have them in their TLBs,
+// so on multicores a color taken back still backs the memory its former
+// partition got from it.
 class Page_Coloring
 {
     friend class System;
+    friend class Thread;
 
     friend void * ::operator new(size_t, const EPOS::Color &);
     friend void * ::operator new[](size_t, const EPOS::Color &);
@@ -59,19 +76,80 @@ class Page_Coloring
 private:
     static const unsigned int HEAP_SIZE = Traits<Application>::HEAP_SIZE;
     static const unsigned int COLORS = Traits<MMU>::COLORS;
+    static const unsigned int GROWTH = HEAP_SIZE / COLORS; // each color's share of the application's heap
+    static const bool partitioning = Traits<MMU>::colorful && Traits<MMU>::partitioning && Traits<PMU>::enabled;
+    static const bool recoloring = partitioning && !Traits<System>::multicore;
+    static const unsigned int GROW = Traits<MMU>::PARTITION_GROW;
+    static const unsigned int SHRINK = Traits<MMU>::PARTITION_SHRINK;
+    static const unsigned int CPUS = Traits<Build>::CPUS;
 
 public:
-    static void * alloc(unsigned int bytes, const EPOS::Color & allocator) {
-        assert((unsigned int)allocator <= COLORS);
-        return _heap[allocator]->alloc(bytes);
-    }
+    typedef unsigned int Colors; // a set of colors, one bit per color
+
+private:
+    struct Partition {
+        Colors colors;                  // colors backing the partition's heap (the home color is one of them once it's been used)
+        Color next;                     // color of the next segment added to the heap
+        volatile unsigned int misses;   // LLC misses of the threads whose home color is the partition's
+        unsigned int last;              // misses at the last repartition()
+        Simple_List<Segment> segments;  // segments backing the partition's heap
+    };
+
+public:
+    static void * alloc(unsigned int bytes, const EPOS::Color & allocator);
+
+    static Colors colors(const EPOS::Color & home) { return ((unsigned int)home < COLORS) ? _partition[home].colors : 0; }
+    static unsigned int misses(const EPOS::Color & home) { return ((unsigned int)home < COLORS) ? _partition[home].misses : 0; }
+
+    static void repartition();
 
 private:
     static void init();
 
+    static bool grow(const Color & home, unsigned int bytes);
+    static void claim(const Color & home);
+    static void give(const Color & home, const Color & color);
+    static void take(const Color & home, const Color & color);
+    static void spread(const Color & home, const Color & color);
+
+    static void charge(const Color & home);
+
+    static unsigned int count(Colors colors) {
+        unsigned int n = 0;
+        for( ; colors; colors &= colors - 1)
+            n++;
+        return n;
+    }
+
+    static Colors bit(const Color & color) { return 1U << color; }
+
+    // The color in "colors" that follows "after", wrapping around
+    static Color next(Colors colors, const Color & after) {
+        for(unsigned int i = 1; i <= COLORS; i++) {
+            Color c = Color((after + i) % COLORS);
+            if(colors & bit(c))
+                return c;
+        }
+        return after;
+    }
+
+    static void lock() {
+        _lock.acquire();
+        CPU::int_disable();
+    }
+
+    static void unlock() {
+        _lock.release();
+        CPU::int_enable();
+    }
+
 protected:
-    static Segment * _segment[COLORS];
     static Heap * _heap[COLORS];
+    static Partition _partition[COLORS];
+    static Colors _free;
+    static Spin _lock;
+    static unsigned int _llc_misses[CPUS]; // last reading of the LLC_MISS counter in each CPU
+    static bool _counting[CPUS];
 };
 
 __END_SYS
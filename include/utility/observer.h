@@ -11,6 +11,7 @@
 #define	__observer_h
 
 #include <utility/list.h>
+#include <utility/hash.h>
 
 __BEGIN_UTIL
 
@@ -181,7 +182,7 @@ class Data_Observed
 {
     friend class Data_Observer<T1, T2>;
 
-private:
+protected:
     typedef Data_Observer<T1, T2> Observer;
     typedef typename Simple_Ordered_List<Data_Observer<T1, T2>, T2>::Element Element;
 
@@ -240,10 +241,84 @@ public:
         return o;
     }
 
+protected:
+    static Element * link(Observer * o) { return &o->_link; }
+
 private:
     Simple_Ordered_List<Data_Observer<T1, T2>, T2> _observers;
 };
 
+// Data Observed whose observers are kept in a hash table indexed by their conditions, so notify()
+// costs O(1) instead of O(n) when there are many of them (e.g. UDP ports and TCP connections).
+// Observers still see it as a Data_Observed<T1, T2>.
+template<typename T1, typename T2, unsigned int SIZE>
+class Hashed_Data_Observed: public Data_Observed<T1, T2>
+{
+private:
+    typedef Data_Observed<T1, T2> Base;
+    typedef typename Base::Observer Observer;
+    typedef typename Base::Element Element;
+    typedef Hash<Observer, SIZE, T2, Element> Table;
+
+    using Base::link;
+
+public:
+    Hashed_Data_Observed() {
+        db<Observers>(TRC) << "Hashed_Data_Observed<T>() => " << this << endl;
+    }
+
+    ~Hashed_Data_Observed() {
+        db<Observers>(TRC) << "~Hashed_Data_Observed<T>(this=" << this << ")" << endl;
+    }
+
+    void attach(Observer * o, T2 c) {
+        db<Observers>(TRC) << "Hashed_Data_Observed<T>::attach(obs=" << o << ",cond=" << c << ")" << endl;
+
+        *link(o) = Element(o, c);
+        _observers.insert(link(o));
+    }
+
+    void detach(Observer * o, T2 c) {
+        db<Observers>(TRC) << "Hashed_Data_Observed<T>::detach(obs=" << o << ",cond=" << c << ")" << endl;
+
+        _observers.remove(link(o));
+    }
+
+    bool notify(T2 c, T1 * d) {
+        bool notified = false;
+
+        db<Observers>(TRC) << "Hashed_Data_Observed<T>::notify(this=" << this << ",cond=" << c << ")" << endl;
+
+        // Observers might re-attach themselves under other conditions while being updated (e.g. TCP listeners)
+        for(Element * e = _observers[c]->head(), * next; e; e = next) {
+            next = e->next();
+            if(e->rank() == c) {
+                db<Observers>(INF) << "Hashed_Data_Observed<T>::notify(this=" << this << ",obs=" << e->object() << ")" << endl;
+                e->object()->update(this, c, d);
+                notified = true;
+            }
+        }
+
+        return notified;
+    }
+
+    Observer * observer(T2 c, unsigned int index = 0) {
+        Observer * o = 0;
+        for(Element * e = _observers[c]->head(); e; e = e->next()) {
+            if(e->rank() == c) {
+                if(!index)
+                    o =  e->object();
+                else
+                    index--;
+            }
+        }
+        return o;
+    }
+
+private:
+    Table _observers;
+};
+
 template<typename T1, typename T2>
 class Data_Observer
 {
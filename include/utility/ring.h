@@ -0,0 +1,205 @@
+// EPOS Ring Buffer Utility Declarations
+
+// Rings are bounded FIFO queues of objects (copied in and out, typically
+// pointers) whose operations never block nor take locks: insert() and
+// remove() simply return false if the ring is full or empty, respectively.
+// Positions grow monotonically and are masked into the N slots, so N must
+// be a power of two. Positions updated by producers and by consumers live
+// in separate cache lines, so each side doesn't keep invalidating the
+// other's cache.
+// SPSC_Ring supports a single producer and a single consumer, each one
+// owning a position and caching the other's (Lamport's ring).
+// MPSC_Ring and MPMC_Ring tag each slot with a sequence number telling
+// whether it is ready to be written (sequence == position) or read
+// (sequence == position + 1). Competing producers (and consumers, for
+// MPMC_Ring) claim positions with CPU::cas (Vyukov's bounded queue).
+// Example (N = 4): insert(A);insert(B);insert(C);remove()
+//         +---+---+---+---+
+// object  |   | B | C |   |
+//         + - + - + - + - +
+// seq.    | 4 | 2 | 3 | 3 |     head = 1, tail = 3
+//         +---+---+---+---+
+
+#ifndef __ring_h
+#define __ring_h
+
+#include <cpu.h>
+
+__BEGIN_UTIL
+
+class Ring_Common
+{
+public:
+    static const unsigned int CACHE_LINE = 64;
+
+protected:
+    // IA32 doesn't reorder loads with loads nor stores with stores, so it suffices that the compiler doesn't either
+    static void barrier() { ASM("" : : : "memory"); }
+};
+
+
+// Single-Producer, Single-Consumer Ring
+template<typename T, unsigned int N>
+class SPSC_Ring: public Ring_Common
+{
+public:
+    typedef T Object_Type;
+
+    static const unsigned int SIZE = N;
+
+private:
+    static const unsigned int MASK = N - 1;
+
+public:
+    SPSC_Ring(): _tail(0), _head_cache(0), _head(0), _tail_cache(0) {}
+
+    bool empty() const { return (_head == _tail); }
+    bool full() const { return (_tail - _head == N); }
+    unsigned int size() const { return _tail - _head; }
+
+    bool insert(const T & o) {
+        unsigned int tail = _tail;
+        if(tail - _head_cache == N) {
+            _head_cache = _head;
+            if(tail - _head_cache == N)
+                return false;
+        }
+
+        _ring[tail & MASK] = o;
+        barrier();
+        _tail = tail + 1;
+
+        return true;
+    }
+
+    bool remove(T * o) {
+        unsigned int head = _head;
+        if(head == _tail_cache) {
+            _tail_cache = _tail;
+            if(head == _tail_cache)
+                return false;
+        }
+
+        barrier();
+        *o = _ring[head & MASK];
+        barrier();
+        _head = head + 1;
+
+        return true;
+    }
+
+private:
+    // Producer's cache line
+    volatile unsigned int _tail;
+    unsigned int _head_cache;
+    char _producer_padding[CACHE_LINE - 2 * sizeof(unsigned int)];
+
+    // Consumer's cache line
+    volatile unsigned int _head;
+    unsigned int _tail_cache;
+    char _consumer_padding[CACHE_LINE - 2 * sizeof(unsigned int)];
+
+    T _ring[N];
+};
+
+
+// Multi-Producer Ring, either with a single or with multiple consumers
+template<typename T, unsigned int N, bool multiconsumer>
+class Sequenced_Ring: public Ring_Common
+{
+public:
+    typedef T Object_Type;
+
+    static const unsigned int SIZE = N;
+
+private:
+    static const unsigned int MASK = N - 1;
+
+    struct Slot {
+        volatile unsigned int sequence;
+        T object;
+    };
+
+public:
+    Sequenced_Ring(): _tail(0), _head(0) {
+        for(unsigned int i = 0; i < N; i++)
+            _ring[i].sequence = i;
+    }
+
+    bool empty() const { return (_head == _tail); }
+    bool full() const { return (_tail - _head >= N); }
+    unsigned int size() const { return _tail - _head; }
+
+    bool insert(const T & o) {
+        unsigned int tail = _tail;
+        for(;;) {
+            Slot * s = &_ring[tail & MASK];
+            int delta = int(s->sequence - tail);
+            if(delta == 0) {
+                unsigned int old = CPU::cas(_tail, tail, tail + 1);
+                if(old == tail) {
+                    s->object = o;
+                    barrier();
+                    s->sequence = tail + 1;
+                    return true;
+                }
+                tail = old;
+            } else if(delta < 0) // the slot still holds an object from the previous lap
+                return false;
+            else // another producer got this position
+                tail = _tail;
+        }
+    }
+
+    bool remove(T * o) {
+        unsigned int head = _head;
+        for(;;) {
+            Slot * s = &_ring[head & MASK];
+            int delta = int(s->sequence - (head + 1));
+            if(delta == 0) {
+                if(multiconsumer) {
+                    unsigned int old = CPU::cas(_head, head, head + 1);
+                    if(old != head) {
+                        head = old;
+                        continue;
+                    }
+                } else
+                    _head = head + 1;
+
+                barrier();
+                *o = s->object;
+                barrier();
+                s->sequence = head + N;
+                return true;
+            } else if(delta < 0) // the slot hasn't been written (or the object published) yet
+                return false;
+            else // another consumer got this position
+                head = _head;
+        }
+    }
+
+private:
+    // Producers' cache line
+    volatile unsigned int _tail;
+    char _producer_padding[CACHE_LINE - sizeof(unsigned int)];
+
+    // Consumers' cache line
+    volatile unsigned int _head;
+    char _consumer_padding[CACHE_LINE - sizeof(unsigned int)];
+
+    Slot _ring[N];
+};
+
+
+// Multi-Producer, Single-Consumer Ring
+template<typename T, unsigned int N>
+class MPSC_Ring: public Sequenced_Ring<T, N, false> {};
+
+
+// Multi-Producer, Multi-Consumer Ring
+template<typename T, unsigned int N>
+class MPMC_Ring: public Sequenced_Ring<T, N, true> {};
+
+__END_UTIL
+
+#endif
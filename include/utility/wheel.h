@@ -0,0 +1,234 @@
+// EPOS Timing Wheel Utility Declarations
+
+// Timing Wheel is a hierarchical, hashed timer queue. Objects are inserted
+// tagged with a "rank" that, just like in a Relative Queue, specifies a
+// time-out in ticks relative to the moment of the insertion. Internally,
+// ranks are converted to absolute expiration ticks and elements are hashed
+// into one of the SLOTS lists of the level whose granularity matches their
+// time-out: level 0 has a slot per tick, level 1 a slot per SLOTS ticks, and
+// so on. Insertions and removals take O(1). Each call to tick() advances the
+// wheel, cascading the elements of a higher-level slot into lower levels
+// whenever the lower level wraps, and makes all elements expiring in that
+// tick available, at once, through expired(). advance() takes several
+// ticks at once, jumping over those in which nothing would expire nor
+// cascade, so its cost depends on the number of occupied slots it goes
+// through, not on the number of ticks.
+// Example (SLOTS = 4): insert(A,2);insert(B,6);insert(C,2) at tick 0
+//                +---+---+---+---+
+// level 0        |   |   |A,C|   |
+//                +---+---+---+---+
+// level 1        |   | B |   |   |   (cascaded into level 0 at tick 4)
+//                +---+---+---+---+
+// Time-outs longer than the wheel's span (SLOTS^LEVELS) are parked in the
+// highest level and re-hashed each time their slot cascades.
+
+#ifndef __wheel_h
+#define __wheel_h
+
+#include "list.h"
+
+__BEGIN_UTIL
+
+namespace List_Elements
+{
+    // Timing Wheel Element
+    template<typename T, typename R = Rank>
+    class Doubly_Linked_Timed
+    {
+    public:
+        typedef T Object_Type;
+        typedef R Rank_Type;
+        typedef Doubly_Linked_Timed Element;
+        typedef List<T, Element> Slot;
+
+    public:
+        Doubly_Linked_Timed(const T * o,  const R & r = 0): _object(o), _rank(r), _prev(0), _next(0), _slot(0) {}
+
+        T * object() const { return const_cast<T *>(_object); }
+
+        Element * prev() const { return _prev; }
+        Element * next() const { return _next; }
+        void prev(Element * e) { _prev = e; }
+        void next(Element * e) { _next = e; }
+
+        const R & rank() const { return _rank; }
+        void rank(const R & r) { _rank = r; }
+
+        Slot * slot() const { return _slot; }
+        void slot(Slot * s) { _slot = s; }
+
+    private:
+        const T * _object;
+        R _rank;
+        Element * _prev;
+        Element * _next;
+        Slot * _slot;
+    };
+}
+
+// Hierarchical Timing Wheel
+template<typename T,
+          typename R = List_Element_Rank,
+          unsigned int L = 4,
+          unsigned int B = 6,
+          typename El = List_Elements::Doubly_Linked_Timed<T, R> >
+class Timing_Wheel
+{
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+
+    static const unsigned int LEVELS = L;
+    static const unsigned int SLOTS = 1 << B;
+
+private:
+    typedef typename El::Slot Slot;
+
+    static const unsigned int MASK = SLOTS - 1;
+    static const unsigned int SPAN = (L * B < sizeof(unsigned int) * 8) ? (1U << (L * B)) - 1 : ~0U;
+
+public:
+    Timing_Wheel(): _now(0), _size(0) {}
+
+    bool empty() const { return (_size == 0); }
+    unsigned int size() const { return _size; }
+
+    // Current tick, as seen by the wheel (i.e. the number of calls to tick())
+    R now() const { return _now; }
+
+    void insert(Element * e) {
+        db<Lists>(TRC) << "Timing_Wheel::insert(e=" << e << ",r=" << e->rank() << ")" << endl;
+
+        // Like in Relative_Queue, a null time-out expires in the next tick
+        e->rank(_now + ((e->rank() > 0) ? e->rank() : 1));
+        hash(e);
+        _size++;
+    }
+
+    Element * remove(Element * e) {
+        db<Lists>(TRC) << "Timing_Wheel::remove(e=" << e << ")" << endl;
+
+        if(!e->slot())
+            return 0;
+
+        e->slot()->remove(e);
+        e->slot(0);
+        _size--;
+
+        return e;
+    }
+
+    // Advances the wheel by one tick, moving elements that expire in it to the expired list
+    void tick() {
+        _now++;
+
+        unsigned int now = _now;
+        for(unsigned int l = 1; (l < L) && !((now >> ((l - 1) * B)) & MASK); l++)
+            cascade(&_wheel[l][(now >> (l * B)) & MASK]);
+
+        Slot * slot = &_wheel[0][now & MASK];
+        while(!slot->empty()) {
+            Element * e = slot->remove_head();
+            e->slot(&_expired);
+            _expired.insert(e);
+        }
+    }
+
+    // Advances the wheel by n ticks, just like n calls to tick(). Looking for the next occupied slot only
+    // pays off when catching up with several ticks (i.e. tickless), so a single one is just a tick()
+    void advance(unsigned int n) {
+        while(n) {
+            unsigned int skip = ((n > 1) && _size) ? upcoming() : n;
+            if(skip > n)
+                skip = n;
+            _now = static_cast<unsigned int>(_now) + skip - 1;
+            tick();
+            n -= skip;
+        }
+    }
+
+    // Number of ticks until the next call to tick() that might expire (or cascade) elements,
+    // 1 if there are expired elements not yet removed, or 0 if the wheel is empty
+    R next() const {
+        if(!_size)
+            return 0;
+        if(!_expired.empty())
+            return 1;
+
+        return upcoming();
+    }
+
+    // Removes the next element whose time-out has expired (in the order they expired)
+    Element * expired() {
+        Element * e = _expired.remove_head();
+        if(e) {
+            e->slot(0);
+            _size--;
+        }
+        return e;
+    }
+
+private:
+    // Number of ticks until the next occupied slot of any level is reached (SPAN if none)
+    unsigned int upcoming() const {
+        unsigned int now = _now;
+        unsigned int next = SPAN;
+        for(unsigned int d = 1; d < SLOTS; d++)
+            if(!_wheel[0][(now + d) & MASK].empty()) {
+                next = d;
+                break;
+            }
+        for(unsigned int l = 1; l < L; l++) {
+            unsigned int period = 1 << (l * B);
+            unsigned int first = ((now >> (l * B)) + 1) << (l * B); // the next time this level cascades
+            for(unsigned int k = 0; k < SLOTS; k++) {
+                unsigned int t = first + k * period;
+                if(t - now >= next)
+                    break;
+                if(!_wheel[l][(t >> (l * B)) & MASK].empty()) {
+                    next = t - now;
+                    break;
+                }
+            }
+        }
+
+        return next;
+    }
+
+    void hash(Element * e) {
+        unsigned int expiration = e->rank();
+        unsigned int delta = expiration - static_cast<unsigned int>(_now);
+        Slot * slot;
+
+        if(delta == 0)
+            slot = &_expired;
+        else {
+            if(delta > SPAN) // park it at the highest level, it will be re-hashed when the slot cascades
+                expiration = static_cast<unsigned int>(_now) + SPAN;
+
+            unsigned int l = 0;
+            while((l < L - 1) && (delta >> ((l + 1) * B)))
+                l++;
+            slot = &_wheel[l][(expiration >> (l * B)) & MASK];
+        }
+
+        e->slot(slot);
+        slot->insert(e);
+    }
+
+    void cascade(Slot * slot) {
+        while(!slot->empty())
+            hash(slot->remove_head());
+    }
+
+private:
+    R _now;
+    unsigned int _size;
+    Slot _expired;
+    Slot _wheel[L][SLOTS];
+};
+
+__END_UTIL
+
+#endif
@@ -9,6 +9,7 @@ __BEGIN_SYS
 // Class attributes
 Alarm_Timer * Alarm::_timer;
 volatile Alarm::Tick Alarm::_elapsed;
+TSC::Time_Stamp Alarm::_epoch;
 Alarm::Queue Alarm::_request;
 
 
@@ -21,7 +22,10 @@ Alarm::Alarm(const Microsecond & time, Handler * handler, int times)
     db<Alarm>(TRC) << "Alarm(t=" << time << ",tk=" << _ticks << ",h=" << reinterpret_cast<void *>(handler) << ",x=" << times << ") => " << this << endl;
 
     if(_ticks) {
+        if(tickless)
+            advance(now()); // ticks are only accounted on interrupts, thus _elapsed might be behind
         _request.insert(&_link);
+        program();
         unlock();
     } else {
         unlock();
@@ -36,7 +40,8 @@ Alarm::~Alarm()
 
     db<Alarm>(TRC) << "~Alarm(this=" << this << ")" << endl;
 
-    _request.remove(this);
+    dequeue();
+    program();
 
     unlock();
 }
@@ -47,10 +52,14 @@ void Alarm::period(const Microsecond & p)
 
     db<Alarm>(TRC) << "Alarm::period(this=" << this << ",p=" << p << ")" << endl;
 
-    _request.remove(this);
+    dequeue();
     _time = p;
     _ticks = ticks(p);
+    _link.rank(_ticks);
+    if(tickless)
+        advance(now());
     _request.insert(&_link);
+    program();
 
     unlock();
 }
@@ -72,7 +81,7 @@ void Alarm::handler(const IC::Interrupt_Id & i)
 {
     lock();
 
-    _elapsed++;
+    advance(now());
 
     if(Traits<Alarm>::visible) {
         Display display;
@@ -83,28 +92,113 @@ void Alarm::handler(const IC::Interrupt_Id & i)
         display.position(lin, col);
     }
 
-    Alarm * alarm = 0;
-
-    if(!_request.empty()) {
-        // Replacing the following "if" by a "while" loop is tempting, but recovering the lock and dispatching the handler is
-        // troublesome if the Alarm gets destroyed in between, like is the case for the idle thread returning to shutdown the machine
-        if(_request.head()->promote() <= 0) { // rank can be negative whenever multiple handlers get created for the same time tick
-            Queue::Element * e = _request.remove();
-            alarm = e->object();
-            if(alarm->_times != INFINITE)
-                alarm->_times--;
-            if(alarm->_times) {
-                e->rank(alarm->_ticks);
-                _request.insert(e);
-            }
-        }
+    // Each expired alarm is taken from the queue with the lock held, so an Alarm destroyed by a previous handler
+    // (like is the case for the idle thread returning to shutdown the machine) is never dispatched
+    for(Alarm * alarm = expired(); alarm; alarm = expired()) {
+        unlock();
+
+        db<Alarm>(TRC) << "Alarm::handler(this=" << alarm << ",e=" << _elapsed << ",h=" << reinterpret_cast<void*>(alarm->handler) << ")" << endl;
+        (*alarm->_handler)();
+
+        lock();
+        if(tickless)
+            advance(now());
     }
 
+    program();
+
     unlock();
+}
 
-    if(alarm) {
-        db<Alarm>(TRC) << "Alarm::handler(this=" << alarm << ",e=" << _elapsed << ",h=" << reinterpret_cast<void*>(alarm->handler) << ")" << endl;
-        (*alarm->_handler)();
+
+// Ticks skipped while tickless are accounted at once, so a long idle period doesn't turn into a long interrupts-off stall
+void Alarm::advance(const Tick & now)
+{
+    if(now != _elapsed) {
+        advance(&_request, now - _elapsed, Wheel<wheel>());
+        _elapsed = now;
+    }
+}
+
+
+template<typename Q>
+void Alarm::dequeue(Q * q, const Wheel<false> &)
+{
+    q->remove(this);
+}
+
+
+template<typename Q>
+void Alarm::dequeue(Q * q, const Wheel<true> &)
+{
+    q->remove(&_link);
+}
+
+
+template<typename Q>
+void Alarm::advance(Q * q, const Tick & ticks, const Wheel<false> &)
+{
+    if(!q->empty())
+        q->head()->promote(ticks); // rank can be negative whenever multiple handlers get created for the same time tick
+}
+
+
+template<typename Q>
+void Alarm::advance(Q * q, const Tick & ticks, const Wheel<true> &)
+{
+    q->advance(ticks);
+}
+
+
+template<typename Q>
+Alarm * Alarm::expired(Q * q, const Wheel<false> &)
+{
+    if(q->empty() || (q->head()->rank() > 0))
+        return 0;
+
+    typename Q::Element * e = q->remove();
+    rearm(e);
+
+    return e->object();
+}
+
+
+template<typename Q>
+Alarm * Alarm::expired(Q * q, const Wheel<true> &)
+{
+    typename Q::Element * e = q->expired();
+    if(e)
+        rearm(e);
+
+    return e ? e->object() : 0;
+}
+
+
+template<typename Q>
+Alarm::Tick Alarm::next(Q * q, const Wheel<false> &)
+{
+    if(q->empty())
+        return 0;
+
+    return (q->head()->rank() > 0) ? q->head()->rank() : 1;
+}
+
+
+template<typename Q>
+Alarm::Tick Alarm::next(Q * q, const Wheel<true> &)
+{
+    return q->next();
+}
+
+
+void Alarm::rearm(Queue::Element * e)
+{
+    Alarm * alarm = e->object();
+    if(alarm->_times != INFINITE)
+        alarm->_times--;
+    if(alarm->_times) {
+        e->rank(alarm->_ticks);
+        _request.insert(e);
     }
 }
 
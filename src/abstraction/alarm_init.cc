@@ -9,6 +9,8 @@ void Alarm::init()
 {
     db<Init, Alarm>(TRC) << "Alarm::init()" << endl;
 
+    if(tickless)
+        _epoch = TSC::time_stamp();
     _timer = new (SYSTEM) Alarm_Timer(handler);
 }
 
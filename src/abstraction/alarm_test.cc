@@ -6,9 +6,13 @@
 using namespace EPOS;
 
 const int iterations = 10;
+const int burst = 32;
+
+volatile int fired;
 
 void func_a(void);
 void func_b(void);
+void func_c(void);
 
 OStream cout;
 
@@ -30,6 +34,20 @@ int main()
     // of the idle thread!
     Alarm::delay(2000000 * (iterations + 2));
 
+    cout << "Now I'll create " << burst << " alarms that expire in the same tick ..." << endl;
+
+    Function_Handler handler_c(&func_c);
+    Alarm * alarms[burst];
+    for(int i = 0; i < burst; i++)
+        alarms[i] = new Alarm(100000, &handler_c);
+
+    // They must all fire in the expiration tick
+    Alarm::delay(100000 + 1000000 / Alarm::frequency());
+    cout << fired << " of them fired after one tick." << endl;
+
+    for(int i = 0; i < burst; i++)
+        delete alarms[i];
+
     cout << "I'm done, bye!" << endl;
 
     return 0;
@@ -48,3 +66,8 @@ void func_b(void)
         cout << "b";
     cout << endl;
 }
+
+void func_c(void)
+{
+    CPU::finc(fired);
+}
@@ -0,0 +1,101 @@
+// EPOS IP Checksum Test Program
+
+#include <utility/ostream.h>
+#include <utility/string.h>
+#include <utility/random.h>
+#include <chronometer.h>
+#include <ip.h>
+
+using namespace EPOS;
+
+const unsigned int SIZE = IP::MFS; // a full Ethernet fragment
+const int ITERATIONS = 10000;
+
+unsigned char source[SIZE + 4];
+unsigned char destination[SIZE + 4];
+
+OStream cout;
+
+// The byte-pair sum used before the word-wise engine, as reference
+unsigned short old_sum(const void * data, unsigned int size)
+{
+    const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
+    unsigned long sum = 0;
+
+    for(unsigned int i = 0; i + 1 < size; i += 2)
+        sum += (ptr[i] << 8) | ptr[i+1];
+    if(size & 1)
+        sum += ptr[size - 1] << 8;
+
+    while(sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return sum;
+}
+
+void report(const char * what, const Chronometer::Microsecond & time)
+{
+    cout << what << "\t" << time << " us => " << (long long)SIZE * ITERATIONS / (time ? time : 1) << " MB/s" << endl;
+}
+
+int main()
+{
+    cout << "IP Checksum Test" << endl;
+
+    Chronometer chrono;
+    volatile unsigned short sum = 0;
+
+    for(unsigned int i = 0; i < sizeof(source); i++)
+        source[i] = Random::random();
+
+    // Misaligned sizes and addresses must yield the same sums as the reference
+    bool ok = true;
+    for(unsigned int offset = 0; offset < 4; offset++)
+        for(unsigned int size = SIZE - 3; size <= SIZE; size++) {
+            unsigned short expected = old_sum(&source[offset], size);
+            if((IP::sum(&source[offset], size) != expected) || (IP::copy_and_sum(&destination[3 - offset], &source[offset], size) != expected)
+                || memcmp(&destination[3 - offset], &source[offset], size)) {
+                cout << "Wrong sum for offset=" << offset << ",size=" << size << "!" << endl;
+                ok = false;
+            }
+        }
+    if(ok)
+        cout << "Sums match the reference" << endl;
+
+    cout << "Summing " << SIZE << " bytes " << ITERATIONS << " times:" << endl;
+
+    chrono.start();
+    for(int i = 0; i < ITERATIONS; i++)
+        sum = old_sum(source, SIZE);
+    chrono.stop();
+    report("sum (byte pairs):", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(int i = 0; i < ITERATIONS; i++)
+        sum = IP::sum(source, SIZE);
+    chrono.stop();
+    report("sum (words):\t", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(int i = 0; i < ITERATIONS; i++) {
+        memcpy(destination, source, SIZE);
+        sum = old_sum(destination, SIZE);
+    }
+    chrono.stop();
+    report("memcpy + sum:\t", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(int i = 0; i < ITERATIONS; i++)
+        sum = IP::copy_and_sum(destination, source, SIZE);
+    chrono.stop();
+    report("copy_and_sum:\t", chrono.read());
+
+    cout << "Last sum: " << hex << sum << endl;
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
@@ -16,6 +16,11 @@ unsigned short IP::Header::_next_id = 0;
 IP * IP::_networks[];
 IP::Router IP::_router;
 IP::Reassembling IP::_reassembling;
+IP::Fragmented IP::_fragmented[Traits<IP>::FRAGMENTED];
+Bitmap<Traits<IP>::FRAGMENTED> IP::_free_fragmented;
+Function_Handler IP::_sweeper(&IP::sweep);
+Alarm * IP::_sweep;
+Spin IP::_lock;
 IP::Observed IP::_observed;
 
 // Methods
@@ -51,16 +56,29 @@ IP::Buffer * IP::alloc(const Address & to, const Protocol & prot, unsigned int o
 {
     db<IP>(TRC) << "IP::alloc(to=" << to << ",prot=" << prot << ",on=" << once<< ",pl=" << payload << ")" << endl;
 
-    Route * through = _router.search(to);
-    IP * ip = through->ip();
-    NIC * nic = through->nic();
+    MAC_Address mac;
+    Route * through = _router.cached(to, &mac);
+    if(!through) {
+        unsigned int version = _router.version();
+        through = _router.search(to);
+        if(!through) {
+            db<IP>(WRN) << "IP::alloc: no route to destination host (" << to << ")!" << endl;
+            return 0;
+        }
 
-    MAC_Address mac = through->arp()->resolve((through->gateway() == through->ip()->address()) ? to : through->gateway());
-    if(!mac) {
-         db<IP>(WRN) << "IP::alloc: destination host (" << to << ") unreachable!" << endl;
-         return 0;
+        unsigned int arp_version = through->arp()->version();
+        mac = through->arp()->resolve((through->gateway() == through->ip()->address()) ? to : through->gateway());
+        if(!mac) {
+             db<IP>(WRN) << "IP::alloc: destination host (" << to << ") unreachable!" << endl;
+             return 0;
+        }
+
+        _router.cache(to, through, mac, version, arp_version);
     }
 
+    IP * ip = through->ip();
+    NIC * nic = through->nic();
+
     Buffer * pool = nic->alloc(mac, NIC::IP, once, sizeof(IP::Header), payload);
 
     Header header(ip->address(), to, prot, 0); // length will be defined latter for each fragment
@@ -117,24 +135,9 @@ void IP::update(NIC::Observed * obs, NIC::Protocol prot, Buffer * buf)
     buf->size(packet->length());
 
     if((packet->flags() & Header::MF) || (packet->offset() != 0)) { // Fragmented
-        Key key = ((packet->from() & ~_netmask) << 16) | packet->id();
-        Reassembling::Element * el = _reassembling.search_key(key);
-
-        Fragmented * frag;
-        if(el)
-            frag = el->object();
-        else {
-            frag = new (SYSTEM) Fragmented(key); // the Alarm created within Fragmented will re-enable interrupts
-            _reassembling.insert(frag->link());
-        }
-        frag->insert(buf);
-
-        if(frag->reassembled()) {
+        Buffer * pool = reassemble(buf);
+        if(pool) {
             db<IP>(INF) << "IP::update: notifying reassembled datagram" << endl;
-            frag->reorder();
-            Buffer * pool = frag->pool();
-            _reassembling.remove(frag->link());
-            delete frag;
             if(!notify(packet->protocol(), pool))
                 pool->nic()->free(pool);
         }
@@ -145,24 +148,65 @@ void IP::update(NIC::Observed * obs, NIC::Protocol prot, Buffer * buf)
     }
 }
 
-void IP::Fragmented::reorder() {
-    db<IP>(TRC) << "IP::Fragmented::reorder(this=" << this << ")" << endl;
+// Returns the whole datagram once "buf" completes it, or 0 otherwise
+IP::Buffer * IP::reassemble(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+    Key key = ((packet->from() & ~_netmask) << 16) | packet->id();
+    Buffer * pool = 0;
+    Buffer * drop = 0;
+
+    lock();
+
+    Reassembling::Element * el = _reassembling.search_key(key);
+    Fragmented * frag = el ? el->object() : 0;
+    if(!frag) {
+        int i = _free_fragmented.first();
+        if(i >= 0) {
+            _free_fragmented.reset(i);
+            frag = &_fragmented[i];
+            frag->reset(key);
+            _reassembling.insert(frag->link());
+        }
+    }
+
+    if(!frag) {
+        db<IP>(WRN) << "IP::reassemble: too many fragmented datagrams, dropping fragment!" << endl;
+        drop = buf;
+    } else if(!frag->insert(buf))
+        drop = buf; // duplicate
+    else if(frag->reassembled()) {
+        pool = frag->pool();
+        _reassembling.remove(frag->link());
+        _free_fragmented.set(frag - _fragmented);
+    }
+
+    unlock();
+
+    if(drop)
+        _nic.free(drop);
 
-    if(_list.size() > 1) {
-        Buffer::List tmp;
-        unsigned int i = 0;
-        while(!_list.empty()) {
-            Buffer * buf = _list.remove()->object();
+    return pool;
+}
 
-            if((buf->frame()->data<Packet>()->offset() / MFS) == i) {
-                tmp.insert(buf->link());
-                i++;
-            } else
-                _list.insert(buf->link());
-        };
+// Called every TIMEOUT / SWEEPS to drop the datagrams that could not be reassembled in time
+void IP::sweep()
+{
+    for(unsigned int i = 0; i < Traits<IP>::FRAGMENTED; i++) {
+        Buffer * pool = 0;
+
+        lock();
+        Fragmented * frag = &_fragmented[i];
+        if(!_free_fragmented[i] && frag->age()) {
+            db<IP>(INF) << "IP::sweep: datagram " << hex << frag->link()->key() << dec << " timed out!" << endl;
+            pool = frag->pool();
+            _reassembling.remove(frag->link());
+            _free_fragmented.set(i);
+        }
+        unlock();
 
-        while(!tmp.empty())
-            _list.insert(tmp.remove()->object()->link());
+        if(pool)
+            pool->nic()->free(pool);
     }
 }
 
@@ -170,19 +214,94 @@ unsigned short IP::checksum(const void * data, unsigned int size)
 {
     db<IP>(TRC) << "IP::checksum(d=" << data << ",s=" << size << ")" << endl;
 
+    return ~sum(data, size);
+}
+
+// Sums are accumulated in native byte order, 32 bits at a time with carries deferred to 64 bits (see CPU::sum32()),
+// and converted to network byte order only after folding, which RFC 1071 shows to be equivalent
+unsigned short IP::sum(const void * data, unsigned int size, unsigned short partial)
+{
     const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
-    unsigned long sum = 0;
+    unsigned long long sum = 0;
+
+    if(!Traits<CPU>::unaligned_memory_access) {
+        if(reinterpret_cast<CPU::Reg32>(ptr) & 1) { // odd addresses can only be handled byte by byte
+            unsigned long tmp = partial;
+            for(; size > 1; size -= 2, ptr += 2)
+                tmp += (ptr[0] << 8) | ptr[1];
+            if(size)
+                tmp += ptr[0] << 8;
+            while(tmp >> 16)
+                tmp = (tmp & 0xffff) + (tmp >> 16);
+            return tmp;
+        }
+        if((reinterpret_cast<CPU::Reg32>(ptr) & 2) && (size >= 2)) {
+            sum += *reinterpret_cast<const unsigned short *>(ptr);
+            ptr += 2;
+            size -= 2;
+        }
+    }
+
+    sum += CPU::sum32(ptr, size & ~3U);
+    ptr += size & ~3U;
+
+    if(size & 2) {
+        sum += *reinterpret_cast<const unsigned short *>(ptr);
+        ptr += 2;
+    }
+    if(size & 1) { // the last byte is padded with a zero
+        unsigned short last = 0;
+        *reinterpret_cast<unsigned char *>(&last) = *ptr;
+        sum += last;
+    }
 
-    for(unsigned int i = 0; i < size; i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
+    while(sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    unsigned long result = CPU::ntohs(sum) + partial;
+    return (result & 0xffff) + (result >> 16);
+}
+
+unsigned short IP::copy_and_sum(void * to, const void * from, unsigned int size, unsigned short partial)
+{
+    unsigned char * dst = reinterpret_cast<unsigned char *>(to);
+    const unsigned char * src = reinterpret_cast<const unsigned char *>(from);
+    unsigned long long sum = 0;
+
+    if(!Traits<CPU>::unaligned_memory_access) {
+        if(((reinterpret_cast<CPU::Reg32>(dst) ^ reinterpret_cast<CPU::Reg32>(src)) & 3) || (reinterpret_cast<CPU::Reg32>(src) & 1)) {
+            // Words cannot be moved if source and destination are misaligned with respect to each other
+            memcpy(to, from, size);
+            return IP::sum(to, size, partial);
+        }
+        if((reinterpret_cast<CPU::Reg32>(src) & 2) && (size >= 2)) {
+            sum += (*reinterpret_cast<unsigned short *>(dst) = *reinterpret_cast<const unsigned short *>(src));
+            dst += 2;
+            src += 2;
+            size -= 2;
+        }
+    }
 
-    if(size & 1)
-        sum += ptr[size - 1];
+    sum += CPU::copy_and_sum32(dst, src, size & ~3U);
+    dst += size & ~3U;
+    src += size & ~3U;
+
+    if(size & 2) {
+        sum += (*reinterpret_cast<unsigned short *>(dst) = *reinterpret_cast<const unsigned short *>(src));
+        dst += 2;
+        src += 2;
+    }
+    if(size & 1) {
+        unsigned short last = 0;
+        *reinterpret_cast<unsigned char *>(&last) = *dst = *src;
+        sum += last;
+    }
 
     while(sum >> 16)
         sum = (sum & 0xffff) + (sum >> 16);
 
-    return ~sum;
+    unsigned long result = CPU::ntohs(sum) + partial;
+    return (result & 0xffff) + (result >> 16);
 }
 
 __END_SYS
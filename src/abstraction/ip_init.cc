@@ -27,7 +27,7 @@ IP::IP(unsigned int nic)
     _router.insert(&_nic, this, &_arp, _address & _netmask, _address, _netmask);
 
     if(_gateway) {
-        _router.insert(&_nic, this, &_arp, Address::NULL, _gateway, Address::NULL); // Default route must be the last one in table
+        _router.insert(&_nic, this, &_arp, Address::NULL, _gateway, Address::NULL);
         _arp.resolve(_gateway);
     }
 }
@@ -36,6 +36,12 @@ void IP::init(unsigned int unit)
 {
     db<Init, IP>(TRC) << "IP::init(u=" << unit << ")" << endl;
 
+    if(!_sweep) { // reassembly is shared by all units
+        for(unsigned int i = 0; i < Traits<IP>::FRAGMENTED; i++)
+            _free_fragmented.set(i);
+        _sweep = new (SYSTEM) Alarm(TIMEOUT / SWEEPS, &_sweeper, Alarm::INFINITE);
+    }
+
     _networks[unit] = new (SYSTEM) IP(unit);
 }
 
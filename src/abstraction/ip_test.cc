@@ -163,6 +163,70 @@ int udp_test()
     return stat.tx_bytes + stat.rx_bytes;
 }
 
+int udp_zero_copy_test()
+{
+    cout << "UDP Zero-copy Test" << endl;
+
+    Link<UDP> * com;
+
+    IP * ip = IP::get_by_nic(0);
+
+    if(ip->address()[3] % 2) { // sender
+        cout << "Sender:" << endl;
+
+        IP::Address peer_ip = ip->address();
+        peer_ip[3]--;
+
+        com = new Link<UDP>(8000, Link<UDP>::Address(peer_ip, UDP::Port(8000)));
+
+        for(int i = 0; i < ITERATIONS; i++) {
+            // The datagram is written straight into the NIC buffers, one IP fragment at a time
+            UDP::Buffer * pool = com->alloc(PDU);
+            if(!pool) {
+                cout << "  Could not allocate buffers for the datagram!" << endl;
+                continue;
+            }
+            for(UDP::Buffer::Element * el = pool->link(); el; el = el->next()) {
+                char * data = reinterpret_cast<char *>(UDP::payload(el->object()));
+                for(unsigned int j = 0; j < UDP::payload_size(el->object()); j++)
+                    data[j] = '0' + i;
+            }
+
+            int sent = com->send(pool); // implicitly releases the pool
+            cout << "  Sent " << sent << " bytes of '" << char('0' + i) << "'" << endl;
+        }
+    } else { // receiver
+        cout << "Receiver:" << endl;
+
+        IP::Address peer_ip = ip->address();
+        peer_ip[3]++;
+
+        com = new Link<UDP>(8000, Link<UDP>::Address(peer_ip, UDP::Port(8000)));
+
+        for(int i = 0; i < ITERATIONS; i++) {
+            // The datagram is read in place and the buffers are given back to the NIC afterwards
+            UDP::Buffer * pool = com->receive();
+            unsigned int received = 0;
+            unsigned int wrong = 0;
+            for(UDP::Buffer::Element * el = pool ? pool->link() : 0; el; el = el->next()) {
+                const char * data = reinterpret_cast<const char *>(UDP::payload(el->object()));
+                for(unsigned int j = 0; j < UDP::payload_size(el->object()); j++)
+                    if(data[j] != '0' + i)
+                        wrong++;
+                received += UDP::payload_size(el->object());
+            }
+            if(pool)
+                com->release(pool);
+
+            cout << "  Received " << received << " bytes, " << wrong << " of them wrong" << endl;
+        }
+    }
+
+    delete com;
+
+    return 0;
+}
+
 int tcp_test()
 {
     cout << "TCP Test" << endl;
@@ -262,6 +326,8 @@ int main()
     Alarm::delay(2000000);
     udp_test();
     Alarm::delay(2000000);
+    udp_zero_copy_test();
+    Alarm::delay(2000000);
     tcp_test();
 
     return 0;
@@ -4,9 +4,9 @@
 
 __BEGIN_SYS
 
-Mutex::Mutex(): _locked(false)
+Mutex::Mutex(const Protocol & p, int ceiling): _state(FREE), _protocol(p), _ceiling(ceiling), _owner(0), _natural(0), _next(0)
 {
-    db<Synchronizer>(TRC) << "Mutex() => " << this << endl;
+    db<Synchronizer>(TRC) << "Mutex(protocol=" << p << ",ceiling=" << ceiling << ") => " << this << endl;
 }
 
 
@@ -20,11 +20,55 @@ void Mutex::lock()
 {
     db<Synchronizer>(TRC) << "Mutex::lock(this=" << this << ")" << endl;
 
+    // Protocols change priorities, so they always go through the scheduler lock
+    if(smp && (_protocol == NONE)) {
+        if(cas(_state, FREE, LOCKED) == FREE) {
+            _owner = Thread::running();
+            return;
+        }
+
+        if(spinning) {
+            // Spinning only pays off while the owner is running (on another CPU) and there are no sleepers to hand the mutex over to
+            unsigned int budget = spin_budget();
+            unsigned int i = 0;
+            for(Thread * o = _owner; (i < budget) && (_state == LOCKED) && (!o || (o->_state == Thread::RUNNING)); i++, o = _owner)
+                CPU::pause();
+
+            bool succeeded = (_state == FREE) && (cas(_state, FREE, LOCKED) == FREE);
+            spun(i, succeeded);
+            if(succeeded) {
+                _owner = Thread::running();
+                return;
+            }
+        }
+    }
+
     begin_atomic();
-    if(tsl(_locked))
-        sleep(); // implicit end_atomic()
-    else
-        end_atomic();
+    for(int s = _state; ; s = _state) {
+        if((s == FREE) && (cas(_state, FREE, LOCKED) == FREE)) {
+            if(_protocol != NONE)
+                acquire(Thread::running());
+            else
+                _owner = Thread::running();
+            end_atomic();
+            return;
+        }
+
+        // An unlock() on the fast path might release the mutex meanwhile, hence the CAS
+        if((s == CONTENDED) || (cas(_state, LOCKED, CONTENDED) == LOCKED))
+            break;
+    }
+
+    if(_protocol != NONE) {
+        // Lend our priority to the owner and, if it is itself blocked, up the chain of owners
+        Thread * running = Thread::running();
+        running->_blocker = this;
+        int p = running->priority();
+        for(Mutex * m = this; m && (m->_protocol != NONE) && (p < m->_owner->priority()); m = m->_owner->_blocker)
+            m->_owner->inherit(p);
+    }
+
+    sleep(); // implicit end_atomic(), ownership is handed over by unlock()
 }
 
 
@@ -32,12 +76,74 @@ void Mutex::unlock()
 {
     db<Synchronizer>(TRC) << "Mutex::unlock(this=" << this << ")" << endl;
 
+    // Without sleepers (i.e. not CONTENDED), there is no one to hand the mutex over to
+    if(smp && (_protocol == NONE) && (cas(_state, LOCKED, FREE) == LOCKED))
+        return;
+
     begin_atomic();
+
+    bool demoted = false;
+    if((_protocol != NONE) && _owner) {
+        int p = _owner->priority();
+        release();
+        demoted = (Thread::running()->priority() > p);
+    }
+
     if(_queue.empty()) {
-        _locked = false;
-        end_atomic();
-    } else
+        _state = FREE;
+        _owner = 0;
+        if(demoted && Thread::preemptive)
+            Thread::reschedule(); // a thread we were holding back might now preempt us
+        else
+            end_atomic();
+    } else {
+        // The highest-priority waiter, which wakeup() is about to resume, becomes the owner
+        Thread * next = _queue.head()->object();
+        _state = (_queue.size() > 1) ? CONTENDED : LOCKED;
+        if(_protocol != NONE)
+            acquire(next);
+        else
+            _owner = next;
         wakeup(); // implicit end_atomic()
+    }
+}
+
+
+void Mutex::acquire(Thread * owner)
+{
+    _owner = owner;
+    _natural = owner->_mutexes ? owner->_mutexes->_natural : int(owner->priority());
+    _next = owner->_mutexes;
+    owner->_mutexes = this;
+    owner->_blocker = 0;
+
+    if((_protocol == CEILING) && (_ceiling < owner->priority()))
+        owner->inherit(_ceiling);
+}
+
+
+void Mutex::release()
+{
+    Thread * owner = _owner;
+
+    // Mutexes are not necessarily released in the reverse order they were acquired
+    for(Mutex ** m = &owner->_mutexes; *m; m = &(*m)->_next)
+        if(*m == this) {
+            *m = _next;
+            break;
+        }
+    _owner = 0;
+    _next = 0;
+
+    // The owner's priority is recomputed from the ceilings and waiters of the mutexes it still holds
+    int p = _natural;
+    for(Mutex * m = owner->_mutexes; m; m = m->_next) {
+        if((m->_protocol == CEILING) && (m->_ceiling < p))
+            p = m->_ceiling;
+        if(!m->_queue.empty() && (m->_queue.head()->object()->priority() < p))
+            p = m->_queue.head()->object()->priority();
+    }
+    owner->inherit(p);
 }
 
 __END_SYS
@@ -0,0 +1,127 @@
+// EPOS Mutex Priority Inversion Benchmark
+
+#include <utility/ostream.h>
+#include <periodic_thread.h>
+#include <mutex.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const long duration = 3000; // ms
+const long period_h = 20;   // ms
+const long period_m = 50;   // ms
+const long period_l = 100;  // ms
+const long work_h = 1;      // ms in the critical section
+const long work_m = 15;     // ms without touching the mutex
+const long work_l = 5;      // ms in the critical section
+
+Mutex * mutex;
+unsigned long long loops_per_ms;
+
+Chronometer::Microsecond worst;
+Chronometer::Microsecond total;
+int locks;
+
+OStream cout;
+
+void work(long ms);
+void run(const char * name, const Mutex::Protocol & protocol);
+int high();
+int medium();
+int low();
+
+int main()
+{
+    cout << "Mutex Priority Inversion Benchmark" << endl;
+    cout << "\nThree RM periodic threads run for " << duration << " ms:" << endl;
+    cout << "  H (" << period_h << " ms) holds the mutex for " << work_h << " ms;" << endl;
+    cout << "  M (" << period_m << " ms) computes for " << work_m << " ms without the mutex;" << endl;
+    cout << "  L (" << period_l << " ms) holds the mutex for " << work_l << " ms." << endl;
+    cout << "Without a protocol, M can preempt L while H waits for it, so H may block for up to "
+         << work_l + work_m << " ms. Otherwise, H should block for at most " << work_l << " ms.\n" << endl;
+
+    // Time is measured in loop iterations, so preempted computations take longer in real time
+    const unsigned long long calibration = 1000000;
+    Chronometer chrono;
+    chrono.start();
+    for(volatile unsigned long long i = 0; i < calibration; i++);
+    chrono.stop();
+    loops_per_ms = calibration * 1000 / (chrono.read() ? chrono.read() : 1);
+
+    run("none", Mutex::NONE);
+    run("inheritance", Mutex::INHERITANCE);
+    run("ceiling", Mutex::CEILING);
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+void run(const char * name, const Mutex::Protocol & protocol)
+{
+    mutex = new Mutex(protocol, period_h * 1000); // under RM, the ceiling is the priority (i.e. period) of H
+    worst = 0;
+    total = 0;
+    locks = 0;
+
+    Periodic_Thread * h = new Periodic_Thread(RTConf(period_h * 1000, duration / period_h), &high);
+    Periodic_Thread * m = new Periodic_Thread(RTConf(period_m * 1000, duration / period_m), &medium);
+    Periodic_Thread * l = new Periodic_Thread(RTConf(period_l * 1000, duration / period_l), &low);
+
+    h->join();
+    m->join();
+    l->join();
+
+    cout << name << ":\tworst blocking = " << worst << " us, average = " << total / (locks ? locks : 1) << " us (" << locks << " locks)" << endl;
+
+    delete h;
+    delete m;
+    delete l;
+    delete mutex;
+}
+
+void work(long ms)
+{
+    for(volatile unsigned long long i = 0; i < ms * loops_per_ms; i++);
+}
+
+int high()
+{
+    do {
+        Chronometer chrono;
+        chrono.start();
+        mutex->lock();
+        chrono.stop();
+
+        Chronometer::Microsecond blocking = chrono.read();
+        if(blocking > worst)
+            worst = blocking;
+        total += blocking;
+        locks++;
+
+        work(work_h);
+        mutex->unlock();
+    } while(Periodic_Thread::wait_next());
+
+    return 'H';
+}
+
+int medium()
+{
+    do
+        work(work_m);
+    while(Periodic_Thread::wait_next());
+
+    return 'M';
+}
+
+int low()
+{
+    do {
+        mutex->lock();
+        work(work_l);
+        mutex->unlock();
+    } while(Periodic_Thread::wait_next());
+
+    return 'L';
+}
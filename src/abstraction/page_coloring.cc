@@ -1,11 +1,240 @@
 // EPOS Page Coloring Implementation
 
 #include <utility/malloc.h>
+#include <machine.h>
+#include <address_space.h>
+#include <pmu.h>
+
+extern "C" { void _panic(); }
 
 __BEGIN_SYS
 
 // Class attributes
-Segment * Page_Coloring::_segment[COLORS];
 Heap * Page_Coloring::_heap[COLORS];
+Page_Coloring::Partition Page_Coloring::_partition[COLORS];
+Page_Coloring::Colors Page_Coloring::_free;
+Spin Page_Coloring::_lock;
+unsigned int Page_Coloring::_llc_misses[CPUS];
+bool Page_Coloring::_counting[CPUS];
+
+// The last PMU channel is always programmable
+static const PMU::Channel LLC_MISS_CHANNEL = PMU::CHANNELS - 1;
+
+// Class methods
+void * Page_Coloring::alloc(unsigned int bytes, const Color & allocator)
+{
+    assert((unsigned int)allocator < COLORS);
+
+    lock();
+    void * tmp = _heap[allocator] ? _heap[allocator]->allocate(bytes) : 0;
+    while(!tmp && grow(allocator, bytes))
+        tmp = _heap[allocator]->allocate(bytes);
+    unlock();
+
+    if(!tmp) {
+        db<Heaps>(ERR) << "Page_Coloring::alloc(bytes=" << bytes << ",color=" << allocator << "): out of memory!" << endl;
+        _panic();
+    }
+
+    return tmp;
+}
+
+
+void Page_Coloring::repartition()
+{
+    if(!partitioning)
+        return;
+
+    lock();
+
+    // Misses per color since the last repartition
+    unsigned int rate[COLORS];
+    for(unsigned int h = 1; h < COLORS; h++) {
+        Partition * p = &_partition[h];
+        unsigned int misses = p->misses;
+        rate[h] = p->colors ? (misses - p->last) / count(p->colors) : 0;
+        p->last = misses;
+    }
+
+    db<Heaps>(TRC) << "Page_Coloring::repartition(free=" << hex << _free << ")" << endl;
+
+    // Take a borrowed color back from each partition that barely misses
+    for(unsigned int h = 1; h < COLORS; h++)
+        if((_partition[h].colors & ~bit(Color(h))) && (rate[h] < SHRINK))
+            for(unsigned int c = COLORS - 1; c > 0; c--)
+                if((c != h) && (_partition[h].colors & bit(Color(c)))) {
+                    take(Color(h), Color(c));
+                    break;
+                }
+
+    // Grant free colors, one per partition, to those that miss the most
+    while(_free) {
+        unsigned int hottest = 0;
+        for(unsigned int h = 1; h < COLORS; h++)
+            if(_partition[h].colors && (rate[h] >= GROW) && (!hottest || (rate[h] > rate[hottest])))
+                hottest = h;
+        if(!hottest)
+            break;
+
+        give(Color(hottest), next(_free, WHITE));
+        rate[hottest] = 0;
+    }
+
+    // Restart page reference sampling
+    if(recoloring) {
+        for(unsigned int h = 1; h < COLORS; h++)
+            for(Simple_List<Segment>::Iterator s = _partition[h].segments.begin(); s != _partition[h].segments.end(); s++)
+                for(unsigned int i = 0; i < s->object()->size() / sizeof(MMU::Page); i++)
+                    s->object()->referenced(i, true);
+        MMU::flush_tlb();
+    }
+
+    unlock();
+}
+
+
+bool Page_Coloring::grow(const Color & home, unsigned int bytes)
+{
+    claim(home);
+
+    Partition * p = &_partition[home];
+    p->next = next(p->colors, p->next);
+
+    unsigned int size = (bytes + sizeof(MMU::Page) > GROWTH) ? bytes + sizeof(MMU::Page) : GROWTH;
+    Segment * segment = new (SYSTEM) Segment(size, p->next, Segment::Flags::APP);
+    CPU::Log_Addr addr = Address_Space(MMU::current()).attach(segment);
+    if(!addr) {
+        delete segment;
+        return false;
+    }
+    p->segments.insert(new (SYSTEM) Simple_List<Segment>::Element(segment));
+
+    db<Heaps>(TRC) << "Page_Coloring::grow(home=" << home << ",bytes=" << bytes << ") => {color=" << p->next << ",addr=" << addr << ",size=" << segment->size() << "}" << endl;
+
+    if(_heap[home])
+        _heap[home]->free(addr, segment->size());
+    else
+        _heap[home] = new (SYSTEM) Heap(addr, segment->size());
+
+    return true;
+}
+
+
+// Makes sure a partition has its home color, taking it back from whoever borrowed it
+void Page_Coloring::claim(const Color & home)
+{
+    Partition * p = &_partition[home];
+    if(p->colors & bit(home))
+        return;
+
+    if(!(_free & bit(home)))
+        for(unsigned int h = 1; h < COLORS; h++)
+            if(_partition[h].colors & bit(home)) {
+                take(Color(h), home);
+                break;
+            }
+
+    _free &= ~bit(home);
+    p->colors |= bit(home);
+    p->next = home;
+}
+
+
+void Page_Coloring::give(const Color & home, const Color & color)
+{
+    db<Heaps>(INF) << "Page_Coloring::give(home=" << home << ",color=" << color << ")" << endl;
+
+    _free &= ~bit(color);
+    _partition[home].colors |= bit(color);
+
+    if(recoloring)
+        spread(home, color);
+}
+
+
+// Moves a partition's pages out of a color it gives back
+void Page_Coloring::take(const Color & home, const Color & color)
+{
+    db<Heaps>(INF) << "Page_Coloring::take(home=" << home << ",color=" << color << ")" << endl;
+
+    Partition * p = &_partition[home];
+    p->colors &= ~bit(color);
+    _free |= bit(color);
+
+    if(recoloring && p->colors) {
+        Color to = color;
+        for(Simple_List<Segment>::Iterator s = p->segments.begin(); s != p->segments.end(); s++)
+            for(unsigned int i = 0; i < s->object()->size() / sizeof(MMU::Page); i++)
+                if(s->object()->color(i) == color) {
+                    to = next(p->colors, to);
+                    s->object()->recolor(i, to);
+                }
+        MMU::flush_tlb();
+    }
+}
+
+
+// Moves referenced pages from the partition's most referenced colors to a color it's just got,
+// so each color ends up with about the same share of them
+void Page_Coloring::spread(const Color & home, const Color & color)
+{
+    Partition * p = &_partition[home];
+
+    unsigned int hot[COLORS];
+    unsigned int total = 0;
+    for(unsigned int c = 0; c < COLORS; c++)
+        hot[c] = 0;
+    for(Simple_List<Segment>::Iterator s = p->segments.begin(); s != p->segments.end(); s++)
+        for(unsigned int i = 0; i < s->object()->size() / sizeof(MMU::Page); i++)
+            if(s->object()->referenced(i)) {
+                hot[s->object()->color(i)]++;
+                total++;
+            }
+
+    unsigned int share = total / count(p->colors);
+    unsigned int moved = 0;
+    for(Simple_List<Segment>::Iterator s = p->segments.begin(); (s != p->segments.end()) && (moved < share); s++)
+        for(unsigned int i = 0; (i < s->object()->size() / sizeof(MMU::Page)) && (moved < share); i++)
+            if(s->object()->referenced(i)) {
+                Color c = s->object()->color(i);
+                if((c != color) && (hot[c] > share) && s->object()->recolor(i, color)) {
+                    hot[c]--;
+                    moved++;
+                }
+            }
+    MMU::flush_tlb();
+
+    db<Heaps>(INF) << "Page_Coloring::spread(home=" << home << ",color=" << color << ") => " << moved << " of " << total << " referenced pages" << endl;
+}
+
+
+// Charges the LLC misses since the last dispatch on this CPU to the partition of the thread leaving it
+void Page_Coloring::charge(const Color & home)
+{
+    // Without partitions there is no one to charge (and _partition only holds WHITE)
+    if(!partitioning)
+        return;
+
+    unsigned int cpu = Machine::cpu_id();
+
+    if(!_counting[cpu]) {
+        PMU::config(LLC_MISS_CHANNEL, PMU::LLC_MISS);
+        _llc_misses[cpu] = PMU::read(LLC_MISS_CHANNEL);
+        _counting[cpu] = true;
+        return;
+    }
+
+    unsigned int now = PMU::read(LLC_MISS_CHANNEL);
+    unsigned int delta = now - _llc_misses[cpu];
+    _llc_misses[cpu] = now;
+
+    if((home != WHITE) && ((unsigned int)home < COLORS)) {
+        Partition * p = &_partition[home];
+        if(Traits<System>::multicore)
+            for(unsigned int old = p->misses; CPU::cas(p->misses, old, old + delta) != old; old = p->misses);
+        else
+            p->misses += delta;
+    }
+}
 
 __END_SYS
@@ -1,21 +1,17 @@
 // EPOS Page Coloring Initialization
 
 #include <utility/malloc.h>
-#include <utility/heap.h>
-#include <segment.h>
-#include <address_space.h>
 
 __BEGIN_SYS
 
 void Page_Coloring::init()
 {
-    db<Init, Heaps>(TRC) << "Page_Coloring::init(colors=" << COLORS << ",colsize=" << HEAP_SIZE << ")" << endl;
+    db<Init, Heaps>(TRC) << "Page_Coloring::init(colors=" << COLORS << ",growth=" << GROWTH << ")" << endl;
 
-    // Color 0, WHITE, is reserved for the system
-    for(unsigned int i = 1; i < COLORS; i++) {
-        _segment[i] = new (SYSTEM) Segment(HEAP_SIZE, Color(i), Segment::Flags::APP);
-        _heap[i] = new (SYSTEM) Heap(Address_Space(MMU::current()).attach(_segment[i], HEAP_SIZE), _segment[i]->size());
-   }
+    // Color 0, WHITE, is reserved for the system. The others back the heaps of their home partitions, which
+    // are created at their first allocation (see alloc()), and can be lent to other partitions meanwhile
+    for(unsigned int i = 1; i < COLORS; i++)
+        _free |= bit(Color(i));
 }
 
 __END_SYS
@@ -0,0 +1,90 @@
+// EPOS Page Coloring Partitioning Test Program
+
+#include <utility/ostream.h>
+#include <utility/malloc.h>
+#include <thread.h>
+
+using namespace EPOS;
+
+const unsigned int COLORS = Traits<MMU>::COLORS;
+const unsigned int GROWTH = Traits<Application>::HEAP_SIZE / COLORS;
+const unsigned int ITERATIONS = 100000;
+
+const Color HOME = COLOR_1;
+
+int traverse(void);
+
+char * array;
+
+OStream cout;
+
+int main()
+{
+    cout << "Page Coloring Partitioning Test" << endl;
+
+    if(!(Traits<MMU>::colorful && Traits<MMU>::partitioning && Traits<PMU>::enabled) || (COLORS < 3)) {
+        cout << "Partitioning is disabled (see Traits<MMU>::colorful, Traits<MMU>::partitioning, and Traits<PMU>::enabled)!" << endl;
+        return 0;
+    }
+
+    int failures = 0;
+
+    Page_Coloring::Colors before = Page_Coloring::colors(HOME);
+    cout << "Before allocation: colors=" << hex << before << dec << endl;
+    if(before)
+        failures++;
+
+    // More than one color's share in total, so the partition grows twice, both times at home
+    char * first = new (HOME) char[GROWTH / 2];
+    array = new (HOME) char[GROWTH];
+
+    Page_Coloring::Colors allocated = Page_Coloring::colors(HOME);
+    cout << "After allocating " << GROWTH / 2 + GROWTH << " bytes: colors=" << hex << allocated << dec << endl;
+    if(allocated != (1U << HOME))
+        failures++;
+
+    // Missing the LLC while running at home gets the partition a free color on the next repartition
+    Page_Coloring::repartition();
+    unsigned int start = Page_Coloring::misses(HOME);
+    Thread * t = new Thread(Thread::Configuration(Thread::READY, Thread::NORMAL, HOME), &traverse);
+    t->join();
+    unsigned int misses = Page_Coloring::misses(HOME) - start;
+    Page_Coloring::repartition();
+
+    Page_Coloring::Colors grown = Page_Coloring::colors(HOME);
+    cout << "After repartition with " << misses << " misses: colors=" << hex << grown << dec << endl;
+    if(!(grown & (1U << HOME)))
+        failures++;
+    if((misses >= Traits<MMU>::PARTITION_GROW) && (grown == allocated))
+        failures++;
+
+    // With no misses since, the borrowed color goes back and the home color stays
+    Page_Coloring::repartition();
+
+    Page_Coloring::Colors shrunk = Page_Coloring::colors(HOME);
+    cout << "After an idle repartition: colors=" << hex << shrunk << dec << endl;
+    if(shrunk != allocated)
+        failures++;
+
+    delete t;
+    delete[] array;
+    delete[] first;
+
+    cout << (failures ? "Failed!" : "Passed!") << endl;
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+int traverse(void)
+{
+    int sum = 0;
+    unsigned int pos = 0;
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        pos = (pos + 4099 * 64) % GROWTH; // a new cache line far from the last one
+        sum += array[pos];
+        array[pos] = i;
+    }
+
+    return sum;
+}
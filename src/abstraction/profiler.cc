@@ -0,0 +1,74 @@
+// EPOS Profiler Abstraction Implementation
+
+#include <profiler.h>
+
+__BEGIN_SYS
+
+// Class attributes
+List<Thread> Profiler::_threads;
+
+// Class methods
+Profiler::Counters Profiler::counters(const Thread * t)
+{
+    Thread::lock();
+
+    Counters c = t->_pmu;
+    if(t == Thread::running())
+        PMU::peek(&c);
+
+    Thread::unlock();
+
+    return c;
+}
+
+
+unsigned int Profiler::samples(Sample * buffer, unsigned int n)
+{
+    // Thread::lock() also makes us the only consumer of the rings
+    Thread::lock();
+
+    unsigned int i = 0;
+    for(unsigned int cpu = 0; cpu < Machine::n_cpus(); cpu++)
+        while((i < n) && PMU::samples(cpu)->remove(&buffer[i]))
+            i++;
+
+    Thread::unlock();
+
+    return i;
+}
+
+
+void Profiler::dump(OStream & out)
+{
+    if(!PMU::virtualized) {
+        db<PMU>(WRN) << "Profiler::dump: PMU is not virtualized (see Traits<PMU>::virtualized)!" << endl;
+        return;
+    }
+
+    // Counters are printed with the thread list locked, so no thread can come or go meanwhile
+    Thread::lock();
+
+    out << "Profiler::dump(threads=" << _threads.size() << ")" << endl;
+    out << "thread\tcycles\tinstructions\tbranch misses\tLLC misses" << endl;
+    for(List<Thread>::Iterator it = _threads.begin(); it != _threads.end(); it++) {
+        Counters c = it->object()->_pmu;
+        if(it->object() == Thread::running())
+            PMU::peek(&c);
+        out << it->object() << "\t" << c[CYCLES] << "\t" << c[INSTRUCTIONS] << "\t" << c[BRANCH_MISSES] << "\t" << c[LLC_MISSES] << endl;
+    }
+
+    Thread::unlock();
+
+    if(!PMU::sampling)
+        return;
+
+    out << "thread\tip" << endl;
+    Sample buffer[16];
+    unsigned int total = 0;
+    for(unsigned int n; (n = samples(buffer, sizeof(buffer) / sizeof(Sample))); total += n)
+        for(unsigned int i = 0; i < n; i++)
+            out << reinterpret_cast<void *>(buffer[i].thread) << "\t" << buffer[i].ip << endl;
+    out << "Profiler::dump: " << total << " samples" << endl;
+}
+
+__END_SYS
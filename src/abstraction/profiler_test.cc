@@ -0,0 +1,83 @@
+// EPOS Profiler Test Program
+
+#include <utility/ostream.h>
+#include <thread.h>
+#include <profiler.h>
+
+using namespace EPOS;
+
+const unsigned int ITERATIONS = 100000;
+const unsigned int ARRAY_SIZE = 256 * 1024;
+
+int compute(void);
+int traverse(void);
+
+int * array;
+
+OStream cout;
+
+int main()
+{
+    cout << "Profiler test" << endl;
+
+    if(!PMU::virtualized) {
+        cout << "PMU virtualization is disabled (see Traits<PMU>::virtualized)!" << endl;
+        return 0;
+    }
+
+    array = new int[ARRAY_SIZE];
+
+    // One thread mostly executes instructions while the other mostly misses the LLC
+    Thread * a = new Thread(&compute);
+    Thread * b = new Thread(&traverse);
+
+    a->join();
+    b->join();
+
+    Profiler::Counters ca = Profiler::counters(a);
+    Profiler::Counters cb = Profiler::counters(b);
+
+    cout << "compute: cycles=" << ca[Profiler::CYCLES] << ",instructions=" << ca[Profiler::INSTRUCTIONS]
+         << ",LLC misses=" << ca[Profiler::LLC_MISSES] << endl;
+    cout << "traverse: cycles=" << cb[Profiler::CYCLES] << ",instructions=" << cb[Profiler::INSTRUCTIONS]
+         << ",LLC misses=" << cb[Profiler::LLC_MISSES] << endl;
+
+    if(!ca[Profiler::INSTRUCTIONS] || !cb[Profiler::INSTRUCTIONS])
+        cout << "Failed: threads weren't accounted for!" << endl;
+    else if(ca[Profiler::LLC_MISSES] > cb[Profiler::LLC_MISSES])
+        cout << "Failed: compute missed the LLC more than traverse!" << endl;
+    else
+        cout << "Passed!" << endl;
+
+    Profiler::dump();
+
+    delete a;
+    delete b;
+    delete array;
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+int compute(void)
+{
+    volatile unsigned int x = 1;
+    for(unsigned int i = 0; i < ITERATIONS; i++)
+        x = x * 1103515245 + 12345;
+
+    return x;
+}
+
+int traverse(void)
+{
+    int sum = 0;
+    unsigned int pos = 0;
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        pos = (pos + 4099 * 16) % ARRAY_SIZE; // a new cache line far from the last one
+        sum += array[pos];
+        array[pos] = i;
+    }
+
+    return sum;
+}
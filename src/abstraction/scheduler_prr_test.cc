@@ -0,0 +1,133 @@
+// EPOS Partitioned Round-Robin with Work Stealing Scheduler Test Program
+
+#include <utility/ostream.h>
+#include <machine.h>
+#include <thread.h>
+#include <semaphore.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const int iterations = 10000;
+const int MAX_CPUS = Traits<Build>::CPUS;
+
+volatile int yields[MAX_CPUS];
+volatile int wakeups[MAX_CPUS];
+
+Semaphore * ping[MAX_CPUS];
+Semaphore * pong[MAX_CPUS];
+
+Thread * yielder[MAX_CPUS][2];
+Thread * pinger[MAX_CPUS];
+Thread * ponger[MAX_CPUS];
+Thread * worker[MAX_CPUS * 4];
+
+OStream cout;
+
+int yield(int cpu);
+int ping_pong(int cpu, bool pinger);
+int work(int n);
+
+int main()
+{
+    cout << "Partitioned Round-Robin with Work Stealing Scheduler Test" << endl;
+    cout << "This test measures the yield and wakeup rates of each CPU." << endl;
+
+    Chronometer chrono;
+    unsigned int cpus = Machine::n_cpus();
+
+    chrono.start();
+    for(unsigned int i = 0; i < cpus; i++) {
+        yielder[i][0] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i)), &yield, int(i));
+        yielder[i][1] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i)), &yield, int(i));
+    }
+    for(unsigned int i = 0; i < cpus; i++) {
+        yielder[i][0]->join();
+        yielder[i][1]->join();
+    }
+    chrono.stop();
+
+    Chronometer::Microsecond elapsed = chrono.read();
+    cout << "Yields (" << elapsed << " us):" << endl;
+    for(unsigned int i = 0; i < cpus; i++)
+        cout << "CPU[" << i << "]: " << yields[i] << " yields => " << (long long)yields[i] * 1000000 / (elapsed ? elapsed : 1) << " yields/s" << endl;
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < cpus; i++) {
+        ping[i] = new Semaphore(0);
+        pong[i] = new Semaphore(0);
+        pinger[i] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i)), &ping_pong, int(i), true);
+        ponger[i] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i)), &ping_pong, int(i), false);
+    }
+    for(unsigned int i = 0; i < cpus; i++) {
+        pinger[i]->join();
+        ponger[i]->join();
+    }
+    chrono.stop();
+
+    elapsed = chrono.read();
+    cout << "Wakeups (" << elapsed << " us):" << endl;
+    for(unsigned int i = 0; i < cpus; i++)
+        cout << "CPU[" << i << "]: " << wakeups[i] << " wakeups => " << (long long)wakeups[i] * 1000000 / (elapsed ? elapsed : 1) << " wakeups/s" << endl;
+
+    // Unpinned workers are distributed round-robin, but have different amounts of work,
+    // so CPUs that finish first will steal READY workers from their neighbours
+    for(unsigned int i = 0; i < cpus * 4; i++)
+        worker[i] = new Thread(&work, int(i));
+    for(unsigned int i = 0; i < cpus * 4; i++)
+        cout << "Worker " << i << " finished on CPU " << worker[i]->join() << endl;
+
+    for(unsigned int i = 0; i < cpus; i++) {
+        delete yielder[i][0];
+        delete yielder[i][1];
+        delete pinger[i];
+        delete ponger[i];
+        delete ping[i];
+        delete pong[i];
+    }
+    for(unsigned int i = 0; i < cpus * 4; i++)
+        delete worker[i];
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+int yield(int cpu)
+{
+    for(int i = 0; i < iterations; i++) {
+        Thread::yield();
+        CPU::finc(yields[cpu]);
+    }
+
+    return 0;
+}
+
+int ping_pong(int cpu, bool pinger)
+{
+    for(int i = 0; i < iterations; i++) {
+        if(pinger) {
+            ping[cpu]->v();
+            pong[cpu]->p();
+        } else {
+            ping[cpu]->p();
+            CPU::finc(wakeups[cpu]);
+            pong[cpu]->v();
+        }
+    }
+
+    return 0;
+}
+
+int work(int n)
+{
+    volatile unsigned long long v = 0;
+    for(unsigned long long j = 0; j < (n % 4 + 1) * 10000000ULL; j++) {
+        v &= 2 ^ j;
+        if(!(j % 100000))
+            Thread::yield();
+    }
+
+    return Machine::cpu_id();
+}
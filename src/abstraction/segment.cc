@@ -19,6 +19,13 @@ Segment::Segment(const Phy_Addr & phy_addr, unsigned int bytes, const Flags & fl
 }
 
 
+Segment::Segment(const Segment & origin, const Flags & flags): Chunk(origin, flags)
+// With Flags::COW, the frames are shared with origin until either segment writes to them
+{
+    db<Segment>(TRC) << "Segment(origin=" << &origin << ",flags=" << flags << ") [Chunk::_pt=" << Chunk::pt() << "] => " << this << endl;
+}
+
+
 Segment::~Segment()
 {
     db<Segment>(TRC) << "~Segment() [Chunk::_pt=" << Chunk::pt() << "]" << endl;
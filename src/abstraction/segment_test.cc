@@ -8,6 +8,7 @@ using namespace EPOS;
 
 const unsigned ES1_SIZE = 10000;
 const unsigned ES2_SIZE = 100000;
+const unsigned ES3_SIZE = MMU::LARGE_PAGE; // mapped with a single 4 MiB page if Traits<MMU>::large_pages
 
 int main()
 {
@@ -36,14 +37,28 @@ int main()
     memset(extra2, 0, ES2_SIZE);
     cout << "  done!" << endl;
 
+    cout << "Creating a large segment:" << endl;
+    Segment * es3 = new Segment(ES3_SIZE);
+    CPU::Log_Addr * extra3 = self.attach(es3);
+    cout << "  extra segment 3 => " << ES3_SIZE << " bytes at " << extra3 << " (phy=" << es3->phy_address() << ")" << endl;
+    memset(extra3, 0, ES3_SIZE);
+    if(es3->phy_address()) {
+        // A large page is physically contiguous, so its last byte is as far from the first as in the logical space
+        CPU::Log_Addr last = CPU::Log_Addr(extra3) + ES3_SIZE - 1;
+        bool ok = (self.physical(last) == es3->phy_address() + ES3_SIZE - 1);
+        cout << "  translation of its last byte => " << self.physical(last) << (ok ? " ok" : " wrong!") << endl;
+    }
+
     cout << "Detaching segments:";
     self.detach(es1);
     self.detach(es2);
+    self.detach(es3);
     cout << "  done!" << endl;
 
     cout << "Deleting segments:";
     delete es1;
     delete es2;
+    delete es3;
     cout << "  done!" << endl;
 
     cout << "I'm done, bye!" << endl;
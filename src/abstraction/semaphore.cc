@@ -20,6 +20,24 @@ void Semaphore::p()
 {
     db<Synchronizer>(TRC) << "Semaphore::p(this=" << this << ",value=" << _value << ")" << endl;
 
+    if(smp) {
+        if(down())
+            return;
+
+        if(spinning) {
+            // A negative value means there are sleepers already, and v() would wake them up instead of us
+            unsigned int budget = spin_budget();
+            unsigned int i = 0;
+            for(; (i < budget) && (_value == 0); i++)
+                CPU::pause();
+
+            bool succeeded = down();
+            spun(i, succeeded);
+            if(succeeded)
+                return;
+        }
+    }
+
     begin_atomic();
     if(fdec(_value) < 1)
         sleep(); // implicit end_atomic()
@@ -32,6 +50,12 @@ void Semaphore::v()
 {
     db<Synchronizer>(TRC) << "Semaphore::v(this=" << this << ",value=" << _value << ")" << endl;
 
+    // Without sleepers (i.e. value >= 0), there is no one to wake up
+    if(smp)
+        for(int n = _value; n >= 0; n = _value)
+            if(cas(_value, n, n + 1) == n)
+                return;
+
     begin_atomic();
     if(finc(_value) < 0)
         wakeup();  // implicit end_atomic()
@@ -39,4 +63,15 @@ void Semaphore::v()
         end_atomic();
 }
 
+
+// Lock-free decrement, which only succeeds if p() wouldn't block
+bool Semaphore::down()
+{
+    for(int n = _value; n > 0; n = _value)
+        if(cas(_value, n, n - 1) == n)
+            return true;
+
+    return false;
+}
+
 __END_SYS
@@ -56,6 +56,8 @@ template<> struct Traits<Spin>: public Traits<void>
 template<> struct Traits<Heaps>: public Traits<void>
 {
     static const bool debugged = hysterically_debugged;
+    static const bool slab = true; // size-class free lists in front of the heap for small blocks
+    static const unsigned int MAGAZINE = 16; // per-CPU cache of small blocks in multicore heaps (0 disables)
 };
 
 template<> struct Traits<Observers>: public Traits<void>
@@ -167,11 +169,15 @@ template<> struct Traits<Segment>: public Traits<void>
 template<> struct Traits<Alarm>: public Traits<void>
 {
     static const bool visible = hysterically_debugged;
+    static const bool timing_wheel = true; // hierarchical timing wheel instead of a relative queue
 };
 
 template<> struct Traits<Synchronizer>: public Traits<void>
 {
     static const bool enabled = Traits<System>::multithread;
+
+    // Maximum busy-waiting iterations before blocking on SMP (adapted per synchronizer, 0 means always block)
+    static const unsigned int SPIN = 1000;
 };
 
 template<> struct Traits<Network>: public Traits<void>
@@ -180,6 +186,8 @@ template<> struct Traits<Network>: public Traits<void>
 
     static const unsigned int RETRIES = 3;
     static const unsigned int TIMEOUT = 10; // s
+    static const bool deferred = false; // NICs receive frames in a high-priority thread instead of in the ISR (NAPI-like)
+    static const unsigned int BUDGET = 32; // frames received by that thread before giving other threads a chance to run
 
     // This list is positional, with one network for each NIC in Traits<NIC>::NICS
     typedef LIST<TSTP> NETWORKS;
@@ -220,6 +228,8 @@ template<> struct Traits<IP>: public Traits<Network>
     struct Config: public Default_Config {};
 
     static const unsigned int TTL  = 0x40; // Time-to-live
+    static const unsigned int CACHE = 16; // destinations whose routes and next-hop MACs are cached (0 disables it)
+    static const unsigned int FRAGMENTED = 8; // datagrams that can be under reassembly at once
 };
 
 template<> struct Traits<IP>::Config<0> //: public Traits<IP>::Default_Config
@@ -237,11 +247,18 @@ template<> struct Traits<IP>::Config<1>: public Traits<IP>::Default_Config
 template<> struct Traits<UDP>: public Traits<Network>
 {
     static const bool checksum = true;
+    static const unsigned int DEMUX = 64; // buckets of the hashed port demultiplexing table (0 for a linear list)
 };
 
 template<> struct Traits<TCP>: public Traits<Network>
 {
-    static const unsigned int WINDOW = 4096;
+    static const unsigned int WINDOW = 32768; // receive window (scaled, as in RFC 7323, above 64 KiB)
+    static const unsigned int DEMUX = 64; // buckets of the hashed connection demultiplexing table (0 for a linear list)
+    static const unsigned int SEGMENTS = 64; // capacity of each connection's retransmission queue, i.e. segments in flight
+    static const bool SACK = true; // selective acknowledgments (RFC 2018)
+    static const bool CUBIC = false; // CUBIC (RFC 8312) instead of NewReno (RFC 6582) congestion control
+    static const unsigned int REORDER = 16; // out-of-order segments held by each connection until the gap before them is filled
+    static const unsigned int DELAYED_ACK = 40; // ms an ACK may be delayed waiting for a second segment (0 acknowledges every segment)
 };
 
 template<> struct Traits<DHCP>: public Traits<Network>
@@ -0,0 +1,90 @@
+// EPOS Multicore Synchronizer Test Program
+
+#include <utility/ostream.h>
+#include <machine.h>
+#include <thread.h>
+#include <mutex.h>
+#include <semaphore.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const int ROUNDS = 100000;
+const int MAX_CPUS = Traits<Build>::CPUS;
+
+Mutex mutex;
+Semaphore semaphore;
+volatile int counter;
+Thread * worker[MAX_CPUS];
+
+OStream cout;
+
+int with_mutex(int cpu);
+int with_semaphore(int cpu);
+Chronometer::Microsecond run(int (* entry)(int), unsigned int cpus);
+
+int main()
+{
+    cout << "Multicore Synchronizer Test" << endl;
+    cout << "This test measures the throughput of short critical sections with one thread per CPU." << endl;
+    cout << "Uncontended operations take a lock-free fast path and contended ones spin a little before blocking," << endl;
+    cout << "so handoffs should rarely need a context switch." << endl;
+
+    unsigned int cpus = Machine::n_cpus();
+
+    for(unsigned int n = 1; n <= cpus; n++) {
+        counter = 0;
+        Chronometer::Microsecond elapsed = run(&with_mutex, n);
+        long long ops = (long long)n * ROUNDS;
+        cout << "Mutex, " << n << " CPU(s): " << ops << " critical sections in " << elapsed << " us => "
+             << ops * 1000 / (elapsed ? elapsed : 1) << " ops/ms" << ((counter == ops) ? "" : " (wrong count!)") << endl;
+
+        counter = 0;
+        elapsed = run(&with_semaphore, n);
+        cout << "Semaphore, " << n << " CPU(s): " << ops << " critical sections in " << elapsed << " us => "
+             << ops * 1000 / (elapsed ? elapsed : 1) << " ops/ms" << ((counter == ops) ? "" : " (wrong count!)") << endl;
+    }
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+Chronometer::Microsecond run(int (* entry)(int), unsigned int cpus)
+{
+    Chronometer chrono;
+
+    chrono.start();
+    for(unsigned int i = 0; i < cpus; i++)
+        worker[i] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i)), entry, int(i));
+    for(unsigned int i = 0; i < cpus; i++)
+        worker[i]->join();
+    chrono.stop();
+
+    for(unsigned int i = 0; i < cpus; i++)
+        delete worker[i];
+
+    return chrono.read();
+}
+
+int with_mutex(int cpu)
+{
+    for(int i = 0; i < ROUNDS; i++) {
+        mutex.lock();
+        counter = counter + 1;
+        mutex.unlock();
+    }
+
+    return 0;
+}
+
+int with_semaphore(int cpu)
+{
+    for(int i = 0; i < ROUNDS; i++) {
+        semaphore.p();
+        counter = counter + 1;
+        semaphore.v();
+    }
+
+    return 0;
+}
@@ -17,6 +17,9 @@ Task::~Task()
         delete _threads.remove()->object();
 
     delete _as;
+
+    if(_clone)
+        delete _ds;
 }
 
 __END_SYS
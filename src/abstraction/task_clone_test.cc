@@ -0,0 +1,78 @@
+// EPOS Task Clone and Demand-Zero Segment Test Program
+
+#include <utility/ostream.h>
+#include <task.h>
+#include <segment.h>
+#include <address_space.h>
+
+using namespace EPOS;
+
+typedef _SYS::Segment::Flags Flags; // Segment is a handle for the system's Segment in the kernel mode
+
+const int CLONES = 16;
+const unsigned int SEGMENT_SIZE = 1024 * 1024;
+const unsigned int PAGE_SIZE = 4096;
+
+// Lives in the data segment, which clones share copy-on-write
+int value = 0;
+
+OStream cout;
+
+int worker();
+
+int main()
+{
+    cout << "Task Clone and Demand-Zero Segment Test" << endl;
+
+    int failures = 0;
+
+    // Demand-zero segments only get frames for the pages that are touched, and they come zeroed
+    cout << "Creating a " << SEGMENT_SIZE / 1024 << " KB demand-zero segment:" << endl;
+    Address_Space * as = Task::self()->address_space();
+    Segment * seg = new Segment(SEGMENT_SIZE, Flags::APP | Flags::DZ);
+    char * p = as->attach(seg);
+    for(unsigned int i = 0; i < SEGMENT_SIZE; i += 16 * PAGE_SIZE) {
+        if(p[i] != 0)
+            failures++;
+        p[i] = 1;
+        if(p[i] != 1)
+            failures++;
+    }
+    as->detach(seg);
+    delete seg;
+    cout << "  pages touched: " << SEGMENT_SIZE / (16 * PAGE_SIZE) << ", wrong values: " << failures << endl;
+
+    // Clones share the code segment and only copy the pages of the data segment they write to
+    value = 42;
+    Task * self = Task::self();
+    Task * clones[CLONES];
+
+    cout << "Cloning myself " << CLONES << " times:" << endl;
+    for(int i = 0; i < CLONES; i++)
+        clones[i] = new Task(self, &worker);
+
+    int wrong = 0;
+    for(int i = 0; i < CLONES; i++) {
+        if(!clones[i]->main()->join())
+            wrong++;
+        delete clones[i];
+    }
+    cout << "  clones that saw a wrong value: " << wrong << endl;
+    failures += wrong;
+
+    // Writes of the clones must not be visible here, nor mine to them
+    value = 7;
+    cout << "  my value after the clones wrote theirs: " << value << endl;
+
+    cout << (failures ? "Failed!" : "Passed!") << endl;
+    cout << "I'm done, bye!" << endl;
+
+    return 0;
+}
+
+int worker()
+{
+    bool ok = (value == 42); // the parent's data, still shared
+    value = 1000;            // gets a private copy of the page
+    return ok && (value == 1000);
+}
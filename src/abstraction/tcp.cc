@@ -8,7 +8,7 @@
 __BEGIN_SYS
 
 // Class attributes
-TCP::Observed TCP::_observed;
+TCP::Demux TCP::_observed;
 
 TCP::Connection::State_Handler TCP::Connection::_handlers[] = {&TCP::Connection::listening,
                                                                &TCP::Connection::syn_sent,
@@ -31,50 +31,58 @@ void TCP::update(IP::Observed * obs, IP::Protocol prot, NIC::Buffer * pool)
     Packet * packet = pool->frame()->data<Packet>();
     Segment * segment = packet->data<Segment>();
 
-    unsigned int size = pool->size() - sizeof(IP::Header) - sizeof(TCP::Header);
+    if((segment->size() < sizeof(Header)) || (segment->size() > pool->size() - sizeof(IP::Header))) {
+        db<TCP>(WRN) << "TCP::update: bad data offset!" << endl;
+        pool->nic()->free(pool);
+        return;
+    }
+
+    unsigned int size = pool->size() - sizeof(IP::Header) - segment->size();
     if(size && !segment->check(size)) { // FIXME there should not be a check for "size", it should always check the sum. However, it doesn't seem to work when size == 0
         db<TCP>(WRN) << "TCP::update: wrong message checksum!" << endl;
         pool->nic()->free(pool);
         return;
     }
 
-    unsigned long long id;
-    if(segment->header()->flags() == Header::SYN) // try to notify any eventual listener
-        id = Connection::id(segment->header()->to(), 0, IP::Address::NULL);
-    else
-        id = Connection::id(segment->header()->to(), segment->header()->from(), packet->header()->from());
+    // Exact match first, then, for connection requests, the wildcard id of an eventual listener
+    unsigned long long id = Connection::id(segment->header()->to(), segment->header()->from(), packet->header()->from());
 
     db<TCP>(INF) << "TCP::update::condition=" << hex << id << endl;
 
-    if(!_observed.notify(id, pool))
-        pool->nic()->free(pool);
+    if(_observed.notify(id, pool))
+        return;
+
+    if(segment->header()->flags() == Header::SYN) {
+        id = Connection::id(segment->header()->to(), 0, IP::Address::NULL);
+
+        db<TCP>(INF) << "TCP::update::condition=" << hex << id << endl;
+
+        if(_observed.notify(id, pool))
+            return;
+    }
+
+    pool->nic()->free(pool);
 }
 
 void TCP::Segment::sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int size)
 {
     _checksum = 0;
 
-    IP::Pseudo_Header pseudo(from, to, IP::TCP, sizeof(Header) + size);
+    IP::Pseudo_Header pseudo(from, to, IP::TCP, header()->size() + size);
+    unsigned short sum = IP::sum(header(), header()->size(), IP::sum(&pseudo, sizeof(IP::Pseudo_Header)));
+    if(data)
+        sum = IP::sum(data, size, sum);
 
-    unsigned long sum = 0;
-    const unsigned char * ptr = reinterpret_cast<const unsigned char *>(&pseudo);
-    for(unsigned int i = 0; i < sizeof(IP::Pseudo_Header); i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
-
-    ptr = reinterpret_cast<const unsigned char *>(header());
-    for(unsigned int i = 0; i < sizeof(Header); i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
+    _checksum = htons(~sum);
+}
 
-    if(data) {
-        ptr = reinterpret_cast<const unsigned char *>(data);
-        for(unsigned int i = 0; i < size; i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-        if(size & 1)
-            sum += ptr[size - 1];
-    }
+void TCP::Segment::fill(const IP::Address & from, const IP::Address & to, const void * data, unsigned int size)
+{
+    _checksum = 0;
 
-    while(sum >> 16)
-        sum = (sum & 0xffff) + (sum >> 16);
+    IP::Pseudo_Header pseudo(from, to, IP::TCP, header()->size() + size);
+    unsigned short sum = IP::sum(header(), header()->size(), IP::sum(&pseudo, sizeof(IP::Pseudo_Header)));
+    sum = IP::copy_and_sum(this->data<void>(), data, size, sum);
 
     _checksum = htons(~sum);
 }
@@ -82,11 +90,15 @@ void TCP::Segment::sum(const IP::Address & from, const IP::Address & to, const v
 void TCP::Connection::fsend(const Flags & flags)
 {
     _flags = flags;
-    if(!_retransmiting) _sequence = htonl(_next);
+    _sequence = htonl(_next);
 
     db<TCP>(TRC) << "TCP::Connection::send(flags=" << ((flags & ACK) ? 'A' : '-') << ((flags & RST) ? 'R' : '-') << ((flags & SYN) ? 'S' : '-') << ((flags & FIN) ? 'F' : '-') << "): SND.NXT=" << _next << ",SND.SEQ=" << sequence() << endl;
 
-    Buffer * buf = IP::alloc(peer(), IP::TCP, sizeof(Header), 0);
+    unsigned int blocks[4][2];
+    unsigned int sacks = (!(flags & SYN) && (flags & ACK) && _sack && _reordering) ? selective(blocks) : 0;
+    unsigned int options = (flags & SYN) ? OPTIONS : sacks ? 4 + 8 * sacks : 0;
+
+    Buffer * buf = IP::alloc(peer(), IP::TCP, sizeof(Header) + options, 0);
     if(!buf) {
         db<TCP>(WRN) << "TCP::send: failed to alloc a NIC buffer to send a TCP control segment!" << endl;
         return;
@@ -96,6 +108,30 @@ void TCP::Connection::fsend(const Flags & flags)
     Packet * packet = buf->frame()->data<Packet>();
     Segment * segment = packet->data<Segment>();
     memcpy(segment, header(), sizeof(Header));
+    segment->window(advertised(flags & SYN));
+
+    if(flags & SYN) {
+        // MSS, then window scale and SACK permitted if we are opening or if the peer offered them, padded with NOPs
+        unsigned char * o = reinterpret_cast<unsigned char *>(segment) + sizeof(Header);
+        o[0] = SEGMENT_SIZE;
+        o[1] = 4;
+        o[2] = MSS >> 8;
+        o[3] = MSS & 0xff;
+        o[4] = NOP;
+        o[5] = _scaling ? WINDOW_SCALE : NOP;
+        o[6] = _scaling ? 3 : NOP;
+        o[7] = _scaling ? SCALE : NOP;
+        o[8] = NOP;
+        o[9] = NOP;
+        o[10] = _sack ? SACK_PERMITTED : NOP;
+        o[11] = _sack ? 2 : NOP;
+        segment->size(sizeof(Header) + options);
+    } else if(sacks)
+        segment->sack(blocks, sacks);
+
+    if(flags & ACK)
+        acked();
+
     segment->sum(packet->from(), packet->to(), 0, 0);
 
     db<TCP>(INF) << "TCP::Connection::send:conn=" << this << " => " << *this << endl;
@@ -112,61 +148,50 @@ void TCP::Connection::fsend(const Flags & flags)
 
 int TCP::Connection::send(const void * d, unsigned int size)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
-
-    db<TCP>(TRC) << "TCP::Connection::send(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << data << ",s=" << size << ")" << endl;
-
-    unsigned int allowed = WINDOW;
-    unsigned int left = size; // bytes that have not been sent at all
-    unsigned int acknowledged = 0; // bytes that were sent AND acknowledged
-    unsigned int initial_seq = sequence(); // sequence number when stream is started
-
-    unsigned int tries = 0;
-    for(; (tries < RETRIES) && (acknowledged != size) && (_state == ESTABLISHED || _state == CLOSE_WAIT);
-        acknowledged = _current->header()->acknowledgment() - initial_seq, allowed = _peer_window - (sequence() - _current->header()->acknowledgment())) {
-        _streaming = true;
-        allowed = (allowed > MSS) ? MSS: allowed;
-
-        if(allowed && left) {
-            db<TCP>(TRC) << "TCP::Connection::send: send" << endl;
-
-            int payload = (allowed > left) ? left : allowed;
+    db<TCP>(TRC) << "TCP::Connection::send(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << d << ",s=" << size << ")" << endl;
 
-            if(!dsend(data, payload)) // FIXME we should wait until there are available buffers
-                return -1;
+    lock();
+    _data = reinterpret_cast<const unsigned char *>(d);
+    _base = _next;
+    _streaming = true;
+    unlock();
 
-            data += payload;
-            left -= payload;
-            if(sequence() == _next)
-                _retransmiting = false;
-        } else { // Either window's full or we've sent all there was to
-            db<TCP>(TRC) << "TCP::Connection::send: wait" << endl;
+    unsigned int end = _base + size;
+    unsigned int tries = 0; // consecutive retransmission time-outs
+    bool probe = false;
 
-            unsigned int old_ack = _current->header()->acknowledgment();
+    while((_unacknowledged < end) && (tries < RETRIES) && (_state == ESTABLISHED || _state == CLOSE_WAIT)) {
+        transmit(end, probe);
+        probe = false;
 
-            Condition_Handler h(&_stream);
-            Alarm a(TIMEOUT, &h);
+        unsigned int acknowledged = _unacknowledged;
 
-            _stream.wait();
+        lock();
+        unsigned int elapsed = (TSC::time_stamp() - _timer) / (TSC::frequency() / 1000000);
+        Alarm::Microsecond remaining = (elapsed < _rto) ? _rto - elapsed : 0;
+        unlock();
 
-            if(_current->header()->acknowledgment() == old_ack) {
-                // Retransmission
-                db<TCP>(TRC) << "TCP::Connection::send: retransmission" << endl;
-
-                _retransmiting = true;
-                _sequence = htonl(_current->header()->acknowledgment());
-                _unacknowledged = _current->header()->acknowledgment();
-                data = reinterpret_cast<const unsigned char*>(d) + acknowledged;
-                left = size - acknowledged;
+        if(remaining) {
+            Semaphore_Handler handler(&_stream);
+            Alarm alarm(remaining, &handler);
+            _stream.p();
+        }
 
+        if(_unacknowledged != acknowledged)
+            tries = 0;
+        else if(expired()) {
+            if(_queued) {
+                db<TCP>(TRC) << "TCP::Connection::send: retransmission time-out (rto=" << _rto << ")" << endl;
                 tries++;
             } else
-                tries = 0;
+                probe = true; // the peer's window is closed
         }
     }
 
+    lock();
     _streaming = false;
-    _retransmiting = false;
+    _queued = 0;
+    unlock();
 
     if(tries == RETRIES) {
         db<TCP>(TRC) << "TCP::send: Enough tries already!" << endl;
@@ -178,26 +203,84 @@ int TCP::Connection::send(const void * d, unsigned int size)
         return -1;
     }
 
-
     return size;
 }
 
-int TCP::Connection::dsend(const void * d, unsigned int size)
+// Sends all the congestion window allows: first the segments in the retransmission queue marked as lost,
+// then new segments from the stream, while they also fit in the peer's window (or a single one, if probing it)
+void TCP::Connection::transmit(unsigned int end, bool probe)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
+    while(true) {
+        unsigned int sequence;
+        unsigned int length;
+
+        lock();
+
+        // RFC 6675's "pipe": bytes believed to be still in the network
+        unsigned int pipe = 0;
+        Transmission * lost = 0;
+        for(unsigned int i = 0; i < _queued; i++) {
+            Transmission * t = transmission(i);
+            if(t->lost) {
+                if(!lost)
+                    lost = t;
+            } else if(!t->sacked)
+                pipe += t->length;
+        }
+
+        unsigned int room = (_congestion.window() > pipe) ? _congestion.window() - pipe : 0;
+
+        if(lost && (room >= lost->length)) {
+            lost->lost = false;
+            lost->retransmitted = true;
+            lost->sent = TSC::time_stamp();
+            sequence = lost->sequence;
+            length = lost->length;
+        } else if(!lost && (_next < end) && (_queued < SEGMENTS)) {
+            length = (end - _next > _mss) ? _mss : end - _next;
+            if(((room < length) || (_next + length - _unacknowledged > _peer_window)) && !(probe && !_queued)) {
+                unlock();
+                return;
+            }
+
+            Transmission * t = transmission(_queued++);
+            t->sequence = _next;
+            t->length = length;
+            t->sent = TSC::time_stamp();
+            t->sacked = false;
+            t->lost = false;
+            t->retransmitted = false;
+            if(_queued == 1)
+                _timer = t->sent;
+
+            sequence = _next;
+            _next += length;
+        } else {
+            unlock();
+            return;
+        }
+
+        unlock();
+
+        if(!dsend(sequence, _data + (sequence - _base), length)) // it will be retransmitted once the timer expires
+            return;
+    }
+}
 
-    db<TCP>(TRC) << "TCP::dsend(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << data << ",s=" << size << ")" << endl;
+int TCP::Connection::dsend(unsigned int sequence, const void * d, unsigned int size)
+{
+    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
 
-    _flags = ACK;
-    if(!_retransmiting)
-        _sequence = htonl(_next);
+    db<TCP>(TRC) << "TCP::dsend(f=" << from() << ",t=" << peer() << ":" << to() << ",seq=" << sequence << ",d=" << data << ",s=" << size << ")" << endl;
 
-    db<TCP>(TRC) << "TCP::Connection::dsend: SND.NXT=" << _next << ",SND.SEQ=" << sequence() << ",payload=" << size << endl;
+    db<TCP>(TRC) << "TCP::Connection::dsend: SND.NXT=" << _next << ",SND.UNA=" << _unacknowledged << ",payload=" << size << endl;
 
     Buffer * pool = IP::alloc(peer(), IP::TCP, sizeof(Header), size);
     if(!pool)
         return 0;
 
+    acked();
+
     unsigned int headers = sizeof(Header);
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
         Buffer * buf = el->object();
@@ -206,10 +289,13 @@ int TCP::Connection::dsend(const void * d, unsigned int size)
         db<TCP>(INF) << "TCP::send:buf=" << buf << " => " << *buf<< endl;
 
         if(el == pool->link()) {
+            // The connection's header is shared with control segments sent on reception, so the sequence number is only set in the copy
             Segment * segment = packet->data<Segment>();
             memcpy(segment, header(), sizeof(Header));
-            segment->sum(packet->from(), packet->to(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            memcpy(segment->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
+            segment->sequence(sequence);
+            segment->flags(ACK);
+            segment->window(advertised(false));
+            segment->fill(packet->from(), packet->to(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
             data += buf->size() - sizeof(Header) - sizeof(IP::Header);
 
             db<TCP>(INF) << "TCP::send:msg=" << segment << " => " << *segment << endl;
@@ -221,14 +307,189 @@ int TCP::Connection::dsend(const void * d, unsigned int size)
         headers += sizeof(IP::Header);
     }
 
-    if(!_retransmiting)
-        _next += size;
-    else
-        _sequence = htonl(header()->sequence() + size);
-
     return IP::send(pool) - headers; // implicitly releases the pool
 }
 
+// Processes the acknowledgment in the current segment: releases the acknowledged segments from the retransmission queue,
+// samples the RTT, grows the congestion window or detects losses by duplicate ACKs and SACK blocks.
+// Returns whether the sender must be woken up.
+bool TCP::Connection::acknowledge()
+{
+    unsigned int ack = _current->header()->acknowledgment();
+    TSC::Time_Stamp now = TSC::time_stamp();
+    bool wake = false;
+
+    lock();
+
+    if(_sack && _queued)
+        sack();
+
+    if(ack > _unacknowledged) {
+        unsigned int acknowledged = ack - _unacknowledged;
+
+        TSC::Time_Stamp sent = 0;
+        while(_queued && (transmission(0)->sequence + transmission(0)->length <= ack)) {
+            if(!transmission(0)->retransmitted)
+                sent = transmission(0)->sent;
+            _first = (_first + 1) % SEGMENTS;
+            _queued--;
+        }
+        if(_queued && (transmission(0)->sequence < ack)) { // partially acknowledged
+            transmission(0)->length -= ack - transmission(0)->sequence;
+            transmission(0)->sequence = ack;
+        }
+        if(sent)
+            rtt(now - sent);
+
+        _unacknowledged = ack;
+        _duplicates = 0;
+        _timer = now;
+
+        if(_recovering) {
+            if(ack >= _recover) { // full acknowledgment
+                _recovering = false;
+                _congestion.window(_congestion.threshold());
+            } else { // partial acknowledgment: the next hole was lost as well
+                if(_queued && !transmission(0)->sacked && !transmission(0)->retransmitted)
+                    transmission(0)->lost = true;
+                if(!_sack)
+                    _congestion.deflate(acknowledged);
+            }
+        } else
+            _congestion.acknowledged(acknowledged);
+
+        wake = true;
+    } else if((ack == _unacknowledged) && _queued && !_length && !(_current->header()->flags() & (SYN | FIN))) {
+        _duplicates++;
+
+        if(!_recovering && (_duplicates == DUPLICATES)) { // fast retransmit
+            db<TCP>(TRC) << "TCP::Connection::acknowledge: fast retransmit (seq=" << ack << ")" << endl;
+
+            _congestion.lost(_next - _unacknowledged, false);
+            _recovering = true;
+            _recover = _next;
+            if(!transmission(0)->sacked)
+                transmission(0)->lost = true;
+            if(!_sack)
+                _congestion.inflate(DUPLICATES * _mss);
+            wake = true;
+        } else if(_recovering) {
+            if(!_sack)
+                _congestion.inflate(_mss);
+            wake = true;
+        }
+    }
+
+    // With SACK, a segment is considered lost once DUPLICATES segments sent after it have been selectively acknowledged (RFC 6675)
+    if(_sack && _recovering) {
+        unsigned int sacked = 0;
+        for(unsigned int i = _queued; i > 0; i--) {
+            Transmission * t = transmission(i - 1);
+            if(t->sacked)
+                sacked++;
+            else if((sacked >= DUPLICATES) && !t->retransmitted)
+                t->lost = true;
+        }
+    }
+
+    unlock();
+
+    return wake;
+}
+
+// Marks the segments covered by the SACK blocks in the current segment
+void TCP::Connection::sack()
+{
+    const unsigned char * o = _current->header()->option(SELECTIVE_ACK);
+    if(!o)
+        return;
+
+    for(unsigned int b = 2; b + 8 <= o[1]; b += 8) {
+        unsigned int left = o[b] << 24 | o[b + 1] << 16 | o[b + 2] << 8 | o[b + 3];
+        unsigned int right = o[b + 4] << 24 | o[b + 5] << 16 | o[b + 6] << 8 | o[b + 7];
+
+        for(unsigned int i = 0; i < _queued; i++) {
+            Transmission * t = transmission(i);
+            if((t->sequence >= left) && (t->sequence + t->length <= right)) {
+                t->sacked = true;
+                t->lost = false;
+            }
+        }
+    }
+}
+
+// Checks the retransmission timer. On time-out, the congestion window collapses to a single segment,
+// the RTO is backed off and every segment in flight not selectively acknowledged is marked as lost (RFC 5681 and RFC 6298)
+bool TCP::Connection::expired()
+{
+    lock();
+
+    if((TSC::time_stamp() - _timer) / (TSC::frequency() / 1000000) < _rto) {
+        unlock();
+        return false;
+    }
+
+    if(_queued) {
+        _congestion.lost(_next - _unacknowledged, true);
+        _recovering = false;
+        _duplicates = 0;
+        _recover = _next;
+
+        for(unsigned int i = 0; i < _queued; i++)
+            if(!transmission(i)->sacked)
+                transmission(i)->lost = true;
+    }
+
+    backoff();
+    _timer = TSC::time_stamp();
+
+    unlock();
+
+    return true;
+}
+
+// Jacobson/Karels RTT estimator (RFC 6298), with _srtt scaled by 8 and _rttvar by 4
+void TCP::Connection::rtt(const TSC::Time_Stamp & sample)
+{
+    unsigned int r = sample / (TSC::frequency() / 1000000);
+
+    if(!_srtt) {
+        _srtt = r << 3;
+        _rttvar = r << 1;
+    } else {
+        int delta = r - (_srtt >> 3);
+        _srtt += delta;
+        if(delta < 0)
+            delta = -delta;
+        _rttvar += delta - (_rttvar >> 2);
+    }
+
+    _rto = (_srtt >> 3) + _rttvar;
+    if(_rto < RTO_MIN)
+        _rto = RTO_MIN;
+    else if(_rto > RTO_MAX)
+        _rto = RTO_MAX;
+
+    db<TCP>(INF) << "TCP::Connection::rtt(r=" << r << "): srtt=" << (_srtt >> 3) << ",rttvar=" << (_rttvar >> 2) << ",rto=" << _rto << endl;
+}
+
+// Processes the options in a SYN segment: the peer's MSS and, if it offered them too, window scale and SACK
+void TCP::Connection::negotiate()
+{
+    const unsigned char * o = _current->header()->option(SEGMENT_SIZE);
+    unsigned int mss = (o && (o[1] == 4)) ? (o[2] << 8 | o[3]) : 536; // RFC 1122's default
+    _mss = (mss < MSS) ? mss : MSS;
+    _congestion.mss(_mss);
+
+    o = _current->header()->option(WINDOW_SCALE);
+    _scaling = _scaling && o && (o[1] == 3);
+    _peer_shift = _scaling ? ((o[2] > 14) ? 14 : o[2]) : 0;
+
+    _sack = _sack && _current->header()->option(SACK_PERMITTED);
+
+    db<TCP>(INF) << "TCP::Connection::negotiate: mss=" << _mss << ",scale=" << (_scaling ? _peer_shift : -1) << ",sack=" << _sack << endl;
+}
+
 int TCP::Connection::receive(Buffer * pool, void * d, unsigned int s)
 {
     unsigned char * data = reinterpret_cast<unsigned char *>(d);
@@ -249,7 +510,7 @@ int TCP::Connection::receive(Buffer * pool, void * d, unsigned int s)
 
         unsigned int len = buf->size() - sizeof(IP::Header);
         if(el == head) {
-            len -= sizeof(Header);
+            len -= segment->size();
             memcpy(data, segment->data<void>(), len);
 
             db<TCP>(INF) << "TCP::receive:msg=" << segment << " => " << *segment << endl;
@@ -262,20 +523,51 @@ int TCP::Connection::receive(Buffer * pool, void * d, unsigned int s)
         size += len;
     }
 
-    pool->nic()->free(pool);
+    release(pool);
 
     return size;
 }
 
+void TCP::Connection::release(Buffer * pool)
+{
+    unsigned int size = payload_size(pool);
+
+    pool->nic()->free(pool);
+
+    lock();
+    _buffered -= size;
+    unsigned int free = (_buffered < WINDOW) ? WINDOW - _buffered : 0;
+    unsigned int current = (_edge > acknowledgment()) ? _edge - acknowledgment() : 0;
+    unlock();
+
+    // Window update, if the last window advertised might be throttling the peer and has grown by at least two segments (as in BSD)
+    unsigned int threshold = (2 * MSS < WINDOW / 2) ? 2 * MSS : WINDOW / 2;
+    if((current < WINDOW / 2) && (free >= current + threshold) && ((_state == ESTABLISHED) || (_state == FIN_WAIT1) || (_state == FIN_WAIT2)))
+        fsend(ACK);
+}
+
 void TCP::Connection::update(TCP::Observed * obs, unsigned long long socket, NIC::Buffer * pool)
 {
     db<TCP>(TRC) << "TCP::Connection::update(obs=" << obs << ",sock=" << hex << socket << ",buf=" << pool << ")" << endl;
 
+    if(process(socket, pool)) {
+        // The segment filled (part of) a gap, so the queued segments that became in order are processed
+        // as if they had just arrived and everything is acknowledged at once (RFC 5681)
+        for(Buffer * next = deliverable(); next; next = deliverable())
+            process(socket, next);
+        ack(true);
+    }
+}
+
+// Runs a segment through the state machine and delivers its payload to the observer.
+// Returns whether it was an in-order data segment received while there were out-of-order ones queued.
+bool TCP::Connection::process(unsigned long long socket, Buffer * pool)
+{
     Packet * packet = pool->frame()->data<Packet>();
 
     _current = packet->data<Segment>(); // FIXME should free the previous buffer
-    _length = pool->size() - sizeof(IP::Header) - sizeof(TCP::Header);
-    _peer_window = _current->header()->window();
+    _length = pool->size() - sizeof(IP::Header) - _current->header()->size();
+    _peer_window = _current->header()->window() << ((_current->header()->flags() & SYN) ? 0 : _peer_shift);
 
     db<TCP>(INF) << "TCP::Connection::update:" <<
         "SEQ.SEQ=" << _current->header()->sequence() <<
@@ -290,13 +582,19 @@ void TCP::Connection::update(TCP::Observed * obs, unsigned long long socket, NIC
         TCP::_observed.attach(this, id());
     }
 
+    if((_current->header()->flags() & SYN) && ((_state == LISTENING) || (_state == SYN_SENT)))
+        negotiate();
+
     db<TCP>(INF) << "TCP::Connection::update:conn=" << this << " => " << *this << endl;
 
-    if(!((_state == LISTENING) || (_state == SYN_SENT)) && _current->header()->sequence() > acknowledgment()) {
-        // SEG.SEQ musn't be > than RCV.NXT, this forces segments to be accepted in order, except when connecting or listening, then one may receive stuff out of the blue
+    if(_length && !((_state == LISTENING) || (_state == SYN_SENT)) && _current->header()->sequence() > acknowledgment()) {
+        // SEG.SEQ > RCV.NXT: data is accepted in order, so the segment is held until the gap before it is filled (if there is room for it)
+        // and a duplicate ACK is sent at once, so the sender learns about the gap (RFC 5681)
         // If SEG.SEQ < RCV.NXT, i.e. delayed or repeated segment, the treatment happens later
-        pool->nic()->free(pool);
-        return;
+        if(!(((_state == ESTABLISHED) || (_state == FIN_WAIT1) || (_state == FIN_WAIT2)) && reorder(pool)))
+            pool->nic()->free(pool);
+        ack(true);
+        return false;
     }
 
     if(_current->header()->acknowledgment() > _next) {
@@ -304,24 +602,14 @@ void TCP::Connection::update(TCP::Observed * obs, unsigned long long socket, NIC
         fsend(RST);
         state(CLOSED);
         pool->nic()->free(pool);
-        return;
+        return false;
     }
 
+    bool filling = _reordering && _length && (_current->header()->sequence() == acknowledgment());
+
     bool relevant = false; // The segment is relevant to the sliding window
-    if(_streaming) {
-        if(_current->header()->acknowledgment() <= sequence()) {
-            // Regular ack, i.e. SEG.ACK is <= than the last sequence I sent
-            if(_current->header()->acknowledgment() > _unacknowledged)
-                relevant = true; // A segment must ack something in order to be relevant
-
-            _unacknowledged = _current->header()->acknowledgment();
-        } else if(_current->header()->acknowledgment() > sequence()) {
-            // Forward ack, i.e. SEG.ACK > SEG.SEQ, but not > than the SND.NXT. This scenario is only possible in this code and in the FSM during retransmission
-            _sequence = htonl(_current->header()->acknowledgment());
-            _unacknowledged = _current->header()->acknowledgment();
-            relevant = true;
-        }
-    }
+    if(_streaming && (_current->header()->flags() & ACK))
+        relevant = acknowledge();
 
     State state_at_arrival = _state;
 
@@ -329,19 +617,178 @@ void TCP::Connection::update(TCP::Observed * obs, unsigned long long socket, NIC
 
     if(!_valid) {
         pool->nic()->free(pool);
-        return;
+        return false;
     }
 
     if((state_at_arrival == ESTABLISHED)
         || (state_at_arrival == SYN_RECEIVED)
         || (state_at_arrival == FIN_WAIT1)
         || (state_at_arrival == FIN_WAIT2))
-        if(_length)
-            if(!notify(socket, pool))
+        if(_length) {
+            unsigned int length = _length;
+            if(notify(socket, pool)) {
+                lock();
+                _buffered += length;
+                unlock();
+            } else
                 pool->nic()->free(pool);
+        }
 
-    if(_streaming && relevant)
-        _stream.signal();
+    if(relevant)
+        _stream.v();
+
+    return filling;
+}
+
+// Holds an out-of-order segment in the reordering queue, sorted by sequence number
+bool TCP::Connection::reorder(Buffer * pool)
+{
+    unsigned int sequence = _current->header()->sequence();
+
+    if((_reordering == REORDER) || (sequence + _length > acknowledgment() + WINDOW))
+        return false;
+
+    unsigned int i = 0;
+    while((i < _reordering) && (reordered(i)->sequence() < sequence))
+        i++;
+    if((i < _reordering) && (reordered(i)->sequence() == sequence))
+        return false; // duplicate
+
+    for(unsigned int j = _reordering; j > i; j--)
+        _reordered[j] = _reordered[j - 1];
+    _reordered[i] = pool;
+    _reordering++;
+    _latest = sequence;
+
+    lock();
+    _buffered += _length;
+    unlock();
+
+    db<TCP>(TRC) << "TCP::Connection::reorder(seq=" << sequence << ",len=" << _length << "): RCV.NXT=" << acknowledgment() << ",queued=" << _reordering << endl;
+
+    return true;
+}
+
+// Removes the first queued segment if it became in order, freeing the ones made obsolete on the way
+TCP::Buffer * TCP::Connection::deliverable()
+{
+    while(_reordering && (reordered(0)->sequence() <= acknowledgment())) {
+        Buffer * pool = _reordered[0];
+        bool in_order = (reordered(0)->sequence() == acknowledgment());
+
+        _reordering--;
+        for(unsigned int i = 0; i < _reordering; i++)
+            _reordered[i] = _reordered[i + 1];
+
+        lock();
+        _buffered -= payload_size(pool);
+        unlock();
+
+        if(in_order)
+            return pool;
+
+        pool->nic()->free(pool);
+    }
+
+    return 0;
+}
+
+// Fills up to four SACK blocks with the ranges held in the reordering queue, the one with the latest arrival first (RFC 2018)
+unsigned int TCP::Connection::selective(unsigned int blocks[][2])
+{
+    unsigned int ranges[REORDER ? REORDER : 1][2];
+    unsigned int n = 0;
+    for(unsigned int i = 0; i < _reordering; i++) {
+        unsigned int left = reordered(i)->sequence();
+        unsigned int right = left + payload_size(_reordered[i]);
+        if(n && (left <= ranges[n - 1][1])) {
+            if(right > ranges[n - 1][1])
+                ranges[n - 1][1] = right;
+        } else {
+            ranges[n][0] = left;
+            ranges[n][1] = right;
+            n++;
+        }
+    }
+
+    unsigned int latest = 0;
+    while((latest < n - 1) && !((ranges[latest][0] <= _latest) && (_latest < ranges[latest][1])))
+        latest++;
+
+    unsigned int count = 0;
+    blocks[count][0] = ranges[latest][0];
+    blocks[count][1] = ranges[latest][1];
+    count++;
+    for(unsigned int i = 0; (i < n) && (count < 4); i++)
+        if(i != latest) {
+            blocks[count][0] = ranges[i][0];
+            blocks[count][1] = ranges[i][1];
+            count++;
+        }
+
+    return count;
+}
+
+// Acknowledges received data at once, on every second segment, or when the delayed ACK timer expires (RFC 1122 and RFC 5681)
+void TCP::Connection::ack(bool now)
+{
+    if(now || !DELAYED_ACK || (++_pending >= 2)) {
+        fsend(ACK);
+        return;
+    }
+
+    if(!_delay)
+        _delay = new (SYSTEM) Alarm(DELAYED_ACK * 1000, &_delay_handler);
+}
+
+// Any segment sent carries an acknowledgment of all data received so far, so pending ones are dropped
+void TCP::Connection::acked()
+{
+    lock();
+    Alarm * delay = _delay;
+    _delay = 0;
+    _pending = 0;
+    unlock();
+
+    if(delay)
+        delete delay;
+}
+
+void TCP::Connection::delayed(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::Connection::delayed(connection=" << c << ",pending=" << c->_pending << ")" << endl;
+
+    c->lock();
+    Alarm * delay = c->_delay;
+    c->_delay = 0;
+    c->unlock();
+
+    if(!delay)
+        return;
+
+    delete delay;
+    c->fsend(ACK);
+}
+
+// Receive window: the free buffer space, scaled on all but SYN segments,
+// but not growing by less than min(WINDOW / 2, MSS) to avoid the silly window syndrome (RFC 1122)
+unsigned int TCP::Connection::advertised(bool syn)
+{
+    unsigned int shift = (_scaling && !syn) ? SCALE : 0;
+    unsigned int free = (_buffered < WINDOW) ? WINDOW - _buffered : 0;
+    unsigned int current = (_edge > acknowledgment()) ? _edge - acknowledgment() : 0;
+    unsigned int threshold = (WINDOW / 2 < MSS) ? WINDOW / 2 : MSS;
+
+    if((free > current) && (free - current < threshold))
+        free = current;
+
+    unsigned int window = free >> shift;
+    if(window > 0xffff)
+        window = 0xffff;
+
+    _edge = acknowledgment() + (window << shift);
+
+    return window;
 }
 
 void TCP::Connection::listen()
@@ -351,6 +798,7 @@ void TCP::Connection::listen()
     state(LISTENING);
     _transition.wait();
 
+    _timer = TSC::time_stamp();
     fsend(SYN | ACK);
     _unacknowledged = _initial;
     state(SYN_RECEIVED);
@@ -363,9 +811,10 @@ void TCP::Connection::connect()
     db<TCP>(TRC) << "TCP::Connection::connect(from=" << hex << from() << ",to=" << peer() << ":" << to() << ")" << endl;
 
     state(SYN_SENT);
+    _timer = TSC::time_stamp();
     fsend(SYN);
     _unacknowledged = sequence();
-    set_timeout();
+    set_timeout(_rto);
     _transition.wait();
 }
 
@@ -384,7 +833,7 @@ void TCP::Connection::close()
         else if(_state == CLOSE_WAIT)
             state(LAST_ACK);
         fsend(ACK | FIN);
-        set_timeout(TIMEOUT / 2);
+        set_timeout(_rto);
         _transition.wait();
     }
 }
@@ -442,6 +891,9 @@ void TCP::Connection::syn_sent()
                 if(_unacknowledged > _initial) {
                     db<TCP>(INF) << "TCP::Connection::syn_sent: connection established!" << endl;
 
+                    if(!_tries) // the SYN was not retransmitted, so its round trip is a valid RTT sample
+                        rtt(TSC::time_stamp() - _timer);
+
                     fsend(ACK);
                     state(ESTABLISHED);
                     _tries = 0;
@@ -514,12 +966,13 @@ void TCP::Connection::syn_received()
             && (_current->header()->acknowledgment() <= _next)) {
             db<TCP>(INF) << "TCP::Connection::syn_received: connection established!" << endl;
 
+            rtt(TSC::time_stamp() - _timer);
             state(ESTABLISHED);
             _tries = 0;
 
             if(_length) {
                 _acknowledgment = htonl(acknowledgment() + _length);
-                fsend(ACK);
+                ack();
             }
 
             _transition.signal();
@@ -576,7 +1029,7 @@ void TCP::Connection::established()
 
             if(_length) {
                 _acknowledgment = htonl(acknowledgment() + _length);
-                fsend(ACK);
+                ack();
             }
 
             if(_current->header()->flags() & FIN) {
@@ -622,7 +1075,7 @@ void TCP::Connection::fin_wait1()
 
         if(_length) {
             _acknowledgment = htonl(acknowledgment() + _length);
-            fsend(ACK);
+            ack();
         }
 
         if(_current->header()->acknowledgment() >= _next) { // our FIN has been acknowledged
@@ -631,7 +1084,7 @@ void TCP::Connection::fin_wait1()
             if(_current->header()->flags() & FIN) {
                 process_fin();
                 state(TIME_WAIT);
-                set_timeout();
+                set_timeout(TIMEOUT);
 
                 db<TCP>(TRC) << "TCP::Connection::fin_wait1-->time_wait" << endl;
             } else {
@@ -681,13 +1134,13 @@ void TCP::Connection::fin_wait2()
     if(_current->header()->flags() & ACK) {
         if(_length) {
             _acknowledgment = htonl(acknowledgment() + _length);
-            fsend(ACK);
+            ack();
         }
 
         if(_current->header()->flags() & FIN) {
             process_fin();
             state(TIME_WAIT);
-            set_timeout();
+            set_timeout(TIMEOUT);
 
             db<TCP>(TRC) << "TCP::Connection::fin_wait2-->time_wait" << endl;
         }
@@ -770,7 +1223,7 @@ void TCP::Connection::closing()
         db<TCP>(TRC) << "TCP::Connection:closing-->time_wait" << endl;
 
         state(TIME_WAIT);
-        set_timeout();
+        set_timeout(TIMEOUT);
     }
 }
 
@@ -843,7 +1296,7 @@ void TCP::Connection::time_wait()
         && (_current->header()->acknowledgment() <= _next)
         && (_current->header()->flags() & FIN)) {
         process_fin();
-        set_timeout();
+        set_timeout(TIMEOUT);
     }
 }
 
@@ -952,7 +1405,8 @@ void TCP::Connection::timeout(Connection* c)
         c->_tries++;
         c->_next--;
         c->fsend(FIN | ACK);
-        c->set_timeout(1000 * 1000 * 2.5);
+        c->backoff();
+        c->set_timeout(c->_rto);
         return;
     }
 
@@ -961,7 +1415,8 @@ void TCP::Connection::timeout(Connection* c)
         c->_tries++;
         c->_next--;
         c->fsend(SYN);
-        c->set_timeout();
+        c->backoff();
+        c->set_timeout(c->_rto);
         return;
     }
 }
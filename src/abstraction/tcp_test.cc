@@ -0,0 +1,61 @@
+// EPOS TCP Header Options Test Program
+
+#include <utility/ostream.h>
+#include <utility/string.h>
+#include <tcp.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+unsigned int edge(const unsigned char * o) { return (o[0] << 24) | (o[1] << 16) | (o[2] << 8) | o[3]; }
+
+int main()
+{
+    cout << "TCP Header Options Test" << endl;
+
+    int failures = 0;
+
+    // RCV.NXT = 1000, while [2000, 2500) and then [3000, 3100) arrived out of order, so the ACK
+    // carries the block holding the latest arrival first
+    const unsigned int blocks[2][2] = { { 3000, 3100 }, { 2000, 2500 } };
+
+    // Whatever the buffer held before must not show up in the options
+    unsigned char segment[sizeof(TCP::Header) + 40];
+    memset(segment, 0xff, sizeof(segment));
+
+    TCP::Header * header = new (segment) TCP::Header(8000, 8001, 500, 1024);
+    header->flags(TCP::Header::ACK);
+    header->sack(blocks, 2);
+
+    cout << "Header size=" << header->size() << " (expected " << sizeof(TCP::Header) + 20 << ")" << endl;
+    if(header->size() != sizeof(TCP::Header) + 20)
+        failures++;
+
+    const unsigned char expected[20] = { TCP::Header::NOP, TCP::Header::NOP, TCP::Header::SELECTIVE_ACK, 18,
+                                         0, 0, 0x0b, 0xb8, 0, 0, 0x0c, 0x1c,    // 3000, 3100
+                                         0, 0, 0x07, 0xd0, 0, 0, 0x09, 0xc4 };  // 2000, 2500
+    const unsigned char * o = segment + sizeof(TCP::Header);
+    for(unsigned int i = 0; i < sizeof(expected); i++)
+        if(o[i] != expected[i]) {
+            cout << "  option byte " << i << " is " << o[i] << " instead of " << expected[i] << "!" << endl;
+            failures++;
+        }
+
+    // The receiver's side must find the same blocks
+    const unsigned char * sack = header->option(TCP::Header::SELECTIVE_ACK);
+    if(!sack || (sack[1] != 18)) {
+        cout << "  SACK option not found!" << endl;
+        failures++;
+    } else
+        for(unsigned int i = 0; i < 2; i++) {
+            cout << "  block " << i << "=[" << edge(&sack[2 + 8 * i]) << "," << edge(&sack[6 + 8 * i]) << ")" << endl;
+            if((edge(&sack[2 + 8 * i]) != blocks[i][0]) || (edge(&sack[6 + 8 * i]) != blocks[i][1]))
+                failures++;
+        }
+
+    cout << (failures ? "Failed!" : "Passed!") << endl;
+    cout << "The end!" << endl;
+
+    return 0;
+}
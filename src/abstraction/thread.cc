@@ -3,6 +3,7 @@
 #include <machine.h>
 #include <system.h>
 #include <thread.h>
+#include <profiler.h>
 #include <alarm.h> // for FCFS
 
 // This_Thread class attributes
@@ -17,6 +18,7 @@ volatile unsigned int Thread::_thread_count;
 Scheduler_Timer * Thread::_timer;
 Scheduler<Thread> Thread::_scheduler;
 Spin Thread::_lock;
+Thread * volatile Thread::_leaving[Traits<Machine>::CPUS];
 
 // Methods
 void Thread::constructor_prologue(const Color & color, unsigned int stack_size)
@@ -26,10 +28,14 @@ void Thread::constructor_prologue(const Color & color, unsigned int stack_size)
     _thread_count++;
     _scheduler.insert(this);
 
+    _color = color;
     if(Traits<MMU>::colorful && color != WHITE)
         _stack = new (color) char[stack_size];
     else
         _stack = new (SYSTEM) char[stack_size];
+
+    if(PMU::virtualized)
+        Profiler::insert(this);
 }
 
 
@@ -102,6 +108,11 @@ Thread::~Thread()
     if(_joining)
         _joining->resume();
 
+    CPU::fpu_release(&_fpu);
+
+    if(PMU::virtualized)
+        Profiler::remove(this);
+
     unlock();
 
     delete _stack;
@@ -116,12 +127,14 @@ void Thread::priority(const Priority & c)
 
     unsigned int old_cpu = _link.rank().queue();
 
+    // The criterion might move the thread to another queue, so it must leave the current one first
+    if(_state != RUNNING)
+        _scheduler.remove(this);
+
     _link.rank(Criterion(c));
 
-    if(_state != RUNNING) {
-        _scheduler.remove(this);
+    if(_state != RUNNING)
         _scheduler.insert(this);
-    }
 
     if(preemptive) {
         reschedule(old_cpu);
@@ -133,6 +146,53 @@ void Thread::priority(const Priority & c)
 }
 
 
+void Thread::update_criterion()
+{
+    lock();
+
+    db<Thread>(TRC) << "Thread::update_criterion(this=" << this << ")" << endl;
+
+    // Heap-based scheduling queues only compare ranks on insertion, so a ready thread must be reinserted
+    if(_state == READY) {
+        _scheduler.remove(this);
+        criterion().update();
+        _scheduler.insert(this);
+    } else
+        criterion().update();
+
+    unlock();
+}
+
+
+// Changes the priority this thread is scheduled with, but not the rest of its criterion (e.g. a deadline), on behalf of
+// priority inheritance and ceiling protocols (see Mutex), re-queueing it wherever it is waiting
+void Thread::inherit(int p)
+{
+    // lock() must be called before entering this method
+    assert(locked());
+
+    if(criterion()._priority == p)
+        return;
+
+    db<Thread>(TRC) << "Thread::inherit(this=" << this << ",prio=" << criterion()._priority << "=>" << p << ")" << endl;
+
+    switch(_state) {
+    case READY:
+        _scheduler.remove(this);
+        criterion()._priority = p;
+        _scheduler.insert(this);
+        break;
+    case WAITING:
+        _waiting->remove(this);
+        criterion()._priority = p;
+        _waiting->insert(&_link);
+        break;
+    default: // the running thread is only reinserted when the scheduler chooses another one
+        criterion()._priority = p;
+    }
+}
+
+
 int Thread::join()
 {
     lock();
@@ -354,11 +414,24 @@ void Thread::time_slicer(const IC::Interrupt_Id & i)
 void Thread::dispatch(Thread * prev, Thread * next, bool charge)
 {
     if(charge) {
-        if(Criterion::timed)
-            _timer->reset();
+        if(Criterion::timed) {
+            // A tickless quantum is only armed when someone else is ready to take the CPU
+            if(Scheduler_Timer::tickless && !_scheduler.contended())
+                _timer->arm(0);
+            else
+                _timer->reset();
+        }
     }
 
     if(prev != next) {
+        // prev's context will only be saved by switch_context(), so thieves must not take it
+        // until this CPU dispatches again (see Scheduler::steal()). Stores are not reordered on
+        // SMP IA32, so a thief that sees prev READY will also see it here. And since this CPU
+        // only replaces it at its next dispatch, a thief that sees another thread here knows
+        // that any READY thread it sees has already been saved
+        if(stealing)
+            _leaving[Machine::cpu_id()] = prev;
+
         if(prev->_state == RUNNING)
             prev->_state = READY;
         next->_state = RUNNING;
@@ -373,6 +446,14 @@ void Thread::dispatch(Thread * prev, Thread * next, bool charge)
         if(multitask && (next->_task != prev->_task))
             next->_task->activate();
 
+        if(Page_Coloring::partitioning)
+            Page_Coloring::charge(prev->_color);
+
+        if(PMU::virtualized)
+            PMU::account(&prev->_pmu);
+
+        CPU::fpu_switch(&prev->_fpu, &next->_fpu);
+
         CPU::switch_context(&prev->_context, next->_context);
     } else
         if(smp)
@@ -388,6 +469,11 @@ int Thread::idle()
         if(Traits<Thread>::trace_idle)
             db<Thread>(TRC) << "Thread::idle(CPU=" << Machine::cpu_id() << ",this=" << running() << ")" << endl;
 
+        if(stealing && steal()) { // Pull a READY thread from a busy neighbour instead of halting
+            yield();
+            continue;
+        }
+
         CPU::int_enable();
         CPU::halt();
         if(_scheduler.schedulables() > 0) // A thread might have been woken up by another CPU
@@ -408,12 +494,37 @@ int Thread::idle()
     return 0;
 }
 
+
+bool Thread::steal()
+{
+    Thread * stolen = 0;
+
+    CPU::int_disable();
+
+    for(unsigned int i = 1; !stolen && (i < Machine::n_cpus()); i++) {
+        unsigned int victim = (Machine::cpu_id() + i) % Machine::n_cpus();
+        stolen = _scheduler.steal(victim, &_leaving[victim]);
+    }
+
+    CPU::int_enable();
+
+    if(stolen)
+        db<Thread>(TRC) << "Thread::steal(CPU=" << Machine::cpu_id() << ") => " << stolen << endl;
+
+    return stolen;
+}
+
 __END_SYS
 
-// Id forwarder to the spin lock
+// Id forwarders to the spin lock and the heap
 __BEGIN_UTIL
 unsigned int This_Thread::id()
 {
     return _not_booting ? reinterpret_cast<volatile unsigned int>(Thread::self()) : Machine::cpu_id() + 1;
 }
+
+unsigned int This_CPU::id()
+{
+    return Machine::cpu_id();
+}
 __END_UTIL
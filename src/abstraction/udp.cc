@@ -8,7 +8,7 @@
 __BEGIN_SYS
 
 // Class attributes
-UDP::Observed UDP::_observed;
+UDP::Demux UDP::_observed;
 
 // Methods
 int UDP::send(const Port & from, const Address & to, const void * d, unsigned int s)
@@ -18,38 +18,65 @@ int UDP::send(const Port & from, const Address & to, const void * d, unsigned in
 
     db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",d=" << data << ",s=" << size << ")" << endl;
 
-    Buffer * pool = IP::alloc(to.ip(), IP::UDP, sizeof(Header), size);
+    Buffer * pool = alloc(to, size);
     if(!pool)
         return 0;
 
-    Message * message = 0;
+    Packet * packet = pool->frame()->data<Packet>();
+    Message * message = packet->data<Message>();
+    new(message) Header(from, to.port(), size);
+    message->sum_header(packet->from(), packet->to());
+
     unsigned int headers = sizeof(Header);
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
         Buffer * buf = el->object();
-        Packet * packet = buf->frame()->data<Packet>();
+        unsigned int len = payload_size(buf);
 
         db<UDP>(INF) << "UDP::send:buf=" << buf << " => " << *buf<< endl;
 
-        if(el == pool->link()) {
-            message = packet->data<Message>();
-            new(packet->data<void>()) Header(from, to.port(), size);
-            message->sum_header(packet->from(), packet->to());
-            memcpy(message->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            message->sum_data(data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            data += buf->size() - sizeof(Header) - sizeof(IP::Header);
-
-            db<UDP>(INF) << "UDP::send:msg=" << message << " => " << *message << endl;
-        } else {
-            memcpy(packet->data<void>(), data, buf->size() - sizeof(IP::Header));
-            message->sum_data(data, buf->size() - sizeof(IP::Header));
-            data += buf->size() - sizeof(IP::Header);
-        }
+        message->copy_data(payload(buf), data, len);
+        data += len;
+
+        headers += sizeof(IP::Header);
+    }
+
+    message->sum_trailer();
+
+    db<UDP>(INF) << "UDP::send:msg=" << message << " => " << *message << endl;
+
+    return IP::send(pool) - headers; // implicitly releases the pool
+}
+
+
+UDP::Buffer * UDP::alloc(const Address & to, unsigned int size)
+{
+    db<UDP>(TRC) << "UDP::alloc(t=" << to << ",s=" << size << ")" << endl;
+
+    return IP::alloc(to.ip(), IP::UDP, sizeof(Header), (size > sizeof(Data)) ? sizeof(Data) : size);
+}
+
 
+int UDP::send(const Port & from, const Address & to, Buffer * pool)
+{
+    db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",buf=" << pool << ")" << endl;
+
+    unsigned int size = 0;
+    unsigned int headers = sizeof(Header);
+    for(Buffer::Element * el = pool->link(); el; el = el->next()) {
+        size += payload_size(el->object());
         headers += sizeof(IP::Header);
     }
 
+    Packet * packet = pool->frame()->data<Packet>();
+    Message * message = packet->data<Message>();
+    new(message) Header(from, to.port(), size);
+    message->sum_header(packet->from(), packet->to());
+    for(Buffer::Element * el = pool->link(); el; el = el->next())
+        message->sum_data(payload(el->object()), payload_size(el->object()));
     message->sum_trailer();
 
+    db<UDP>(INF) << "UDP::send:msg=" << message << " => " << *message << endl;
+
     return IP::send(pool) - headers; // implicitly releases the pool
 }
 
@@ -98,6 +125,46 @@ int UDP::receive(Buffer * pool, void * d, unsigned int s)
 }
 
 
+int UDP::receive(Buffer * pool)
+{
+    db<UDP>(TRC) << "UDP::receive(buf=" << pool << ")" << endl;
+
+    Message * message = pool->frame()->data<Packet>()->data<Message>();
+    if(!message->check()) {
+        db<UDP>(WRN) << "UDP::receive: wrong message checksum!" << endl;
+        release(pool);
+        return -1;
+    }
+
+    unsigned int size = 0;
+    for(Buffer::Element * el = pool->link(); el; el = el->next())
+        size += payload_size(el->object());
+
+    // There's nothing to lend in an empty datagram
+    if(!size)
+        release(pool);
+
+    return size;
+}
+
+
+void * UDP::payload(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+    if(packet->offset() == 0) // the first fragment carries the UDP header
+        return packet->data<Message>()->data<void>();
+    else
+        return packet->data<void>();
+}
+
+
+unsigned int UDP::payload_size(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+    return buf->size() - sizeof(IP::Header) - ((packet->offset() == 0) ? sizeof(Header) : 0);
+}
+
+
 void UDP::update(IP::Observed * obs, IP::Protocol prot, Buffer * pool)
 {
     db<UDP>(TRC) << "UDP::update(obs=" << obs << ",prot=" << prot << ",buf=" << pool << ")" << endl;
@@ -117,45 +184,28 @@ void UDP::Message::sum_header(const IP::Address & from, const IP::Address & to)
     _checksum = 0;
     if(Traits<UDP>::checksum) {
         IP::Pseudo_Header pseudo(from, to, IP::UDP, length());
-        unsigned long sum = 0;
-
-        const unsigned char * ptr = reinterpret_cast<const unsigned char *>(&pseudo);
-        for(unsigned int i = 0; i < sizeof(IP::Pseudo_Header); i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-
-        ptr = reinterpret_cast<const unsigned char *>(header());
-        for(unsigned int i = 0; i < sizeof(Header); i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-
-        _checksum = sum;
+        _checksum = IP::sum(header(), sizeof(Header), IP::sum(&pseudo, sizeof(IP::Pseudo_Header)));
     }
 }
 
 void UDP::Message::sum_data(const void * data, unsigned int size)
 {
-    if(Traits<UDP>::checksum) {
-        unsigned long sum = _checksum;
-
-        const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
-        for(unsigned int i = 0; i < size; i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-        if(size & 1)
-            sum += ptr[size - 1];
+    if(Traits<UDP>::checksum)
+        _checksum = IP::sum(data, size, _checksum);
+}
 
-        _checksum = sum;
-    }
+void UDP::Message::copy_data(void * to, const void * from, unsigned int size)
+{
+    if(Traits<UDP>::checksum)
+        _checksum = IP::copy_and_sum(to, from, size, _checksum);
+    else
+        memcpy(to, from, size);
 }
 
 void UDP::Message::sum_trailer()
 {
-    if(Traits<UDP>::checksum) {
-        unsigned long sum = _checksum;
-
-        while(sum >> 16)
-            sum = (sum & 0xffff) + (sum >> 16);
-
-        _checksum = htons(~sum);
-    }
+    if(Traits<UDP>::checksum)
+        _checksum = htons(~_checksum);
 }
 
 __END_SYS
@@ -10,6 +10,8 @@ __BEGIN_SYS
 // Class attributes
 unsigned int IA32::_cpu_clock;
 unsigned int IA32::_bus_clock;
+IA32::FPU_Context * IA32::_fpu_owner[Traits<Build>::CPUS];
+IA32::FPU_Context * IA32::_fpu_running[Traits<Build>::CPUS];
 
 // Class methods
 void IA32::Context::save() volatile
@@ -89,6 +91,80 @@ void IA32::switch_context(Context * volatile * o, Context * volatile n)
         "       iret                                            \n");
 }
 
+void IA32::lazy_fpu_switch(FPU_Context * prev, FPU_Context * next)
+{
+    unsigned int cpu = Machine::cpu_id();
+
+    // Before the first dispatch on this CPU, whatever is in the FPU belongs to the thread that was running
+    if(!_fpu_running[cpu]) {
+        _fpu_owner[cpu] = prev;
+        prev->_used = true;
+    }
+
+    // Threads migrate among CPUs, so on multicores the state of the outgoing thread cannot be left behind in this CPU's FPU
+    if(Traits<System>::multicore && (_fpu_owner[cpu] == prev)) {
+        prev->save();
+        _fpu_owner[cpu] = 0;
+    }
+
+    _fpu_running[cpu] = next;
+
+    // If the FPU still holds next's state (e.g. no other thread touched it since next last ran), it won't even trap
+    Reg32 cr = cr0();
+    if(_fpu_owner[cpu] == next) {
+        if(cr & CR0_TS)
+            clts();
+    } else if(!(cr & CR0_TS))
+        cr0(cr | CR0_TS);
+}
+
+void IA32::fpu_release(FPU_Context * c)
+{
+    for(unsigned int i = 0; i < Traits<Build>::CPUS; i++)
+        if(_fpu_owner[i] == c)
+            _fpu_owner[i] = 0;
+}
+
+void IA32::fpu_handover()
+{
+    clts();
+
+    unsigned int cpu = Machine::cpu_id();
+    FPU_Context * owner = _fpu_owner[cpu];
+    FPU_Context * running = _fpu_running[cpu];
+
+    if(owner == running)
+        return;
+
+    if(owner)
+        owner->save();
+
+    if(running->_used)
+        running->load();
+    else {
+        // First use: start with a clean x87 stack and all exceptions masked (SSE registers are not cleared)
+        Reg32 mxcsr = 0x1f80;
+        ASM("fninit                                             \n"
+            "ldmxcsr %0                                         \n" : : "m"(mxcsr));
+        running->_used = true;
+    }
+
+    _fpu_owner[cpu] = running;
+
+    db<CPU>(TRC) << "CPU::fpu_handover(owner=" << owner << ",running=" << running << ")" << endl;
+}
+
+void IA32::fpu_trap()
+{
+    // We get here through an interrupt gate (i.e. with interrupts disabled) when the running thread
+    // executes an FPU/SSE instruction with CR0.TS set (#NM, which pushes no error code)
+    // Stack contents at this point are: [ss, esp,] eflags, cs, eip
+    ASM("       pusha                                           \n");
+    ASM("       call    *%0                                     \n"
+        "       popa                                            \n"
+        "       iret                                            \n" : : "c"(&fpu_handover));
+}
+
 void IA32::syscalled()
 {
     // We get here when an APP triggers INT_SYSCALL with the message address in CX
@@ -0,0 +1,90 @@
+// EPOS IA32 Lazy FPU Context Switch Test Program
+
+#include <utility/ostream.h>
+#include <thread.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const int THREADS = 4;
+const int ITERATIONS = 10000;
+
+OStream cout;
+
+double expected(int n);
+int compute(int n);
+int yield(int n);
+
+int main()
+{
+    cout << "IA32 Lazy FPU Context Switch Test" << endl;
+    cout << "Threads interleave floating-point computations with yields, so their results are only right if each one gets its own FPU context." << endl;
+
+    Thread * threads[THREADS];
+    for(int i = 0; i < THREADS; i++)
+        threads[i] = new Thread(&compute, i);
+
+    // main also computes with the FPU across the joins. Operands and results go through memory, so the
+    // division happens at run time and both quotients are rounded to double alike (the x87 computes in 80 bits)
+    volatile double one = 1.0;
+    volatile double three = 3.0;
+    volatile double check = one / three;
+
+    int failures = 0;
+    for(int i = 0; i < THREADS; i++) {
+        int ok = threads[i]->join();
+        cout << "Thread " << i << ": " << (ok ? "ok" : "wrong result!") << endl;
+        failures += !ok;
+        delete threads[i];
+    }
+    volatile double again = one / three;
+    if(check != again) {
+        cout << "main: wrong result!" << endl;
+        failures++;
+    }
+
+    // Threads that never touch the FPU shouldn't pay for it: dispatching them only sets CR0.TS
+    Chronometer chrono;
+    chrono.start();
+    for(int i = 0; i < THREADS; i++)
+        threads[i] = new Thread(&yield, i);
+    for(int i = 0; i < THREADS; i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    chrono.stop();
+    cout << "Integer-only yields: " << chrono.read() * 1000 / (THREADS * ITERATIONS) << " ns/yield" << endl;
+
+    cout << (failures ? "Failed!" : "Passed!") << endl;
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+double expected(int n)
+{
+    double sum = 0;
+    for(int i = 1; i <= ITERATIONS; i++)
+        sum += (n + 1.0) / i;
+    return sum;
+}
+
+int compute(int n)
+{
+    double sum = 0;
+    for(int i = 1; i <= ITERATIONS; i++) {
+        sum += (n + 1.0) / i;
+        if(!(i % 100))
+            Thread::yield();
+    }
+
+    return (sum == expected(n));
+}
+
+int yield(int n)
+{
+    for(int i = 0; i < ITERATIONS; i++)
+        Thread::yield();
+
+    return n;
+}
@@ -5,7 +5,97 @@
 __BEGIN_SYS
 
 // Class attributes
-IA32_MMU::List IA32_MMU::_free[colorful * COLORS + 1];
+IA32_MMU::Buddy IA32_MMU::_free[colorful * COLORS + 1];
+IA32_MMU::Buddy::Element * IA32_MMU::_blocks;
+unsigned int IA32_MMU::_memory_frames;
 IA32_MMU::Page_Directory * IA32_MMU::_master;
+unsigned short * IA32_MMU::_shares;
+Spin IA32_MMU::_lock;
+
+// Class methods
+IA32_MMU::Phy_Addr IA32_MMU::Buddy::alloc(unsigned int n)
+{
+    unsigned int order = 0;
+    while((order < ORDERS) && ((1U << order) < n))
+        order++;
+
+    unsigned int o = order;
+    while((o < ORDERS) && _free[o].empty())
+        o++;
+    if(o >= ORDERS)
+        return Phy_Addr(false);
+
+    unsigned int frame = _free[o].head() - _blocks;
+    remove(frame, o);
+
+    // Split the block keeping its upper half, so free regions are consumed from their top (like the old free lists did)
+    while(o > order) {
+        o--;
+        insert(frame, o);
+        frame += 1 << o;
+    }
+
+    // Give back the head of the block that exceeds n (blocks of 2^k frames for k >= order stay aligned to 2^order)
+    unsigned int spare = (1 << order) - n;
+    if(spare) {
+        free(frame << PAGE_SHIFT, spare);
+        frame += spare;
+    }
+
+    return frame << PAGE_SHIFT;
+}
+
+void IA32_MMU::Buddy::free(const Phy_Addr & addr, unsigned int n)
+{
+    unsigned int frame = addr >> PAGE_SHIFT;
+
+    while(n) {
+        // Largest aligned block starting at frame that fits in the run
+        unsigned int order = 0;
+        while((order + 1 < ORDERS) && !(frame & ((1 << (order + 1)) - 1)) && ((1U << (order + 1)) <= n))
+            order++;
+
+        // Merge it with its buddy for as long as the buddy is free (and in this list)
+        unsigned int block = frame;
+        unsigned int o = order;
+        while(o + 1 < ORDERS) {
+            unsigned int buddy = block ^ (1 << o);
+            if((buddy >= _memory_frames) || (_blocks[buddy].rank() != tag(o)))
+                break;
+            remove(buddy, o);
+            block &= ~(1 << o);
+            o++;
+        }
+        insert(block, o);
+
+        frame += 1 << order;
+        n -= 1 << order;
+    }
+}
+
+void IA32_MMU::Buddy::statistics(Statistics * s) const
+{
+    s->free = _frames;
+    s->largest = largest();
+    for(unsigned int o = 0; o < ORDERS; o++)
+        s->blocks[o] = _free[o].size();
+    s->fragmentation = _frames ? (_frames - s->largest) * 100 / _frames : 0;
+}
+
+void IA32_MMU::Buddy::insert(unsigned int frame, unsigned int order)
+{
+    Element * e = &_blocks[frame];
+    e->rank(tag(order));
+    _free[order].insert_head(e);
+    _frames += 1 << order;
+}
+
+void IA32_MMU::Buddy::remove(unsigned int frame, unsigned int order)
+{
+    Element * e = &_blocks[frame];
+    _free[order].remove(e);
+    e->rank(0);
+    _frames -= 1 << order;
+}
 
 __END_SYS
@@ -20,10 +20,21 @@ void IA32_MMU::init()
     db<Init, MMU>(INF) << "MMU::free3={base=" << reinterpret_cast<void *>(si->pmm.free3_base) << ",size="
                        << (si->pmm.free3_top - si->pmm.free3_base) / 1024 << "KB}" << endl;
 
+    // Allocate the buddy allocator's element table (an element per frame) from the largest free region
+    _memory_frames = si->bm.mem_top >> PAGE_SHIFT;
+    unsigned int table = pages(_memory_frames * sizeof(Buddy::Element)) * sizeof(Page);
+    _blocks = phy2log(si->pmm.free3_base);
+    memset(_blocks, 0, table);
+    si->pmm.free3_base += table;
+    for(unsigned int i = 0; i < colorful * COLORS + 1; i++)
+        _free[i].color(Color(i));
+    db<Init, MMU>(INF) << "MMU::blocks=" << _blocks << " (" << _memory_frames << " frames)" << endl;
+
     // BIG NOTE HERE: INIT (i.e. this program) will be part of the free
     // storage after the following is executed, but it will remain alive
-    // This only works because the _free.insert_merging() only
-    // touches the first page of each chunk and INIT is not there
+    // This only works because the buddy allocator keeps its lists in _blocks,
+    // never touching free frames, and allocates from the top of each block,
+    // while INIT is at the bottom of free2
 
     if(colorful) {
         int f1b = si->pmm.free1_base;
@@ -66,7 +77,7 @@ void IA32_MMU::init()
                 f3b = f3t = 0;
             }
         }
-        if((size > 0) || (_free[WHITE].grouped_size() * MMU::PAGE_SIZE < Traits<System>::HEAP_SIZE))
+        if((size > 0) || (_free[WHITE].frames() * MMU::PAGE_SIZE < Traits<System>::HEAP_SIZE))
             db<Init, MMU>(ERR) << "MMU::int: System's heap size (Traits<System>::HEAP_SIZE=" << Traits<System>::HEAP_SIZE << ") is larger than memory!" << endl;
 
         // Insert the remaining free memory into the _free[color] lists
@@ -94,6 +105,12 @@ void IA32_MMU::init()
         free(si->pmm.free3_base, pages(si->pmm.free3_top - si->pmm.free3_base));
     }
 
+    // Allocate a sharing counter for each frame, so chunks can share them copy-on-write (see Chunk(origin, flags))
+    Phy_Addr shares = calloc(pages(_memory_frames * sizeof(unsigned short)));
+    if(shares)
+        _shares = phy2log(shares);
+    db<Init, MMU>(INF) << "MMU::shares=" << _shares << " (" << _memory_frames << " frames)" << endl;
+
     // Remember the master page directory (created during SETUP)
     _master = reinterpret_cast<Page_Directory *>(CPU::pdp());
 
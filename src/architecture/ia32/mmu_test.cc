@@ -0,0 +1,75 @@
+// EPOS IA32 MMU Frame Allocator Test Program
+
+#include <utility/ostream.h>
+#include <cpu.h>
+#include <mmu.h>
+
+using namespace EPOS;
+
+const unsigned int RUNS = 64;
+
+OStream cout;
+
+void print(const MMU::Statistics & s);
+
+int main()
+{
+    cout << "IA32 MMU Frame Allocator Test" << endl;
+
+    MMU::Statistics before = MMU::statistics();
+    print(before);
+
+    int failures = 0;
+
+    // Runs of any length come out contiguous, and those of 2^k frames aligned to 2^k frames
+    cout << "Allocating " << RUNS << " runs of 1 to " << RUNS << " frames:" << endl;
+    CPU::Phy_Addr runs[RUNS];
+    for(unsigned int i = 0; i < RUNS; i++) {
+        unsigned int n = i + 1;
+        unsigned int align = (n & (n - 1)) ? 1 : n;
+        runs[i] = MMU::alloc(n);
+        if(!runs[i] || ((runs[i] / sizeof(MMU::Page)) & (align - 1))) {
+            cout << "  run " << i << " => " << runs[i] << " is wrong!" << endl;
+            failures++;
+        }
+    }
+    print(MMU::statistics());
+
+    // Freeing every other run first and then the rest must merge everything back
+    cout << "Freeing them:" << endl;
+    for(unsigned int i = 0; i < RUNS; i += 2)
+        MMU::free(runs[i], i + 1);
+    for(unsigned int i = 1; i < RUNS; i += 2)
+        MMU::free(runs[i], i + 1);
+    MMU::Statistics after = MMU::statistics();
+    print(after);
+    if((after.free != before.free) || (after.largest != before.largest)) {
+        cout << "  frames weren't merged back!" << endl;
+        failures++;
+    }
+
+    // A run of PT_ENTRIES frames is what a 4 MiB page needs
+    CPU::Phy_Addr large = MMU::alloc(MMU::PT_ENTRIES);
+    cout << "Large page => " << large << endl;
+    if(large && (large & (MMU::LARGE_PAGE - 1))) {
+        cout << "  isn't aligned!" << endl;
+        failures++;
+    }
+    if(large)
+        MMU::free(large, MMU::PT_ENTRIES);
+
+    cout << (failures ? "Failed!" : "Passed!") << endl;
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+void print(const MMU::Statistics & s)
+{
+    cout << "  free=" << s.free << " frames, largest block=" << s.largest << " frames, fragmentation=" << s.fragmentation << "%" << endl;
+    cout << "  blocks:";
+    for(unsigned int o = 0; o < MMU::ORDERS; o++)
+        if(s.blocks[o])
+            cout << " " << (1 << o) << "x" << s.blocks[o];
+    cout << endl;
+}
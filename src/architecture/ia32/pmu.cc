@@ -1,6 +1,7 @@
 // EPOS IA32 PMU Mediator Implementation
 
 #include <architecture/ia32/pmu.h>
+#include <machine.h>
 
 __BEGIN_SYS
 
@@ -20,4 +21,81 @@ const CPU::Reg32 Intel_PMU_V1::_events[EVENTS] = {
                          /* L3_MISS            */ LLC_MISSES,
 };
 
+const PMU_Common::Channel IA32_PMU::_channels[Context::COUNTERS] = {
+                         /* CYCLES             */ 2,               // fixed CLOCK counter
+                         /* INSTRUCTIONS       */ 0,               // fixed INSTRUCTION counter
+                         /* BRANCH_MISSES      */ CHANNELS - 2,
+                         /* LLC_MISSES         */ CHANNELS - 1     // the same Page_Coloring reads
+};
+IA32_PMU::Count IA32_PMU::_mask;
+IA32_PMU::Count IA32_PMU::_last[CPUS][Context::COUNTERS];
+bool IA32_PMU::_virtualized[CPUS];
+IA32_PMU::Samples IA32_PMU::_samples[CPUS];
+
+// Class methods
+void IA32_PMU::collect(Context * ctx, bool account)
+{
+    if(!virtualized || !_mask) // this PMU can't be virtualized (see init())
+        return;
+
+    unsigned int cpu = Machine::cpu_id();
+    if(!_virtualized[cpu]) {
+        virtualize();
+        return;
+    }
+
+    for(unsigned int i = 0; i < Context::COUNTERS; i++) {
+        Count now = read(_channels[i]);
+        ctx->_count[i] += (now - _last[cpu][i]) & _mask;
+        if(account)
+            _last[cpu][i] = now;
+    }
+}
+
+// Programs this CPU's counters at its first dispatch
+void IA32_PMU::virtualize()
+{
+    unsigned int cpu = Machine::cpu_id();
+
+    db<PMU>(TRC) << "PMU::virtualize(cpu=" << cpu << ")" << endl;
+
+    config(_channels[Context::CYCLES], CLOCK);
+    config(_channels[Context::INSTRUCTIONS], INSTRUCTION);
+    config(_channels[Context::BRANCH_MISSES], BRANCH_MISS);
+    config(_channels[Context::LLC_MISSES], LLC_MISS);
+
+    if(sampling) {
+        // The clock counter overflows, and interrupts this CPU, every SAMPLING_PERIOD cycles
+        wrmsr(FIXED_CTR0 + _channels[Context::CYCLES], (_mask + 1 - SAMPLING_PERIOD) & _mask);
+        wrmsr(FIXED_CTR_CTL, rdmsr(FIXED_CTR_CTL) | (1ULL << CRT2_ENABLE_INT));
+        APIC::enable_perf();
+    }
+
+    for(unsigned int i = 0; i < Context::COUNTERS; i++)
+        _last[cpu][i] = read(_channels[i]);
+
+    _virtualized[cpu] = true;
+}
+
+// Called by IC at each PMI, with the instruction pointer it interrupted (see PC_IC::pmi())
+void IA32_PMU::sample(const Log_Addr & ip)
+{
+    Channel clock = _channels[Context::CYCLES];
+    if(!overflow(clock))
+        return;
+
+    // Rearm the counter for the next sample, moving the cycles it has counted since the last account() to _last
+    unsigned int cpu = Machine::cpu_id();
+    Count rearm = (_mask + 1 - SAMPLING_PERIOD) & _mask;
+    Count now = read(clock);
+    wrmsr(FIXED_CTR0 + clock, rearm);
+    wrmsr(GLOBAL_OVF, 1ULL << (CRT0_OVERFLOW + clock));
+    _last[cpu][Context::CYCLES] = (rearm - ((now - _last[cpu][Context::CYCLES]) & _mask)) & _mask;
+
+    Sample s;
+    s.ip = ip;
+    s.thread = This_Thread::id();
+    _samples[cpu].insert(s); // dropped if the ring is full
+}
+
 __END_SYS
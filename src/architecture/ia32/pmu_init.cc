@@ -16,7 +16,7 @@ void IA32_PMU::init()
     }
 
     // Enable rdpmc for any protection level
-    CPU::cr4((CPU::cr4() | CPU::CR4_PSE));
+    CPU::cr4((CPU::cr4() | CPU::CR4_PCE));
 
     Reg32 eax, ebx, ecx = 0, edx;
 
@@ -54,6 +54,16 @@ void IA32_PMU::init()
 	counters_fixed = edx & 0xf;
 
     db<Init, PMU>(INF) << "PMU::init:CPUID(10)={ver=" << version << ",counters=" << counters << ",width=" << cntval_bits << ",fixed counters=" << counters_fixed << "}" << endl;
+
+    // Virtual counters (see collect()) wrap around with the narrowest counter, either fixed or programmable
+    if(virtualized) {
+        if((version > 1) && (counters_fixed >= 3) && (unsigned(counters) + FIXED >= CHANNELS)) {
+            int fixed_bits = (edx >> 5) & 0xff;
+            int bits = (fixed_bits < cntval_bits) ? fixed_bits : cntval_bits;
+            _mask = (1ULL << bits) - 1;
+        } else
+            db<Init, PMU>(WRN) << "PMU::init: not enough counters! PMU won't be virtualized!" << endl;
+    }
 }
 
 __END_SYS
@@ -3,6 +3,7 @@
 #include <machine/pc/machine.h>
 #include <machine/pc/e100.h>
 #include <task.h>
+#include <semaphore.h>
 
 __BEGIN_SYS
 
@@ -39,6 +40,8 @@ E100::E100(unsigned int unit, const Log_Addr & io_mem, const IO_Irq & irq, DMA_B
     _irq = irq;
     csr = static_cast<CSR_Desc *>(io_mem);
     _dma_buffer = dma_buf;
+    _receiver = 0;
+    _rx_ready = 0;
 
     // Distribute the DMA_Buffer allocated by init()
     Log_Addr log = dma_buf->log_address();
@@ -546,65 +549,119 @@ void E100::handle_int() {
         if ((status & rus_suspended) && (stat_ack & stat_ack_rnr)) {
         }
 
-        for(int count = RX_BUFS; count && (_rx_ring[_rx_cur].status & cb_complete); count--, ++_rx_cur %= RX_BUFS) {
-            db<E100>(TRC) << "@ count = " << count << ", _rx_cur = " << _rx_cur << endl;
+        if(deferred && _receiver) {
+            if(_rx_ring[_rx_cur].status & cb_complete) {
+                // Mask the device's interrupts, the receiver thread will drain the ring and unmask them
+                i82559_disable_irq();
+                _rx_ready->v();
+            }
+        } else
+            poll(RX_BUFS);
 
-            // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
-            if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
-                Buffer * buf = _rx_buffer[_rx_cur];
-                Rx_Desc * desc = &_rx_ring[_rx_cur];
-                Frame * frame = buf->frame();
+        if ((status & cus_suspended)) {
+            _tx_cuc_suspended++;
+            if (_tx_frames_sent < _statistics.tx_packets) {
+                _tx_frames_sent = _statistics.tx_packets;
+                _tx_cuc_suspended--;
+                while(exec_command(cuc_resume, 0));
+            }
+        }
+    }
 
-                Frame * desc_frame = reinterpret_cast<Frame *>(desc->frame);
+    db<E100>(TRC) << "<" << endl;
 
-                // For the upper layers, size will represent the size of frame->data<T>()
-                unsigned int size = 0;
-                if(_rx_ring[_rx_cur].actual_size & 0xC000)
-                    size = _rx_ring[_rx_cur].actual_size & 0x3FFF;
-                buf->size(size);
+    CPU::int_enable();
+    // IC::enable(IC::irq2int(_irq));
+}
 
-                db<E100>(INF) << "E100::int:receive desc_frame(s=" << desc_frame->src() << ",d=" << desc_frame->dst() << ",p=" << hex << desc_frame->prot() << dec << ",t=" << (char *) desc_frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+// Handles up to budget received frames, returning how many were handled
+unsigned int E100::poll(unsigned int budget)
+{
+    unsigned int handled = 0;
+    for(int count = RX_BUFS; count && (handled < budget) && (_rx_ring[_rx_cur].status & cb_complete); count--, ++_rx_cur %= RX_BUFS) {
+        db<E100>(TRC) << "@ count = " << count << ", _rx_cur = " << _rx_cur << endl;
 
-                new (frame) Frame(desc_frame->src(), desc_frame->dst(), desc_frame->prot(), desc_frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
+        // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
+        if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
+            Buffer * buf = _rx_buffer[_rx_cur];
+            Rx_Desc * desc = &_rx_ring[_rx_cur];
+            Frame * frame = buf->frame();
 
-                db<E100>(INF) << "E100::int:receive(s=" << frame->src() << ",d=" << frame->dst() << ",p=" << hex << frame->header()->prot() << dec << ",t=" << (char *) frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+            Frame * desc_frame = reinterpret_cast<Frame *>(desc->frame);
 
-                db<E100>(INF) << "E100::handle_int:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
+            // For the upper layers, size will represent the size of frame->data<T>()
+            unsigned int size = 0;
+            if(_rx_ring[_rx_cur].actual_size & 0xC000)
+                size = _rx_ring[_rx_cur].actual_size & 0x3FFF;
+            buf->size(size);
 
-                _rx_ring[_rx_cur].command = cb_el;
-                _rx_ring[_rx_cur].status = Rx_RFD_NOT_FILLED;
+            db<E100>(INF) << "E100::poll:receive desc_frame(s=" << desc_frame->src() << ",d=" << desc_frame->dst() << ",p=" << hex << desc_frame->prot() << dec << ",t=" << (char *) desc_frame->data<void>() << ",s=" << buf->size() << ")" << endl;
 
-                // try to avoid ruc stop interrupts by "walking" the el bit
-                _rx_ring[_rx_last_el].command &= ~cb_el; // remove previous el bit
-                _rx_last_el = _rx_cur;
+            new (frame) Frame(desc_frame->src(), desc_frame->dst(), desc_frame->prot(), desc_frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
 
-                _statistics.rx_packets++;
-                _statistics.rx_bytes += size;
+            db<E100>(INF) << "E100::poll:receive(s=" << frame->src() << ",d=" << frame->dst() << ",p=" << hex << frame->header()->prot() << dec << ",t=" << (char *) frame->data<void>() << ",s=" << buf->size() << ")" << endl;
 
-                db<E100>(TRC) << "Will notify!" << endl;
-                if(!notify(frame->header()->prot(), buf)) { // No one was waiting for this frame, so let it free for receive()
-                    free(buf);
-                    db<E100>(TRC) << "Not notified!" << endl;
-                } else {
-                    db<E100>(TRC) << "Notified!" << endl;
-                }
-            }
-        }
+            db<E100>(INF) << "E100::poll:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
 
-        if ((status & cus_suspended)) {
-            _tx_cuc_suspended++;
-            if (_tx_frames_sent < _statistics.tx_packets) {
-                _tx_frames_sent = _statistics.tx_packets;
-                _tx_cuc_suspended--;
-                while(exec_command(cuc_resume, 0));
+            _rx_ring[_rx_cur].command = cb_el;
+            _rx_ring[_rx_cur].status = Rx_RFD_NOT_FILLED;
+
+            // try to avoid ruc stop interrupts by "walking" the el bit
+            _rx_ring[_rx_last_el].command &= ~cb_el; // remove previous el bit
+            _rx_last_el = _rx_cur;
+
+            _statistics.rx_packets++;
+            _statistics.rx_bytes += size;
+
+            db<E100>(TRC) << "Will notify!" << endl;
+            if(!notify(frame->header()->prot(), buf)) { // No one was waiting for this frame, so let it free for receive()
+                free(buf);
+                db<E100>(TRC) << "Not notified!" << endl;
+            } else {
+                db<E100>(TRC) << "Notified!" << endl;
             }
+
+            handled++;
         }
     }
 
-    db<E100>(TRC) << "<" << endl;
+    return handled;
+}
 
-    CPU::int_enable();
-    // IC::enable(IC::irq2int(_irq));
+void E100::defer()
+{
+    if(!deferred || _receiver)
+        return;
+
+    db<E100>(TRC) << "E100::defer(unit=" << _unit << ")" << endl;
+
+    _rx_ready = new (SYSTEM) Semaphore(0);
+    _receiver = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::HIGH), &receiver, this);
+}
+
+// Bottom half of the receive interrupt, see PCNet32::receiver()
+int E100::receiver(E100 * dev)
+{
+    bool polling = false;
+
+    while(true) {
+        if(!polling)
+            dev->_rx_ready->p();
+
+        bool busy = (dev->poll(BUDGET) == BUDGET);
+        if(busy != polling) {
+            polling = busy;
+            db<E100>(INF) << "E100::receiver: " << (polling ? "polling" : "interrupt") << " mode" << endl;
+            Thread::self()->priority(polling ? Thread::NORMAL : Thread::HIGH);
+        }
+
+        if(polling)
+            Thread::yield();
+        else
+            dev->i82559_enable_irq();
+    }
+
+    return 0;
 }
 
 void E100::i82559_configure(void)
@@ -1,6 +1,8 @@
 // EPOS PC Interrupt Dispatcher
 
 #include <machine/pc/ic.h>
+#include <mmu.h>
+#include <pmu.h>
 
 extern "C" { void _exit(int s); }
 extern "C" { void __exit(); }
@@ -161,11 +163,11 @@ void PC_IC::entry()
         "        jmp        .GO         \n"
         "        .align 16              \n"
         "        movl        $49, %0    \n"
+        "        jmp        .GO         \n"
+        "        .align 16              \n"
+        "        movl        $50, %0    \n"
         // On a regular PC, only the first 32 exceptions and the subsequent 16 interrupts are useful
-        // We also left two spare entries for multicore IPIs and an interrupt-based system call mechanism
-        //        "        jmp        .GO         \n"
-        //        "        .align 16              \n"
-        //        "        movl        $50, %0    \n"
+        // We also left three spare entries for multicore IPIs, an interrupt-based system call mechanism and PMIs
         //        "        jmp        .GO         \n"
         //        "        .align 16              \n"
         //        "        movl        $51, %0    \n"
@@ -804,10 +806,50 @@ void PC_IC::exc_not(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error)
     _exit(-1);
 }
 
+// Page faults are resumable (see MMU::fault()), so they go through a stub that preserves the registers and
+// returns to the faulting instruction if exc_pf() returns
+void PC_IC::exc_pf_entry()
+{
+    // Stack contents at this point are: [ss, esp,] eflags, cs, eip, error
+    ASM("       pusha                                           \n");
+    ASM("       pushl   32(%%esp)           # error             \n"
+        "       pushl   48(%%esp)           # eflags            \n"
+        "       pushl   48(%%esp)           # cs                \n"
+        "       pushl   48(%%esp)           # eip               \n"
+        "       call    *%0                                     \n"
+        "       addl    $16, %%esp                              \n"
+        "       popa                                            \n"
+        "       addl    $4, %%esp           # error             \n"
+        "       iret                                            \n" : : "c"(&exc_pf));
+}
+
+// Performance counter overflows are sampled (see PMU::sample()) through a stub that hands pmi() the interrupted instruction pointer
+void PC_IC::pmi_entry()
+{
+    // Stack contents at this point are: [ss, esp,] eflags, cs, eip
+    ASM("       pusha                                           \n");
+    ASM("       pushl   32(%%esp)           # eip               \n"
+        "       call    *%0                                     \n"
+        "       addl    $4, %%esp                               \n"
+        "       popa                                            \n"
+        "       iret                                            \n" : : "c"(&pmi));
+}
+
+void PC_IC::pmi(Reg32 eip)
+{
+    PMU::sample(eip);
+    APIC::eoi(INT_PMU);
+    APIC::enable_perf();
+}
+
 void PC_IC::exc_pf(Reg32 eip, Reg32 cs, Reg32 eflags, Reg32 error)
 {
     register Reg32 fr = CPU::fr();
 
+    // Demand-zero and copy-on-write pages are mapped on the first (write) access
+    if(MMU::fault(CPU::cr2(), error & (1 << 0), error & (1 << 1), error & (1 << 2)))
+        return;
+
     if(CPU::cr2() == reinterpret_cast<CPU::Reg32>(&__exit)) {
         db<IC,Machine>(INF) << "IC::exc_pf[address=" << reinterpret_cast<void *>(CPU::cr2()) << "]: final return!" << endl;
        _exit(fr);
@@ -2,6 +2,7 @@
 
 #include <cpu.h>
 #include <ic.h>
+#include <pmu.h>
 
 __BEGIN_SYS
 
@@ -20,15 +21,19 @@ void PC_IC::init()
             idt[i] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(entry) + CPU::EXC_LAST * 16, CPU::SEG_IDT_ENTRY);
 
     // Install some important exception handlers
-    idt[CPU::EXC_PF]     = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf),  CPU::SEG_IDT_ENTRY);
+    idt[CPU::EXC_PF]     = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf_entry),  CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_DOUBLE] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf),  CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_GPF]    = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_gpf), CPU::SEG_IDT_ENTRY);
-    idt[CPU::EXC_NODEV]  = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_fpu), CPU::SEG_IDT_ENTRY);
+    idt[CPU::EXC_NODEV]  = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Traits<FPU>::enabled ? Log_Addr(&CPU::fpu_trap) : Log_Addr(&exc_fpu), CPU::SEG_IDT_ENTRY);
 
     // Install the syscall trap handler
     if(Traits<Build>::MODE == Traits<Build>::KERNEL)
         idt[INT_SYSCALL] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&CPU::syscalled), CPU::SEG_IDT_ENTRY);
 
+    // Install the PMU's sampling interrupt handler
+    if(PMU::sampling)
+        idt[INT_PMU] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&pmi_entry), CPU::SEG_IDT_ENTRY);
+
     // Set all interrupt handlers to int_not()
     for(unsigned int i = 0; i < INTS; i++)
  	_int_vector[i] = int_not;
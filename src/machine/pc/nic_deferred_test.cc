@@ -0,0 +1,81 @@
+// EPOS PC_NIC Deferred Reception Test Program
+
+#include <utility/ostream.h>
+#include <nic.h>
+#include <alarm.h>
+
+using namespace EPOS;
+
+const NIC::Protocol PROT = 0x8888;
+const unsigned int BUDGET = Traits<Network>::BUDGET;
+const unsigned int FRAMES = 4 * BUDGET + 1; // full batches keep the receiver thread polling, the last one sends it back to sleep
+const unsigned int WAIT = 100; // delays of 100 ms the receiver waits for all FRAMES
+
+OStream cout;
+
+// Attaching to the NIC starts deferred reception, so frames get here from the NIC's receiver thread
+class Receiver: public NIC::Observer
+{
+public:
+    Receiver(NIC * nic): _nic(nic), received(0), misordered(0) { _nic->attach(this, PROT); }
+    ~Receiver() { _nic->detach(this, PROT); }
+
+    void update(NIC::Observed * obs, NIC::Protocol prot, NIC::Buffer * buf) {
+        unsigned int seq = *buf->frame()->data<unsigned int>();
+        if(seq != received)
+            misordered++;
+        received++;
+        _nic->free(buf);
+    }
+
+private:
+    NIC * _nic;
+
+public:
+    volatile unsigned int received;
+    volatile unsigned int misordered;
+};
+
+int main()
+{
+    NIC nic;
+    char data[nic.mtu()];
+
+    NIC::Address self = nic.address();
+    cout << "PC_NIC Deferred Reception Test" << endl;
+    cout << "  MAC: " << self << endl;
+
+    if(!Traits<Network>::deferred)
+        cout << "Deferred reception is disabled (see Traits<Network>::deferred)!" << endl;
+
+    if(self[5] % 2) { // sender
+        Alarm::delay(2000000); // give the receiver time to attach
+
+        memset(data, 0, nic.mtu());
+        for(unsigned int i = 0; i < FRAMES; i++) {
+            *reinterpret_cast<unsigned int *>(data) = i;
+            nic.send(nic.broadcast(), PROT, data, nic.mtu());
+        }
+        cout << "Sent " << FRAMES << " frames (budget=" << BUDGET << ")" << endl;
+    } else { // receiver
+        Receiver receiver(&nic);
+
+        for(unsigned int i = 0; (i < WAIT) && (receiver.received < FRAMES); i++)
+            Alarm::delay(100000);
+
+        cout << "Received " << receiver.received << " of " << FRAMES << " frames (budget=" << BUDGET
+             << "), " << receiver.misordered << " out of order" << endl;
+        cout << ((receiver.received == FRAMES) && !receiver.misordered ? "Passed!" : "Failed!") << endl;
+    }
+
+    NIC::Statistics stat = nic.statistics();
+    cout << "Statistics\n"
+         << "Tx Packets: " << stat.tx_packets << "\n"
+         << "Tx Bytes:   " << stat.tx_bytes << "\n"
+         << "Rx Packets: " << stat.rx_packets << "\n"
+         << "Rx Bytes:   " << stat.rx_bytes << "\n";
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
@@ -4,6 +4,8 @@
 #include <machine/pc/pcnet32.h>
 #include <utility/malloc.h>
 #include <alarm.h>
+#include <thread.h>
+#include <semaphore.h>
 
 __BEGIN_SYS
 
@@ -308,33 +310,15 @@ void PCNet32::handle_int()
         }
 
         if(csr0 & CSR0_RINT) { // Frame received (possibly multiple, let's handle a whole round on the ring buffer)
-
-            // Note that ISRs in EPOS are reentrant, that's why locking was carefully made atomic
-            // Therefore, several instances of this code can compete to handle received buffers
-
-            for(int count = RX_BUFS; count && !(_rx_ring[_rx_cur].status & Rx_Desc::OWN); count--, ++_rx_cur %= RX_BUFS) {
-                // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
-                if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
-                    Buffer * buf = _rx_buffer[_rx_cur];
-                    Rx_Desc * desc = &_rx_ring[_rx_cur];
-                    Frame * frame = buf->frame();
-
-                    // For the upper layers, size will represent the size of frame->data<T>()
-                    buf->size((desc->misc & 0x00000fff) - sizeof(Header) - sizeof(CRC));
-
-                    db<PCNet32>(TRC) << "PCNet32::int:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
-                                     << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                    db<PCNet32>(INF) << "PCNet32::handle_int:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
-
-                    IC::disable(IC::irq2int(_irq));
-                    if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so let it free for receive()
-                        free(buf);
-                    // TODO: this serialization is much too restrictive. It was done this way for students to play with
-                    IC::enable(IC::irq2int(_irq));
-                }
+            IC::disable(IC::irq2int(_irq));
+            if(deferred && _receiver)
+                _rx_ready->v(); // the receiver thread will drain the ring and unmask the IRQ
+            else {
+                poll(RX_BUFS);
+                // TODO: this serialization is much too restrictive. It was done this way for students to play with
+                IC::enable(IC::irq2int(_irq));
             }
- 	}
+        }
 
         if(csr0 & CSR0_ERR) { // Error
             db<PCNet32>(WRN) << "PCNet32::int:error =>";
@@ -364,6 +348,80 @@ void PCNet32::handle_int()
 }
 
 
+// Handles up to budget received frames, returning how many were handled
+unsigned int PCNet32::poll(unsigned int budget)
+{
+    // Note that ISRs in EPOS are reentrant, that's why locking was carefully made atomic
+    // Therefore, several instances of this code can compete to handle received buffers
+    unsigned int handled = 0;
+    for(int count = RX_BUFS; count && (handled < budget) && !(_rx_ring[_rx_cur].status & Rx_Desc::OWN); count--, ++_rx_cur %= RX_BUFS) {
+        // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
+        if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
+            Buffer * buf = _rx_buffer[_rx_cur];
+            Rx_Desc * desc = &_rx_ring[_rx_cur];
+            Frame * frame = buf->frame();
+
+            // For the upper layers, size will represent the size of frame->data<T>()
+            buf->size((desc->misc & 0x00000fff) - sizeof(Header) - sizeof(CRC));
+
+            db<PCNet32>(TRC) << "PCNet32::poll:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
+                             << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            db<PCNet32>(INF) << "PCNet32::poll:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
+
+            if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so let it free for receive()
+                free(buf);
+
+            handled++;
+        }
+    }
+
+    return handled;
+}
+
+
+void PCNet32::defer()
+{
+    if(!deferred || _receiver)
+        return;
+
+    db<PCNet32>(TRC) << "PCNet32::defer(unit=" << _unit << ")" << endl;
+
+    _rx_ready = new (SYSTEM) Semaphore(0);
+    _receiver = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::HIGH), &receiver, this);
+}
+
+
+// Bottom half of the receive interrupt. In interrupt mode, it sleeps at HIGH priority until the ISR masks the
+// NIC's IRQ and wakes it up. If a whole BUDGET of frames is then found in the ring, it switches to polling mode,
+// draining the ring in batches at NORMAL priority with the IRQ still masked, so a flood of frames can neither
+// trigger an interrupt per frame nor starve the other threads. It returns to interrupt mode once a batch comes
+// out short, unmasking the IRQ before sleeping (an interrupt in between just leaves the semaphore up).
+int PCNet32::receiver(PCNet32 * dev)
+{
+    bool polling = false;
+
+    while(true) {
+        if(!polling)
+            dev->_rx_ready->p();
+
+        bool busy = (dev->poll(BUDGET) == BUDGET);
+        if(busy != polling) {
+            polling = busy;
+            db<PCNet32>(INF) << "PCNet32::receiver: " << (polling ? "polling" : "interrupt") << " mode" << endl;
+            Thread::self()->priority(polling ? Thread::NORMAL : Thread::HIGH);
+        }
+
+        if(polling)
+            Thread::yield();
+        else
+            IC::enable(IC::irq2int(dev->_irq));
+    }
+
+    return 0;
+}
+
+
 void PCNet32::int_handler(const IC::Interrupt_Id & interrupt)
 {
     PCNet32 * dev = get_by_interrupt(interrupt);
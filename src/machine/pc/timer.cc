@@ -8,10 +8,96 @@ __BEGIN_SYS
 
 // Class attributes
 PC_Timer * PC_Timer::_channels[CHANNELS];
+TSC::Time_Stamp PC_Timer::_last;
+
+// Methods
+void PC_Timer::arm(const Tick & t)
+{
+    db<Timer>(TRC) << "Timer::arm(ch=" << _channel << ",t=" << t << ")" << endl;
+
+    if(!tickless) {
+        if(t)
+            _current[Machine::cpu_id()] = t;
+        return;
+    }
+
+    bool disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    account();
+    _armed = t;
+    _current[0] = t;
+    program();
+
+    if(!disabled)
+        CPU::int_enable();
+}
+
 
 // Class methods
+void PC_Timer::account()
+{
+    TSC::Time_Stamp tick = TSC::frequency() / FREQUENCY;
+    Count elapsed = (TSC::time_stamp() - _last) / tick;
+    if(!elapsed)
+        return;
+
+    _last += elapsed * tick; // fractions of a tick are accounted next time
+
+    for(unsigned int i = 0; i < CHANNELS; i++) {
+        PC_Timer * t = _channels[i];
+        if(t && t->_armed)
+            t->_current[0] = (t->_current[0] > elapsed) ? t->_current[0] - elapsed : 0;
+    }
+}
+
+
+void PC_Timer::program()
+{
+    Tick next = 0;
+    for(unsigned int i = 0; i < CHANNELS; i++) {
+        PC_Timer * t = _channels[i];
+        if(t && t->_armed) {
+            Tick remaining = t->_current[0] ? t->_current[0] : 1;
+            if(!next || (remaining < next))
+                next = remaining;
+        }
+    }
+
+    // With no channels armed, the engine is left to expire silently
+    if(next) {
+        Count count = Engine::clock() / FREQUENCY;
+        Tick max = Count(~0) / count; // longer time-outs take several shots
+        Engine::config(0, ((next < max) ? next : max) * count, true, false);
+    }
+}
+
+
 void PC_Timer::int_handler(const Interrupt_Id & i)
 {
+    if(tickless) {
+        bool due[CHANNELS];
+
+        account();
+        for(unsigned int c = 0; c < CHANNELS; c++) {
+            PC_Timer * t = _channels[c];
+            due[c] = t && t->_armed && !t->_current[0];
+            if(due[c]) {
+                if(t->_retrigger)
+                    t->_current[0] = t->_initial;
+                else
+                    t->_armed = false;
+            }
+        }
+        program(); // before the handlers, since the scheduler's might not return soon
+
+        for(unsigned int c = 0; c < CHANNELS; c++)
+            if(due[c] && _channels[c])
+                _channels[c]->_handler(i);
+
+        return;
+    }
+
     if(_channels[SCHEDULER] && (--_channels[SCHEDULER]->_current[Machine::cpu_id()] <= 0)) {
         _channels[SCHEDULER]->_current[Machine::cpu_id()] = _channels[SCHEDULER]->_initial;
         _channels[SCHEDULER]->_handler(i);
@@ -11,7 +11,10 @@ void PC_Timer::init()
 
     CPU::int_disable();
 
-    Engine::config(0, Engine::clock() / FREQUENCY);
+    if(tickless) // channels program the engine as they get armed
+        _last = TSC::time_stamp();
+    else
+        Engine::config(0, Engine::clock() / FREQUENCY);
 
     IC::int_vector(IC::INT_TIMER, int_handler);
     IC::enable(IC::INT_TIMER);
@@ -217,6 +217,17 @@ PC_Setup::PC_Setup(char * boot_image)
 
     Machine::smp_barrier(si->bm.n_cpus);
 
+    // Enable SSE on every CPU if the kernel is configured to use it or threads have their own FPU contexts
+    if(Traits<CPU>::sse2 || Traits<FPU>::enabled)
+        CPU::cr4(CPU::cr4() | CPU::CR4_OSFXSR | CPU::CR4_OSXMMEXCPT);
+
+    // Make the system honor read-only pages too, so its writes to copy-on-write pages fault like the applications' (see MMU::fault())
+    CPU::cr0(CPU::cr0() | CPU::CR0_WP);
+
+    // Make WAIT/FWAIT also trap on CR0.TS, so FPU contexts can be switched lazily (see CPU::fpu_trap())
+    if(Traits<FPU>::enabled)
+        CPU::cr0((CPU::cr0() & ~CPU::CR0_EM) | CPU::CR0_MP);
+
     db<Setup>(INF) << "IP=" << CPU::ip() << endl;
     db<Setup>(INF) << "SP=" << reinterpret_cast<void *>(CPU::sp()) << endl;
     db<Setup>(INF) << "CR0=" << reinterpret_cast<void *>(CPU::cr0()) << endl;
@@ -551,6 +562,10 @@ void PC_Setup::enable_paging()
     // Reload GDTR with its linear address (one more absurd from Intel!)
     CPU::gdtr(sizeof(Page) - 1, GDT);
 
+    // The physical memory window is mapped with 4 MiB pages (see setup_sys_pd())
+    if(Traits<MMU>::large_pages)
+        CPU::cr4(CPU::cr4() | CPU::CR4_PSE);
+
     // Set CR3 (PDBR) register
     CPU::cr3(si->pmm.sys_pd);
 
@@ -579,6 +594,10 @@ void PC_Setup::enable_paging()
 
     // Flush TLB to ensure we've got the right memory organization
     MMU::flush_tlb();
+
+    // Keep the system mappings (identical in every address space) in the TLB across CR3 reloads
+    if(Traits<MMU>::global_pages)
+        CPU::cr4(CPU::cr4() | CPU::CR4_PGE);
 }
 
 //========================================================================
@@ -663,38 +682,41 @@ void PC_Setup::setup_sys_pt()
     // Clear the System Page Table
     memset(sys_pt, 0, sizeof(Page));
 
+    // This page table is shared by all address spaces, so its pages are global
+    Flags sys = Traits<MMU>::global_pages ? (Flags::SYS | Flags::GLB) : Flags::SYS;
+
     // IDT
-    sys_pt[MMU::page(IDT)] = si->pmm.idt | Flags::SYS;
+    sys_pt[MMU::page(IDT)] = si->pmm.idt | sys;
 
     // GDT
-    sys_pt[MMU::page(GDT)] = si->pmm.gdt | Flags::SYS;
+    sys_pt[MMU::page(GDT)] = si->pmm.gdt | sys;
 
     // TSS0
-    sys_pt[MMU::page(TSS0)] = si->pmm.tss0 | Flags::SYS;
+    sys_pt[MMU::page(TSS0)] = si->pmm.tss0 | sys;
 
     // Set an entry to this page table, so the system can access it later
-    sys_pt[MMU::page(SYS_PT)] = si->pmm.sys_pt | Flags::SYS;
+    sys_pt[MMU::page(SYS_PT)] = si->pmm.sys_pt | sys;
 
     // System Page Directory
-    sys_pt[MMU::page(SYS_PD)] = si->pmm.sys_pd | Flags::SYS;
+    sys_pt[MMU::page(SYS_PD)] = si->pmm.sys_pd | sys;
 
     // System Info
-    sys_pt[MMU::page(SYS_INFO)] = si->pmm.sys_info | Flags::SYS;
+    sys_pt[MMU::page(SYS_INFO)] = si->pmm.sys_info | sys;
 
     unsigned int i;
     PT_Entry aux;
 
     // SYSTEM code
     for(i = 0, aux = si->pmm.sys_code; i < MMU::pages(si->lm.sys_code_size); i++, aux = aux + sizeof(Page))
-        sys_pt[MMU::page(SYS_CODE) + i] = aux | Flags::SYS;
+        sys_pt[MMU::page(SYS_CODE) + i] = aux | sys;
 
     // SYSTEM data
     for(i = 0, aux = si->pmm.sys_data; i < MMU::pages(si->lm.sys_data_size); i++, aux = aux + sizeof(Page))
-        sys_pt[MMU::page(SYS_DATA) + i] = aux | Flags::SYS;
+        sys_pt[MMU::page(SYS_DATA) + i] = aux | sys;
 
     // SYSTEM stack (used only during init and for the ukernel model)
     for(i = 0, aux = si->pmm.sys_stack; i < MMU::pages(si->lm.sys_stack_size); i++, aux = aux + sizeof(Page))
-        sys_pt[MMU::page(SYS_STACK) + i] = aux | Flags::SYS;
+        sys_pt[MMU::page(SYS_STACK) + i] = aux | sys;
 
     db<Setup>(INF) << "SPT=" << *reinterpret_cast<Page_Table *>(sys_pt) << endl;
 }
@@ -727,10 +749,16 @@ void PC_Setup::setup_sys_pd()
         pts[i] = (i * sizeof(Page)) | Flags::APP;
 
     // Attach all physical memory starting at PHY_MEM
+    // Regions fully backed by RAM are mapped with global 4 MiB pages, except for the first one, whose
+    // legacy holes (e.g. VGA, BIOS) have memory types that must not be mixed in a single large page
     for(int i = 0; i < n_pts; i++)
-        sys_pd[MMU::directory(PHY_MEM) + i] = (si->pmm.phy_mem_pts + i * sizeof(Page)) | Flags::SYS;
+        if(Traits<MMU>::large_pages && (i > 0) && ((i + 1) * MMU::LARGE_PAGE <= si->bm.mem_top))
+            sys_pd[MMU::directory(PHY_MEM) + i] = (i * MMU::LARGE_PAGE) | Flags::SYS | Flags::PS | (Traits<MMU>::global_pages ? Flags::GLB : 0);
+        else
+            sys_pd[MMU::directory(PHY_MEM) + i] = (si->pmm.phy_mem_pts + i * sizeof(Page)) | Flags::SYS;
 
     // Attach memory starting at MEM_BASE
+    // These mappings stay local: addresses this low belong to the applications in other address spaces
     for(unsigned int i = MMU::directory(MMU::align_directory(si->pmm.mem_base)); i < MMU::directory(MMU::align_directory(si->pmm.mem_top)); i++)
         sys_pd[i] = (si->pmm.phy_mem_pts + i * sizeof(Page)) | Flags::APP;
 
@@ -740,15 +768,16 @@ void PC_Setup::setup_sys_pd()
     io_size += VGA_SIZE / sizeof(Page); // Add room for VGA (64 kB, 16 pages)
     n_pts = (io_size + MMU::PT_ENTRIES - 1) / MMU::PT_ENTRIES;
 
-    // Map IO address space into the page tables pointed by io_pts
+    // Map IO address space into the page tables pointed by io_pts (shared by all address spaces, so global)
+    unsigned int glb = Traits<MMU>::global_pages ? Flags::GLB : 0;
     pts = reinterpret_cast<PT_Entry *>((void *)si->pmm.io_pts);
     unsigned int i = 0;
     for(; i < (APIC_SIZE / sizeof(Page)); i++)
-        pts[i] = (APIC_PHY + i * sizeof(Page)) | Flags::APIC;
+        pts[i] = (APIC_PHY + i * sizeof(Page)) | Flags::APIC | glb;
     for(unsigned int j = 0; i < ((APIC_SIZE / sizeof(Page)) + (VGA_SIZE / sizeof(Page))); i++, j++)
-        pts[i] = (VGA_PHY + j * sizeof(Page)) | Flags::VGA;
+        pts[i] = (VGA_PHY + j * sizeof(Page)) | Flags::VGA | glb;
     for(unsigned int j = 0; i < io_size; i++, j++)
-        pts[i] = (si->pmm.io_base + j * sizeof(Page)) | Flags::PCI;
+        pts[i] = (si->pmm.io_base + j * sizeof(Page)) | Flags::PCI | glb;
 
     // Attach devices' memory at Memory_Map<PC>::IO
     for(int i = 0; i < n_pts; i++)
@@ -0,0 +1,96 @@
+// EPOS Multicore Heap Test Program
+
+#include <utility/ostream.h>
+#include <utility/malloc.h>
+#include <machine.h>
+#include <thread.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const int ROUNDS = 1000;
+const int N = 64;
+const int MAX_CPUS = Traits<Build>::CPUS;
+
+char * blocks[MAX_CPUS][N];
+Thread * worker[MAX_CPUS];
+
+OStream cout;
+
+int churn(int cpu);
+int produce(int cpu);
+int consume(int cpu);
+Chronometer::Microsecond run(int (* entry)(int), unsigned int cpus);
+
+int main()
+{
+    cout << "Multicore Heap Test" << endl;
+    cout << "This test measures the allocation throughput of small blocks with one thread per CPU." << endl;
+    cout << "With per-CPU magazines, it should scale with the number of CPUs." << endl;
+
+    unsigned int cpus = Machine::n_cpus();
+
+    for(unsigned int n = 1; n <= cpus; n++) {
+        Chronometer::Microsecond elapsed = run(&churn, n);
+        long long ops = (long long)n * ROUNDS * N * 2;
+        cout << n << " CPU(s): " << ops << " ops in " << elapsed << " us => " << ops * 1000 / (elapsed ? elapsed : 1) << " ops/ms" << endl;
+    }
+
+    // Blocks allocated on a CPU and freed on its neighbour exercise the batched return to the shared heap
+    Chronometer::Microsecond elapsed = 0;
+    for(int r = 0; r < ROUNDS / 10; r++) {
+        run(&produce, cpus);
+        elapsed += run(&consume, cpus);
+    }
+    cout << "Cross-CPU frees: " << (long long)cpus * ROUNDS / 10 * N << " frees in " << elapsed << " us" << endl;
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+Chronometer::Microsecond run(int (* entry)(int), unsigned int cpus)
+{
+    Chronometer chrono;
+
+    chrono.start();
+    for(unsigned int i = 0; i < cpus; i++)
+        worker[i] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i)), entry, int(i));
+    for(unsigned int i = 0; i < cpus; i++)
+        worker[i]->join();
+    chrono.stop();
+
+    for(unsigned int i = 0; i < cpus; i++)
+        delete worker[i];
+
+    return chrono.read();
+}
+
+int churn(int cpu)
+{
+    for(int r = 0; r < ROUNDS; r++) {
+        for(int i = 0; i < N; i++)
+            blocks[cpu][i] = new char[8 + (i % 4) * 16];
+        for(int i = 0; i < N; i++)
+            delete[] blocks[cpu][i];
+    }
+
+    return 0;
+}
+
+int produce(int cpu)
+{
+    for(int i = 0; i < N; i++)
+        blocks[cpu][i] = new char[24];
+
+    return 0;
+}
+
+int consume(int cpu)
+{
+    int from = (cpu + 1) % Machine::n_cpus();
+    for(int i = 0; i < N; i++)
+        delete[] blocks[from][i];
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+// EPOS Heap Utility Test Program
+
+#include <utility/ostream.h>
+#include <utility/heap.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const unsigned int HEAP_SIZE = 256 * 1024;
+const int ROUNDS = 100;
+const int N = 256;
+
+char buffer[HEAP_SIZE];
+
+OStream cout;
+
+Chronometer::Microsecond churn(Simple_Heap * heap, unsigned int small, unsigned int large);
+void print(const Simple_Heap::Statistics & s);
+
+int main()
+{
+    cout << "Heap Utility Test" << endl;
+
+    Simple_Heap heap(buffer, HEAP_SIZE);
+
+    // Objects of 12 and 20 bytes, like list elements and ARP mappings, are served by
+    // the slab front-end, while 300-byte ones go through the first-fit search,
+    // whose cost grows with the fragmentation caused by interleaving both
+    cout << "Allocating and freeing " << N << " objects " << ROUNDS << " times:" << endl;
+
+    Chronometer::Microsecond t = churn(&heap, 12, 0);
+    cout << "small (12 bytes):\t" << t << " us => " << t * 1000 / (ROUNDS * N * 2) << " ns/op" << endl;
+
+    t = churn(&heap, 20, 300);
+    cout << "mixed (20/300 bytes):\t" << t << " us => " << t * 1000 / (ROUNDS * N * 2) << " ns/op" << endl;
+
+    t = churn(&heap, 0, 300);
+    cout << "large (300 bytes):\t" << t << " us => " << t * 1000 / (ROUNDS * N * 2) << " ns/op" << endl;
+
+    print(heap.statistics());
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+// Allocates N objects, alternating between small and large sizes (0 means the other one), and frees every other one
+// before freeing the rest, so the free regions of the heap get fragmented
+Chronometer::Microsecond churn(Simple_Heap * heap, unsigned int small, unsigned int large)
+{
+    void * p[N];
+    Chronometer chrono;
+
+    chrono.start();
+    for(int r = 0; r < ROUNDS; r++) {
+        for(int i = 0; i < N; i++)
+            p[i] = heap->alloc(((i & 1) && large) || !small ? large : small);
+        for(int i = 0; i < N; i += 2)
+            Simple_Heap::untyped_free(heap, p[i]);
+        for(int i = 1; i < N; i += 2)
+            Simple_Heap::untyped_free(heap, p[i]);
+    }
+    chrono.stop();
+
+    return chrono.read();
+}
+
+void print(const Simple_Heap::Statistics & s)
+{
+    cout << "Statistics:" << endl;
+    for(unsigned int i = 0; i < Simple_Heap::CLASSES; i++)
+        cout << "class " << (Simple_Heap::MIN_CLASS << i) << ":\talloc=" << s.allocations[i] << ",free=" << s.frees[i]
+             << ",slabs=" << s.slabs[i] << ",cached=" << s.cached[i] << endl;
+    cout << "large:\t\talloc=" << s.allocations[Simple_Heap::CLASSES] << ",free=" << s.frees[Simple_Heap::CLASSES] << endl;
+    cout << "in use=" << s.in_use << ",high water=" << s.high_water << ",free=" << s.free << ",fragments=" << s.fragments << endl;
+}
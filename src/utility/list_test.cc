@@ -15,6 +15,9 @@ void test_relative_list();
 void test_grouping_list();
 void test_simple_grouping_list();
 void test_scheduling_list();
+void test_bitmap_scheduling_list();
+void test_bitmap_scheduling_list_level();
+void test_heap_scheduling_list();
 
 OStream cout;
 
@@ -29,6 +32,9 @@ int main()
     test_relative_list();
     test_grouping_list();
     test_scheduling_list();
+    test_bitmap_scheduling_list();
+    test_bitmap_scheduling_list_level();
+    test_heap_scheduling_list();
 
     cout << "\nDone!" << endl;
 
@@ -471,3 +477,125 @@ void test_scheduling_list ()
     for(int i = 0; i < N; i++)
         delete e[i];
 }
+
+void test_bitmap_scheduling_list ()
+{
+    typedef Bitmap_Scheduling_List<int, Scheduling_Criteria::RM> List;
+
+    cout << "\nThis is a bitmap-indexed rate monotonic scheduling list of integers:" << endl;
+    List l;
+    int o[N];
+    List::Element * e[N];
+    cout << "Inserting the following integers into the list ";
+    for(int i = 0; i < N; i++) {
+        o[i] = i;
+        // Periods from 1 ms to 1 s, with duplicates
+        e[i] = new List::Element(&o[i], Scheduling_Criteria::RM(((i % 5) + 1) * 1000 * ((i & 1) ? 1 : 100)));
+        l.insert(e[i]);
+        cout << i << "(" << e[i]->rank() << "@" << e[i]->rank().level() << ")";
+        if(i != N - 1)
+            cout << ", ";
+    }
+    cout << endl;
+    cout << "The list has now " << l.size() << " elements" << endl;
+    cout << "Scheduling the list => " << *l.choose()->object() << endl;
+    cout << "Forcing scheduling of antorher element => " << *l.choose_another()->object() << endl;
+    cout << "Forcing scheduling of element whose value is " << o[N/2] << " => " << *l.choose(e[N/2])->object() << endl;
+    cout << "Removing the element whose value is " << o[N/4] << " => " << *l.remove(e[N/4])->object() << endl;
+    cout << "Removing all remaining elements in rank order => ";
+    while(l.size() > 0) {
+        cout << *l.remove(l.choose())->object();
+        if(l.size() > 0)
+            cout << ", ";
+    }
+    cout << endl;
+    cout << "The list has now " << l.size() << " elements" << endl;
+    for(int i = 0; i < N; i++)
+        delete e[i];
+}
+
+void test_bitmap_scheduling_list_level ()
+{
+    typedef Bitmap_Scheduling_List<int, Scheduling_Criteria::RM> List;
+    const int M = 25;
+
+    cout << "\nThis is a bitmap-indexed rate monotonic scheduling list of integers whose periods share a level:" << endl;
+    List l;
+    int o[M];
+    List::Element * e[M];
+    cout << "Inserting the following integers into the list ";
+    for(int i = 0; i < M; i++) {
+        o[i] = i;
+        // 12 periods, each twice, from 1040 to 1216 us (plus 1024 for the first), more than a level keeps runs for
+        e[i] = new List::Element(&o[i], Scheduling_Criteria::RM(i ? 1040 + ((i * 7) % 12) * 16 : 1024));
+        l.insert(e[i]);
+        cout << i << "(" << e[i]->rank() << "@" << e[i]->rank().level() << ")";
+        if(i != M - 1)
+            cout << ", ";
+    }
+    cout << endl;
+    cout << "Removing the elements whose values are " << o[5] << ", " << o[12] << ", and " << o[17] << endl;
+    l.remove(e[5]);
+    l.remove(e[12]);
+    l.remove(e[17]);
+    cout << "Removing all remaining elements in rank order => ";
+    bool ordered = true;
+    List::Element * last = 0;
+    while(l.chosen()) {
+        List::Element * x = l.remove(l.chosen()); // choose() would send the chosen one to the back of its run
+        cout << *x->object();
+        if(l.chosen())
+            cout << ", ";
+        // Ranks must not decrease, and equal ranks must come out in the order they went in
+        if(last && ((int(x->rank()) < int(last->rank())) || ((int(x->rank()) == int(last->rank())) && (*x->object() < *last->object()))))
+            ordered = false;
+        last = x;
+    }
+    cout << endl;
+    cout << "The elements came out " << (ordered ? "in order" : "out of order!") << endl;
+    for(int i = 0; i < M; i++)
+        delete e[i];
+}
+
+void test_heap_scheduling_list ()
+{
+    typedef Heap_Scheduling_List<int, Scheduling_Criteria::Priority> List;
+
+    cout << "\nThis is a pairing heap priority scheduling list of integers:" << endl;
+    List l;
+    int o[N];
+    List::Element * e[N];
+    cout << "Inserting the following integers into the list ";
+    for(int i = 0; i < N; i++) {
+        o[i] = i;
+        e[i] = new List::Element(&o[i], (i * 7) % N);
+        l.insert(e[i]);
+        cout << i << "(" << (i * 7) % N << ")";
+        if(i != N - 1)
+            cout << ", ";
+    }
+    cout << endl;
+    cout << "The list has now " << l.size() << " elements" << endl;
+    cout << "They are (in heap order): ";
+    for(List::Iterator i = l.begin(); i != l.end(); i++)
+        cout << *i->object() << " ";
+    cout << endl;
+    cout << "Scheduling the list => " << *l.choose()->object() << endl;
+    cout << "Forcing scheduling of antorher element => " << *l.choose_another()->object() << endl;
+    cout << "Forcing scheduling of element whose value is " << o[N/2] << " => " << *l.choose(e[N/2])->object() << endl;
+    cout << "Removing the element whose value is " << o[N/4] << " => " << *l.remove(e[N/4])->object() << endl;
+    cout << "Promoting the element whose value is " << o[N - 1] << " to rank 0" << endl;
+    l.remove(e[N - 1]);
+    e[N - 1]->rank(0);
+    l.insert(e[N - 1]);
+    cout << "Removing all remaining elements in rank order => ";
+    while(l.size() > 0) {
+        cout << *l.remove(l.choose())->object();
+        if(l.size() > 0)
+            cout << ", ";
+    }
+    cout << endl;
+    cout << "The list has now " << l.size() << " elements" << endl;
+    for(int i = 0; i < N; i++)
+        delete e[i];
+}
@@ -0,0 +1,92 @@
+// EPOS Hashed Observer Utility Test Program
+
+#include <utility/ostream.h>
+#include <utility/observer.h>
+#include <utility/hash.h>
+
+using namespace EPOS;
+
+const unsigned int BUCKETS = 64; // as Traits<UDP>::DEMUX and Traits<TCP>::DEMUX
+const unsigned int N = 5;
+
+OStream cout;
+
+template<typename C>
+class Counter: public Data_Observer<int, C>
+{
+public:
+    Counter(): updates(0) {}
+
+    void update(Data_Observed<int, C> * o, C c, int * d) { updates++; }
+
+    unsigned int updates;
+};
+
+// Attaches N observers whose conditions share a bucket, detaches the first, the middle, and the last of them,
+// and checks that notify() reaches exactly the survivors
+template<typename C>
+int test(const char * name, C base)
+{
+    Hashed_Data_Observed<int, C, BUCKETS> observed;
+    Counter<C> observers[N];
+    C conditions[N];
+
+    conditions[0] = base;
+    for(unsigned int n = 1; n < N; n++)
+        for(conditions[n] = conditions[n - 1] + 1; hash(conditions[n], BUCKETS) != hash(base, BUCKETS); conditions[n]++);
+
+    cout << name << ": bucket " << hash(base, BUCKETS) << " holds";
+    for(unsigned int i = 0; i < N; i++) {
+        cout << " " << conditions[i];
+        observed.attach(&observers[i], conditions[i]);
+    }
+    cout << endl;
+
+    bool detached[N];
+    for(unsigned int i = 0; i < N; i++) {
+        detached[i] = (i == 0) || (i == N / 2) || (i == N - 1);
+        if(detached[i])
+            observed.detach(&observers[i], conditions[i]);
+    }
+
+    int failures = 0;
+    int data = 0;
+    for(unsigned int i = 0; i < N; i++) {
+        bool notified = observed.notify(conditions[i], &data);
+        unsigned int expected = detached[i] ? 0 : 1;
+        if((notified != !detached[i]) || (observers[i].updates != expected)) {
+            cout << "  " << conditions[i] << (detached[i] ? " (detached)" : "") << " was notified " << observers[i].updates << " times!" << endl;
+            failures++;
+        }
+    }
+
+    // Survivors are detached too, so nothing is left behind in the bucket
+    for(unsigned int i = 0; i < N; i++)
+        if(!detached[i])
+            observed.detach(&observers[i], conditions[i]);
+    for(unsigned int i = 0; i < N; i++)
+        if(observed.notify(conditions[i], &data) || observed.observer(conditions[i])) {
+            cout << "  " << conditions[i] << " is still attached!" << endl;
+            failures++;
+        }
+
+    return failures;
+}
+
+int main()
+{
+    cout << "Hashed Observer Utility Test" << endl;
+
+    int failures = 0;
+
+    // UDP ports
+    failures += test<unsigned short>("UDP", 5000);
+
+    // TCP connection ids: peer 10.0.0.2, remote port 80, and consecutive local ports
+    failures += test<unsigned long long>("TCP", (0x0a000002ULL << 32) | (80 << 16) | 5000);
+
+    cout << (failures ? "Failed!" : "Passed!") << endl;
+    cout << "The end!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+// EPOS Ring Buffer Utility Test Program
+
+#include <utility/ostream.h>
+#include <utility/queue.h>
+#include <utility/ring.h>
+#include <machine.h>
+#include <thread.h>
+#include <semaphore.h>
+#include <chronometer.h>
+
+using namespace EPOS;
+
+const int MESSAGES = 100000; // per producer
+const unsigned int SLOTS = 256;
+const int MAX_CPUS = Traits<Build>::CPUS;
+
+// Baseline: a locked list queue with a semaphore per message (and per free slot)
+struct Message
+{
+    typedef List_Elements::Doubly_Linked<Message> Element;
+
+    Message(): element(this) {}
+
+    int value;
+    Element element;
+};
+
+Queue_Wrapper<List<Message>, true> queue;
+Semaphore * queued;
+Semaphore * room;
+Message pool[MAX_CPUS][SLOTS];
+
+Blocking_Ring<SPSC_Ring<int, SLOTS> > spsc;
+Blocking_Ring<MPSC_Ring<int, SLOTS> > mpsc;
+Blocking_Ring<MPMC_Ring<int, SLOTS> > mpmc;
+
+long long sums[MAX_CPUS];
+Thread * producer[MAX_CPUS];
+Thread * consumer[MAX_CPUS];
+
+OStream cout;
+
+template<typename R>
+int send(R * ring, int n);
+template<typename R>
+int receive(R * ring, int cpu, int n);
+int enqueue(int cpu, int n);
+int dequeue(int cpu, int n);
+void run(const char * name, int (* produce)(int, int), int (* consume)(int, int), unsigned int producers, unsigned int consumers);
+
+int send_spsc(int cpu, int n) { return send(&spsc, n); }
+int receive_spsc(int cpu, int n) { return receive(&spsc, cpu, n); }
+int send_mpsc(int cpu, int n) { return send(&mpsc, n); }
+int receive_mpsc(int cpu, int n) { return receive(&mpsc, cpu, n); }
+int send_mpmc(int cpu, int n) { return send(&mpmc, n); }
+int receive_mpmc(int cpu, int n) { return receive(&mpmc, cpu, n); }
+
+int main()
+{
+    cout << "Ring Buffer Utility Test" << endl;
+    cout << "This test measures the throughput of lock-free rings with blocking wrappers against a locked queue with a semaphore per message." << endl;
+
+    unsigned int cpus = Machine::n_cpus();
+
+    run("Queue 1:1", &enqueue, &dequeue, 1, 1);
+    run("SPSC 1:1", &send_spsc, &receive_spsc, 1, 1);
+
+    for(unsigned int n = 2; n <= cpus; n++) {
+        run("Queue N:1", &enqueue, &dequeue, n - 1, 1);
+        run("MPSC N:1", &send_mpsc, &receive_mpsc, n - 1, 1);
+    }
+
+    for(unsigned int n = 1; n <= cpus; n++) {
+        run("Queue N:N", &enqueue, &dequeue, n, n);
+        run("MPMC N:N", &send_mpmc, &receive_mpmc, n, n);
+    }
+
+    cout << "The end!" << endl;
+
+    return 0;
+}
+
+// Producers and consumers are spread over the CPUs, each producer sends MESSAGES, which are evenly split among consumers
+void run(const char * name, int (* produce)(int, int), int (* consume)(int, int), unsigned int producers, unsigned int consumers)
+{
+    unsigned int cpus = Machine::n_cpus();
+    long long messages = (long long)producers * MESSAGES;
+    Chronometer chrono;
+
+    queued = new Semaphore(0);
+    room = new Semaphore(SLOTS);
+
+    chrono.start();
+    for(unsigned int i = 0; i < consumers; i++)
+        consumer[i] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, (producers + i) % cpus)), consume, int(i), int(messages / consumers));
+    for(unsigned int i = 0; i < producers; i++)
+        producer[i] = new Thread(Thread::Configuration(Thread::READY, Thread::Criterion(Thread::NORMAL, i % cpus)), produce, int(i), MESSAGES);
+    for(unsigned int i = 0; i < producers; i++)
+        producer[i]->join();
+    for(unsigned int i = 0; i < consumers; i++)
+        consumer[i]->join();
+    chrono.stop();
+
+    for(unsigned int i = 0; i < producers; i++)
+        delete producer[i];
+    for(unsigned int i = 0; i < consumers; i++)
+        delete consumer[i];
+    delete queued;
+    delete room;
+
+    long long sum = 0;
+    for(unsigned int i = 0; i < consumers; i++)
+        sum += sums[i];
+
+    Chronometer::Microsecond elapsed = chrono.read();
+    long long expected = messages * (MESSAGES - 1) / 2;
+    cout << name << " (" << producers << ":" << consumers << "): " << messages << " messages in " << elapsed << " us => "
+         << messages * 1000 / (elapsed ? elapsed : 1) << " msgs/ms" << ((sum == expected) ? "" : " (wrong sum!)") << endl;
+}
+
+template<typename R>
+int send(R * ring, int n)
+{
+    for(int i = 0; i < n; i++)
+        ring->send(i);
+
+    return 0;
+}
+
+template<typename R>
+int receive(R * ring, int cpu, int n)
+{
+    long long s = 0;
+    for(int i = 0; i < n; i++)
+        s += ring->receive();
+    sums[cpu] = s;
+
+    return 0;
+}
+
+int enqueue(int cpu, int n)
+{
+    // room limits the queue to SLOTS messages, so a message of the pool is never reused while still queued
+    for(int i = 0; i < n; i++) {
+        Message * m = &pool[cpu][i % SLOTS];
+        room->p();
+        m->value = i;
+        queue.insert(&m->element);
+        queued->v();
+    }
+
+    return 0;
+}
+
+int dequeue(int cpu, int n)
+{
+    long long s = 0;
+    for(int i = 0; i < n; i++) {
+        queued->p();
+        s += queue.remove()->object()->value;
+        room->v();
+    }
+    sums[cpu] = s;
+
+    return 0;
+}